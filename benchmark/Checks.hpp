@@ -0,0 +1,40 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef BENCHMARK_CHECKS_HPP
+#define BENCHMARK_CHECKS_HPP
+
+#include <cstdio>
+
+// Pass/fail reporting shared by the test programs in this directory.
+// Each of them is a single source file, so the state can be static.
+
+//! Number of failed checks, which makes the exit code 1 if not zero.
+static int failureCount = 0;
+
+//! Prints the result of a check and counts it if it failed.
+static void
+check(bool condition, const char* description)
+{
+	printf("%s: %s\n", condition ? "PASS" : "FAIL", description);
+	if (!condition)
+		failureCount++;
+}
+
+#endif//BENCHMARK_CHECKS_HPP
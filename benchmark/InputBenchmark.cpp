@@ -0,0 +1,357 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// Measures the per-frame cost of the plug-in's input processing without
+// Stellarium or any real devices. Synthetic devices of various sizes are fed
+// pre-generated states, and recorded traces can be replayed with --trace.
+// The exit code is 1 if any synthetic workload allocates memory per frame.
+
+#include "AllocationCounter.hpp"
+#include "DeviceSet.hpp"
+#include "InputProcessor.hpp"
+#include "MovementSink.hpp"
+#include "TracePlayer.hpp"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QSettings>
+#include <QStringList>
+#include <QTemporaryFile>
+#include <QVector>
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+//! Stands in for StelMovementMgr and StelCore, doing as little as possible.
+class BenchmarkSink : public MovementSink
+{
+public:
+	BenchmarkSink() : calls(0), fov(60.0) {}
+
+	virtual void performAction(int, bool) {calls++;}
+	virtual void setMovementFlag(int, bool) {calls++;}
+	virtual double getCurrentFov() {return fov;}
+	virtual void panView(double, double) {calls++;}
+	virtual void changeFov(double deltaFov)
+	{
+		calls++;
+		fov += deltaFov;
+		if (fov < 1.0 || fov > 180.0)
+			fov = 60.0;
+	}
+
+	quint64 calls;
+	double fov;
+};
+
+enum Workload
+{
+	//! Nothing moves, the common case.
+	WorkloadIdle,
+	//! All axes sweep continuously and a few buttons change in each sample.
+	WorkloadActive
+};
+
+struct Scenario
+{
+	const char* name;
+	int deviceCount;
+	bool isGamepad;
+	int axisCount;
+	int buttonCount;
+	int hatCount;
+	int ballCount;
+	Workload workload;
+	//! Whether the axes pass through the AxisFilter.
+	bool filtered;
+};
+
+static const Scenario scenarios[] =
+{
+	{"gamepad, idle", 1, true, SDL_CONTROLLER_AXIS_MAX, SDL_CONTROLLER_BUTTON_MAX, 0, 0, WorkloadIdle, false},
+	{"gamepad, active", 1, true, SDL_CONTROLLER_AXIS_MAX, SDL_CONTROLLER_BUTTON_MAX, 0, 0, WorkloadActive, false},
+	{"joystick, idle", 1, false, 4, 32, 1, 0, WorkloadIdle, false},
+	{"joystick, active", 1, false, 4, 32, 1, 0, WorkloadActive, false},
+	{"3 x 128 buttons, idle", 3, false, 8, 128, 4, 0, WorkloadIdle, false},
+	{"3 x 128 buttons, active", 3, false, 8, 128, 4, 0, WorkloadActive, false},
+	{"6 x 128 buttons, idle", 6, false, 8, 128, 4, 0, WorkloadIdle, false},
+	{"6 x 128 buttons, active", 6, false, 8, 128, 4, 0, WorkloadActive, false},
+	{"trackball, idle", 1, false, 2, 4, 0, 2, WorkloadIdle, false},
+	{"trackball, active", 1, false, 2, 4, 0, 2, WorkloadActive, false},
+	{"6 x 128 buttons, filtered", 6, false, 8, 128, 4, 0, WorkloadActive, true},
+	{NULL, 0, false, 0, 0, 0, 0, WorkloadIdle, false}
+};
+
+//! Samples per frame, as with the background sampler at 480 Hz and 60 fps.
+static const int samplesPerFrame = 8;
+//! Number of pre-generated states, cycled through.
+static const int sampleCount = 1024;
+
+//! Binds every joystick button to one of the built-in actions.
+static void
+writeBindings(QSettings& conf)
+{
+	static const char* actions[] =
+	{
+		"turn_up", "turn_down", "turn_left", "turn_right", "zoom_in",
+		"zoom_out", "move_slow", "toggle_mount_mode", "set_time_now",
+		"press:increase_time_speed", "release:decrease_time_speed"
+	};
+	const int actionCount = sizeof(actions) / sizeof(actions[0]);
+	for (int i = 0; i < InputSnapshot::MaxButtons; i++)
+		conf.setValue(QString("JoystickSupport_joystick/button%1").arg(i),
+		              actions[i % actionCount]);
+	conf.setValue("JoystickSupport_joystick/hat0_up", "turn_up");
+	conf.setValue("JoystickSupport_joystick/axis3+", "zoom_in");
+	conf.sync();
+}
+
+static void
+generateSamples(const Scenario& scenario, QVector<InputSnapshot>& samples)
+{
+	samples.resize(sampleCount);
+	for (int s = 0; s < sampleCount; s++)
+	{
+		InputSnapshot& sample = samples[s];
+		memset(&sample, 0, sizeof(sample));
+		// As if sampled at 480 Hz. The filters restart when the samples wrap.
+		sample.timestamp = (s + 1) * SDL_GetPerformanceFrequency() / 480;
+		if (scenario.workload == WorkloadIdle)
+			continue;
+		for (int d = 0; d < scenario.deviceCount; d++)
+		{
+			for (int a = 0; a < scenario.axisCount; a++)
+			{
+				double phase = 2 * M_PI * (s + 37 * a + 101 * d) / sampleCount;
+				sample.axes[d * InputSnapshot::MaxAxes + a] = Sint16(32767 * std::sin(phase));
+			}
+			// Each button is held for a while, as by a person.
+			for (int b = 0; b < scenario.buttonCount; b++)
+			{
+				if (((s / 64 + b * 7 + d) % 16) == 0)
+					sample.setButton(d, b);
+			}
+			for (int h = 0; h < scenario.hatCount; h++)
+				sample.hats[d * InputSnapshot::MaxHats + h] = (s / 128) % 2 ? SDL_HAT_UP : 0;
+			// Small motion in every sample, as from a ball being rolled.
+			for (int b = 0; b < scenario.ballCount; b++)
+			{
+				int* ball = sample.balls + (d * InputSnapshot::MaxBalls + b) * 2;
+				ball[0] = (s % 7) - 3;
+				ball[1] = (s % 5) - 2;
+			}
+		}
+	}
+}
+
+struct Result
+{
+	double nsPerFrame;
+	double allocationsPerFrame;
+};
+
+static Result
+runScenario(const Scenario& scenario, QSettings& conf, int frames)
+{
+	DeviceSet devices;
+	for (int d = 0; d < scenario.deviceCount; d++)
+	{
+		DeviceCapabilities caps;
+		caps.axisCount = scenario.axisCount;
+		caps.buttonCount = scenario.buttonCount;
+		caps.hatCount = scenario.hatCount;
+		caps.ballCount = scenario.ballCount;
+		caps.isGamepad = scenario.isGamepad;
+		memset(&caps.guid, 0, sizeof(caps.guid));
+		caps.guid.data[0] = d;
+		caps.name = scenario.name;
+		devices.openReplayed(caps, d);
+	}
+
+	if (scenario.filtered)
+	{
+		conf.setValue("JoystickSupport/axis_filter_min_cutoff", 1.0);
+		conf.setValue("JoystickSupport/axis_filter_beta", 0.5);
+	}
+	BenchmarkSink sink;
+	InputProcessor processor;
+	processor.configure(&conf);
+	processor.setSink(&sink);
+	processor.compileBindings(&conf, devices);
+	conf.remove("JoystickSupport/axis_filter_min_cutoff");
+	conf.remove("JoystickSupport/axis_filter_beta");
+
+	QVector<InputSnapshot> samples;
+	generateSamples(scenario, samples);
+
+	// Warm-up, also lets the bindings settle.
+	int next = 0;
+	for (int f = 0; f < 100; f++)
+	{
+		for (int s = 0; s < samplesPerFrame; s++)
+			processor.processSnapshot(devices, samples[next++ % sampleCount]);
+		processor.finishFrame();
+	}
+
+	const InputSnapshot* data = samples.constData();
+	quint64 allocationsBefore = AllocationCounter::count();
+	QElapsedTimer timer;
+	timer.start();
+	for (int f = 0; f < frames; f++)
+	{
+		for (int s = 0; s < samplesPerFrame; s++)
+			processor.processSnapshot(devices, data[next++ % sampleCount]);
+		processor.finishFrame();
+	}
+	qint64 elapsed = timer.nsecsElapsed();
+	quint64 allocations = AllocationCounter::count() - allocationsBefore;
+
+	Result result;
+	result.nsPerFrame = double(elapsed) / frames;
+	result.allocationsPerFrame = double(allocations) / frames;
+	return result;
+}
+
+//! Replays a trace as fast as possible, repeating it until at least
+//! @p frames frames have been processed.
+static bool
+runTrace(const QString& path, QSettings& conf, int frames, Result& result)
+{
+	TracePlayer player;
+	if (!player.open(path))
+		return false;
+
+	BenchmarkSink sink;
+	InputProcessor processor;
+	processor.configure(&conf);
+	processor.setSink(&sink);
+
+	DeviceSet devices;
+	TracePlayer::Record record;
+	int processedFrames = 0;
+	quint64 allocationsBefore = AllocationCounter::count();
+	QElapsedTimer timer;
+	timer.start();
+	while (processedFrames < frames)
+	{
+		int passFrames = 0;
+		while (player.next(record, devices.current))
+		{
+			switch (record.type)
+			{
+			case TraceFormat::RecordAttach:
+				devices.openReplayed(record.caps, record.instanceId);
+				processor.compileBindings(&conf, devices);
+				break;
+			case TraceFormat::RecordDetach:
+				devices.close(record.slot);
+				processor.compileBindings(&conf, devices);
+				break;
+			case TraceFormat::RecordSample:
+				processor.processSnapshot(devices, devices.current);
+				break;
+			case TraceFormat::RecordFrame:
+				processor.finishFrame();
+				passFrames++;
+				break;
+			}
+		}
+		if (passFrames == 0)
+		{
+			fprintf(stderr, "The trace %s contains no frames.\n",
+			        path.toLocal8Bit().constData());
+			return false;
+		}
+		processedFrames += passFrames;
+		devices.closeAll();
+		player.rewind();
+	}
+	qint64 elapsed = timer.nsecsElapsed();
+	quint64 allocations = AllocationCounter::count() - allocationsBefore;
+
+	result.nsPerFrame = double(elapsed) / processedFrames;
+	result.allocationsPerFrame = double(allocations) / processedFrames;
+	return true;
+}
+
+static void
+printResult(const QString& name, int devices, int buttons, const Result& result)
+{
+	printf("%-28s %7d %7d %11.1f %13.2f\n", name.toLocal8Bit().constData(),
+	       devices, buttons, result.nsPerFrame, result.allocationsPerFrame);
+}
+
+int
+main(int argc, char* argv[])
+{
+	QCoreApplication app(argc, argv);
+	QStringList arguments = app.arguments();
+	int frames = 20000;
+	QStringList traces;
+	for (int i = 1; i < arguments.count(); i++)
+	{
+		if (arguments[i] == "--frames" && i + 1 < arguments.count())
+			frames = qMax(1, arguments[++i].toInt());
+		else if (arguments[i] == "--trace" && i + 1 < arguments.count())
+			traces << arguments[++i];
+		else
+		{
+			fprintf(stderr, "Usage: %s [--frames N] [--trace FILE]...\n",
+			        argv[0]);
+			return 2;
+		}
+	}
+
+	QTemporaryFile settingsFile;
+	if (!settingsFile.open())
+	{
+		fprintf(stderr, "Unable to create a temporary settings file.\n");
+		return 2;
+	}
+	QSettings conf(settingsFile.fileName(), QSettings::IniFormat);
+	writeBindings(conf);
+
+	printf("%d frames, %d samples per frame\n", frames, samplesPerFrame);
+	printf("%-28s %7s %7s %11s %13s\n",
+	       "workload", "devices", "buttons", "ns/frame", "allocs/frame");
+	bool allocated = false;
+	for (int i = 0; scenarios[i].name != NULL; i++)
+	{
+		Result result = runScenario(scenarios[i], conf, frames);
+		printResult(scenarios[i].name, scenarios[i].deviceCount,
+		            scenarios[i].buttonCount, result);
+		if (result.allocationsPerFrame > 0)
+			allocated = true;
+	}
+	for (int i = 0; i < traces.count(); i++)
+	{
+		// Traces include device changes, which do allocate memory.
+		Result result;
+		if (runTrace(traces[i], conf, frames, result))
+			printResult(traces[i], 0, 0, result);
+	}
+
+	if (allocated)
+	{
+		fprintf(stderr, "Memory was allocated while processing input.\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,288 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// Checks how RemoteInputServer filters datagrams (out of order, stale,
+// malformed, disconnections), then measures the latency and jitter of remote
+// input over the loopback interface: datagrams are sent at a fixed rate from
+// this process to the server's thread, and the time from sending each one to
+// its arrival in the server is recorded. The exit code is 1 if any check fails.
+
+#include "Checks.hpp"
+#include "LatencyHistogram.hpp"
+#include "RemoteInputServer.hpp"
+
+#include <QCoreApplication>
+#include <QStringList>
+#include <QUdpSocket>
+
+#include <cstdio>
+#include <cstring>
+
+static quint64
+microseconds(Uint64 ticks)
+{
+	return quint64(ticks * 1000000.0 / SDL_GetPerformanceFrequency());
+}
+
+//! Writes a datagram of a game controller with one button pressed.
+static int
+writePacket(char* buffer, int source, int flags, quint32 session,
+            quint32 sequence, quint64 sendTime, int button)
+{
+	static InputSnapshot state;
+	DeviceCapabilities caps;
+	caps.axisCount = SDL_CONTROLLER_AXIS_MAX;
+	caps.buttonCount = SDL_CONTROLLER_BUTTON_MAX;
+	caps.hatCount = 0;
+	caps.ballCount = 0;
+	caps.isGamepad = true;
+	memset(&caps.guid, 0, sizeof(caps.guid));
+	memset(&state, 0, sizeof(state));
+	state.axes[0] = -1234;
+	state.setButton(0, button);
+	return RemoteFormat::writePacket(buffer, source, flags, session, sequence,
+	                                 sendTime, caps, state, 0);
+}
+
+//! @returns the number of events in the server's buffer, leaving the last
+//! one in @p event.
+static int
+popEvents(RemoteInputServer& server, RemoteInputServer::Event& event)
+{
+	int count = 0;
+	while (server.popEvent(event))
+		count++;
+	return count;
+}
+
+static void
+runChecks()
+{
+	RemoteInputServer server;
+	server.setTimeouts(100, 1000);
+	const Uint64 second = SDL_GetPerformanceFrequency();
+	const Uint64 ms = second / 1000;
+	// The sender's clock is far from the receiver's.
+	const Uint64 t0 = 100 * second;
+	const quint64 sendStart = 5000000000ULL;
+	char buffer[RemoteFormat::MaxPacketSize];
+	RemoteInputServer::Event event;
+	int size;
+
+	size = writePacket(buffer, 1, 0, 7, 10, sendStart, 3);
+	server.receive(buffer, size, t0);
+	check(popEvents(server, event) == 1
+	      && event.type == RemoteInputServer::Event::EventState
+	      && event.source == 1 && event.isGamepad && event.timestamp == t0,
+	      "the first datagram of a source is accepted");
+	InputSnapshot snapshot;
+	memset(&snapshot, 0xff, sizeof(snapshot));
+	event.read(snapshot, 2);
+	check(snapshot.axis(2, 0) == -1234 && snapshot.button(2, 3)
+	      && !snapshot.button(2, 2) && snapshot.axis(2, 15) == 0
+	      && !snapshot.button(2, 64) && snapshot.button(1, 100),
+	      "the state is parsed into the device's block only");
+
+	server.receive(buffer, size, t0 + ms);
+	size = writePacket(buffer, 1, 0, 7, 9, sendStart + 1000, 4);
+	server.receive(buffer, size, t0 + 2 * ms);
+	check(popEvents(server, event) == 0
+	      && server.getDroppedCount(RemoteInputServer::DropOutOfOrder) == 2,
+	      "repeated and older datagrams are dropped");
+
+	size = writePacket(buffer, 1, 0, 7, 12, sendStart + 4000, 5);
+	server.receive(buffer, size, t0 + 4 * ms);
+	check(popEvents(server, event) == 1 && event.buttons[0] == (1 << 5),
+	      "a datagram after a lost one is accepted");
+
+	// 300 ms on the way, when the fastest one took 0.
+	size = writePacket(buffer, 1, 0, 7, 13, sendStart + 5000, 6);
+	server.receive(buffer, size, t0 + 305 * ms);
+	check(popEvents(server, event) == 0
+	      && server.getDroppedCount(RemoteInputServer::DropStale) == 1,
+	      "a datagram that was delayed too long is dropped");
+	size = writePacket(buffer, 1, 0, 7, 14, sendStart + 305000, 6);
+	server.receive(buffer, size, t0 + 306 * ms);
+	check(popEvents(server, event) == 1, "the next timely datagram is accepted");
+
+	// A constant extra delay, e.g. from drifting clocks, is accepted after
+	// two windows.
+	int accepted = 0;
+	for (int i = 0; i < 300; i++)
+	{
+		size = writePacket(buffer, 1, 0, 7, 15 + i, sendStart + 306000 + i * 10000, 6);
+		server.receive(buffer, size, t0 + 456 * ms + i * 10 * ms);
+		accepted += popEvents(server, event);
+	}
+	check(accepted > 0 && accepted < 300 && event.type == RemoteInputServer::Event::EventState,
+	      "a lasting change of the delay is followed");
+
+	size = writePacket(buffer, 1, 0, 8, 0xffffffff, 0, 1);
+	server.receive(buffer, size, t0 + 4 * second);
+	size = writePacket(buffer, 1, 0, 8, 0, 1000, 1);
+	server.receive(buffer, size, t0 + 4 * second + ms);
+	check(popEvents(server, event) == 2,
+	      "a restarted sender is accepted, and sequence numbers wrap around");
+
+	const int malformed = server.getDroppedCount(RemoteInputServer::DropMalformed);
+	size = writePacket(buffer, 1, 0, 8, 1, 2000, 1);
+	server.receive(buffer, size - 1, t0 + 4 * second + 2 * ms);
+	server.receive(buffer, RemoteFormat::HeaderSize - 1, t0 + 4 * second + 2 * ms);
+	buffer[0] = 'X';
+	server.receive(buffer, size, t0 + 4 * second + 2 * ms);
+	size = writePacket(buffer, RemoteFormat::MaxSources, 0, 8, 1, 2000, 1);
+	server.receive(buffer, size, t0 + 4 * second + 2 * ms);
+	check(popEvents(server, event) == 0
+	      && server.getDroppedCount(RemoteInputServer::DropMalformed) == malformed + 4,
+	      "malformed datagrams are dropped");
+
+	size = writePacket(buffer, 1, RemoteFormat::FlagDisconnect, 8, 5, 0, 0);
+	server.receive(buffer, size, t0 + 4 * second + 3 * ms);
+	check(popEvents(server, event) == 1
+	      && event.type == RemoteInputServer::Event::EventDisconnect
+	      && event.source == 1,
+	      "a closed device is disconnected");
+	size = writePacket(buffer, 1, 0, 8, 4, 4000, 1);
+	server.receive(buffer, size, t0 + 4 * second + 4 * ms);
+	check(popEvents(server, event) == 0,
+	      "a late datagram doesn't reconnect a closed device");
+
+	size = writePacket(buffer, 2, 0, 1, 1, 0, 0);
+	server.receive(buffer, size, t0 + 5 * second);
+	server.checkTimeouts(t0 + 5 * second + 500 * ms);
+	check(popEvents(server, event) == 1
+	      && event.type == RemoteInputServer::Event::EventState,
+	      "a device is kept until the timeout");
+	server.checkTimeouts(t0 + 6 * second + ms);
+	server.checkTimeouts(t0 + 7 * second);
+	check(popEvents(server, event) == 1
+	      && event.type == RemoteInputServer::Event::EventDisconnect
+	      && event.source == 2,
+	      "a silent device is disconnected once");
+}
+
+static void
+runLatency(quint16 port, int count, int rate)
+{
+	RemoteInputServer server;
+	server.setAddress(QHostAddress::LocalHost, port);
+	server.setTimeouts(100, 1000);
+	server.start(QThread::HighPriority);
+	// Gives the thread time to bind the socket.
+	SDL_Delay(200);
+	if (!server.isRunning())
+	{
+		fprintf(stderr, "Unable to receive on port %d.\n", port);
+		failureCount++;
+		return;
+	}
+
+	QUdpSocket socket;
+	char buffer[RemoteFormat::MaxPacketSize];
+	LatencyHistogram latency;
+	LatencyHistogram jitter;
+	RemoteInputServer::Event event;
+	const Uint64 frequency = SDL_GetPerformanceFrequency();
+	const Uint64 period = frequency / rate;
+	int received = 0;
+	qint64 previousDelay = -1;
+	Uint64 deadline = SDL_GetPerformanceCounter();
+	for (int i = 0; i <= count; i++)
+	{
+		// The last iteration only collects the stragglers.
+		if (i < count)
+		{
+			quint64 sendTime = microseconds(SDL_GetPerformanceCounter());
+			int size = writePacket(buffer, 0, 0, 1, i + 1, sendTime, i % 15);
+			socket.writeDatagram(buffer, size, QHostAddress::LocalHost, port);
+		}
+		deadline += (i < count) ? period : frequency / 10;
+		do
+		{
+			while (server.popEvent(event))
+			{
+				if (event.type != RemoteInputServer::Event::EventState)
+					continue;
+				received++;
+				// The sender and the receiver share the clock.
+				qint64 delay = qint64(microseconds(event.timestamp))
+				               - qint64(event.sendTime);
+				latency.add(int(delay));
+				// The variation of the delay between consecutive datagrams.
+				if (previousDelay >= 0)
+					jitter.add(int(qAbs(delay - previousDelay)));
+				previousDelay = delay;
+			}
+		}
+		while (SDL_GetPerformanceCounter() < deadline);
+	}
+	server.stop();
+
+	printf("%d datagrams at %d Hz over the loopback interface\n", count, rate);
+	printf("%s\n", latency.format("latency, us").toLatin1().constData());
+	printf("%s\n", jitter.format("jitter, us").toLatin1().constData());
+	printf("received %d, lost %d, dropped %d stale, %d out of order,"
+	       " %d because of overflow\n",
+	       received, count - received - server.getDroppedCount(RemoteInputServer::DropStale)
+	                  - server.getDroppedCount(RemoteInputServer::DropOutOfOrder),
+	       server.getDroppedCount(RemoteInputServer::DropStale),
+	       server.getDroppedCount(RemoteInputServer::DropOutOfOrder),
+	       server.getDroppedCount(RemoteInputServer::DropOverflow));
+	check(received > 0, "datagrams are received over the loopback interface");
+}
+
+int
+main(int argc, char* argv[])
+{
+	QCoreApplication app(argc, argv);
+	QStringList arguments = app.arguments();
+	int port = 47475;
+	int count = 5000;
+	int rate = 1000;
+	for (int i = 1; i < arguments.count(); i++)
+	{
+		if (arguments[i] == "--port" && i + 1 < arguments.count())
+			port = arguments[++i].toInt();
+		else if (arguments[i] == "--count" && i + 1 < arguments.count())
+			count = qMax(1, arguments[++i].toInt());
+		else if (arguments[i] == "--rate" && i + 1 < arguments.count())
+			rate = qBound(1, arguments[++i].toInt(), 10000);
+		else
+		{
+			fprintf(stderr, "Usage: %s [--port N] [--count N] [--rate HZ]\n",
+			        argv[0]);
+			return 2;
+		}
+	}
+	if (port <= 0 || port > 65535)
+	{
+		fprintf(stderr, "Invalid port.\n");
+		return 2;
+	}
+
+	runChecks();
+	runLatency(quint16(port), count, rate);
+
+	if (failureCount > 0)
+	{
+		printf("%d checks failed.\n", failureCount);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,189 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// Sends the state of the devices connected to this machine to the remote
+// input server of the plug-in (see remote_input_port), by default on the same
+// machine. With --synthetic, a simulated game controller is sent instead,
+// its sticks moving in circles and its buttons pressed in turn, so the remote
+// input path can be tried without any devices or a second machine.
+
+#include "DeviceSet.hpp"
+#include "RemoteFormat.hpp"
+
+#include <QCoreApplication>
+#include <QHostAddress>
+#include <QStringList>
+#include <QUdpSocket>
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+static quint64
+microseconds(Uint64 ticks)
+{
+	return quint64(ticks * 1000000.0 / SDL_GetPerformanceFrequency());
+}
+
+//! Sets the simulated game controller's state @p t seconds after the start.
+static void
+simulate(InputSnapshot& state, double t)
+{
+	memset(&state, 0, sizeof(state));
+	const double phase = 2 * M_PI * t / 4;
+	state.axes[SDL_CONTROLLER_AXIS_LEFTX] = Sint16(20000 * std::cos(phase));
+	state.axes[SDL_CONTROLLER_AXIS_LEFTY] = Sint16(20000 * std::sin(phase));
+	// Each button is pressed for a quarter second in turn.
+	state.setButton(0, int(t * 4) % SDL_CONTROLLER_BUTTON_MAX);
+}
+
+int
+main(int argc, char* argv[])
+{
+	QCoreApplication app(argc, argv);
+	QStringList arguments = app.arguments();
+	QString host = "127.0.0.1";
+	int port = 47474;
+	int rate = 250;
+	int firstSource = 0;
+	double duration = 0;
+	bool synthetic = false;
+	for (int i = 1; i < arguments.count(); i++)
+	{
+		if (arguments[i] == "--host" && i + 1 < arguments.count())
+			host = arguments[++i];
+		else if (arguments[i] == "--port" && i + 1 < arguments.count())
+			port = arguments[++i].toInt();
+		else if (arguments[i] == "--rate" && i + 1 < arguments.count())
+			rate = qBound(1, arguments[++i].toInt(), 1000);
+		else if (arguments[i] == "--source" && i + 1 < arguments.count())
+			firstSource = arguments[++i].toInt();
+		else if (arguments[i] == "--seconds" && i + 1 < arguments.count())
+			duration = arguments[++i].toDouble();
+		else if (arguments[i] == "--synthetic")
+			synthetic = true;
+		else
+		{
+			fprintf(stderr, "Usage: %s [--host ADDRESS] [--port N] [--rate HZ]"
+			                " [--source N] [--seconds S] [--synthetic]\n",
+			        argv[0]);
+			return 2;
+		}
+	}
+	QHostAddress address(host);
+	if (port <= 0 || port > 65535 || firstSource < 0
+	    || firstSource >= RemoteFormat::MaxSources)
+	{
+		fprintf(stderr, "Invalid port or source number.\n");
+		return 2;
+	}
+
+	if (SDL_Init(SDL_INIT_GAMECONTROLLER) != 0)
+	{
+		fprintf(stderr, "Unable to initialize SDL: %s\n", SDL_GetError());
+		return 2;
+	}
+
+	// The devices are sent as consecutive sources, starting from --source.
+	DeviceSet devices;
+	if (synthetic)
+	{
+		DeviceCapabilities caps;
+		caps.axisCount = SDL_CONTROLLER_AXIS_MAX;
+		caps.buttonCount = SDL_CONTROLLER_BUTTON_MAX;
+		caps.hatCount = 0;
+		caps.ballCount = 0;
+		caps.isGamepad = true;
+		memset(&caps.guid, 0, sizeof(caps.guid));
+		caps.name = "Synthetic game controller";
+		devices.openReplayed(caps, 0);
+	}
+	else
+	{
+		const int maxDevices = RemoteFormat::MaxSources - firstSource;
+		for (int i = 0; i < SDL_NumJoysticks() && devices.count() < maxDevices; i++)
+		{
+			if (devices.open(i) < 0)
+				fprintf(stderr, "Unable to open device %d: %s\n", i, SDL_GetError());
+		}
+	}
+	if (devices.isEmpty())
+	{
+		fprintf(stderr, "No devices to send.\n");
+		SDL_Quit();
+		return 1;
+	}
+	for (int i = 0; i < devices.count(); i++)
+		printf("Sending %s as source %d to %s:%d\n",
+		       devices.device(devices.slot(i)).caps.name.toUtf8().constData(),
+		       firstSource + i, address.toString().toLatin1().constData(), port);
+
+	QUdpSocket socket;
+	char buffer[RemoteFormat::MaxPacketSize];
+	const Uint64 frequency = SDL_GetPerformanceFrequency();
+	const Uint64 start = SDL_GetPerformanceCounter();
+	const quint32 session = quint32(start ^ (start >> 32)) | 1;
+	quint32 sequence = 0;
+	Uint64 deadline = start;
+	while (duration <= 0 || deadline - start < duration * frequency)
+	{
+		InputSnapshot& state = devices.current;
+		if (synthetic)
+			simulate(state, double(deadline - start) / frequency);
+		else
+		{
+			SDL_JoystickUpdate();
+			devices.read(state);
+		}
+		const quint64 sendTime = microseconds(SDL_GetPerformanceCounter());
+		sequence++;
+		for (int i = 0; i < devices.count(); i++)
+		{
+			const int slot = devices.slot(i);
+			int size = RemoteFormat::writePacket(buffer, firstSource + i, 0,
+			                                     session, sequence, sendTime,
+			                                     devices.device(slot).caps,
+			                                     state, slot);
+			socket.writeDatagram(buffer, size, address, quint16(port));
+		}
+
+		deadline += frequency / rate;
+		Uint64 now = SDL_GetPerformanceCounter();
+		if (now >= deadline)
+			deadline = now;
+		else
+			SDL_Delay(Uint32((deadline - now) * 1000 / frequency));
+	}
+
+	// Releases everything at once instead of waiting for the timeout.
+	sequence++;
+	for (int i = 0; i < devices.count(); i++)
+	{
+		const int slot = devices.slot(i);
+		int size = RemoteFormat::writePacket(buffer, firstSource + i,
+		                                     RemoteFormat::FlagDisconnect,
+		                                     session, sequence, 0,
+		                                     devices.device(slot).caps,
+		                                     devices.current, slot);
+		socket.writeDatagram(buffer, size, address, quint16(port));
+	}
+	devices.closeAll();
+	SDL_Quit();
+	return 0;
+}
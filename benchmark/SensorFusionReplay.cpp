@@ -0,0 +1,386 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// Develops and checks the fusion of motion sensors (see gyro_pointing) without
+// a game controller. Without arguments, checks SensorFusion against simulated
+// readings with drift and noise. Given a sensor trace, prints how the view
+// would turn. With --record, writes such a trace from the first connected
+// game controller with a gyroscope and an accelerometer (SDL 2.0.14 or later).
+//
+// A sensor trace is a text file with one reading per line: the time in
+// seconds, the gyroscope's x, y and z in radians per second and
+// the accelerometer's x, y and z in meters per second squared, in SDL's axes
+// (see SensorFusion). Lines starting with '#' are ignored.
+
+#include "Checks.hpp"
+#include "SensorFusion.hpp"
+
+#ifndef SDL_MAIN_HANDLED
+#define SDL_MAIN_HANDLED
+#endif
+#include "SDL.h"
+
+#include <QCoreApplication>
+#include <QStringList>
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+static const double degreesPerRadian = 180.0 / M_PI;
+
+//! A controller turned according to a script, read by sensors with drift
+//! and noise. The same seed gives the same readings.
+class SimulatedController
+{
+public:
+	SimulatedController() : seed(1)
+	{
+		up[0] = 0.0;
+		up[1] = 1.0;
+		up[2] = 0.0;
+		bias[0] = 0.01;
+		bias[1] = -0.008;
+		bias[2] = 0.005;
+	}
+
+	//! Rolls the controller by @p angle radians, at once.
+	void roll(double angle)
+	{
+		const double axis[3] = {0.0, 0.0, 1.0};
+		rotate(up, axis, angle);
+	}
+
+	//! Turns the controller at @p rate (radians per second, in its axes)
+	//! for @p dt seconds and returns the readings at the end.
+	void step(const double rate[3], double dt, float gyro[3], float accel[3])
+	{
+		double speed = std::sqrt(rate[0] * rate[0] + rate[1] * rate[1]
+		                         + rate[2] * rate[2]);
+		if (speed > 0.0)
+		{
+			// Seen from the controller, "up" turns the opposite way.
+			const double axis[3] = {rate[0] / speed, rate[1] / speed,
+			                        rate[2] / speed};
+			rotate(up, axis, -speed * dt);
+		}
+		for (int i = 0; i < 3; i++)
+		{
+			gyro[i] = float(rate[i] + bias[i] + 0.003 * noise());
+			accel[i] = float(up[i] * SensorFusion::StandardGravity
+			                 + 0.05 * noise());
+		}
+	}
+
+	//! The direction upwards in the controller's axes.
+	double up[3];
+	//! Drift of the simulated gyroscope, in radians per second.
+	double bias[3];
+
+private:
+	//! Rotates @p v around a unit @p axis by @p angle (Rodrigues).
+	static void rotate(double v[3], const double axis[3], double angle)
+	{
+		const double c = std::cos(angle);
+		const double s = std::sin(angle);
+		const double d = axis[0] * v[0] + axis[1] * v[1] + axis[2] * v[2];
+		const double x[3] = {axis[1] * v[2] - axis[2] * v[1],
+		                     axis[2] * v[0] - axis[0] * v[2],
+		                     axis[0] * v[1] - axis[1] * v[0]};
+		for (int i = 0; i < 3; i++)
+			v[i] = v[i] * c + x[i] * s + axis[i] * d * (1.0 - c);
+	}
+
+	//! Normally distributed, with a standard deviation of 1.
+	double noise()
+	{
+		double sum = 0.0;
+		for (int i = 0; i < 12; i++)
+		{
+			seed = seed * 1103515245u + 12345u;
+			sum += double((seed >> 8) & 0xffff) / 65536.0;
+		}
+		return sum - 6.0;
+	}
+
+	quint32 seed;
+};
+
+//! Simulates a controller kept still for @p restTime seconds, then turned for
+//! a second at @p rate (radians per second, around the axis given by
+//! @p aroundVertical or in the controller's axes), then kept still again.
+//! Sets @p right and @p up to the rotation of the view, in degrees.
+static void
+simulate(SimulatedController& controller, const double rate[3],
+         bool aroundVertical, double restTime, double& right, double& up)
+{
+	const double dt = 1.0 / 250;
+	SensorFusion fusion;
+	right = up = 0.0;
+	const int steps = int((restTime * 2 + 1.0) / dt);
+	for (int i = 0; i < steps; i++)
+	{
+		const double t = i * dt;
+		double w[3] = {0.0, 0.0, 0.0};
+		if (t >= restTime && t < restTime + 1.0)
+		{
+			for (int j = 0; j < 3; j++)
+				w[j] = aroundVertical ? controller.up[j] * rate[1] : rate[j];
+		}
+		float gyro[3], accel[3];
+		controller.step(w, dt, gyro, accel);
+		fusion.addSample(dt, gyro, accel);
+		double x, y;
+		fusion.takeRotation(x, y);
+		right += x * degreesPerRadian;
+		up += y * degreesPerRadian;
+	}
+}
+
+static void
+runChecks()
+{
+	double right, up;
+	const double still[3] = {0.0, 0.0, 0.0};
+	SimulatedController controller;
+	simulate(controller, still, false, 5.0, right, up);
+	check(std::fabs(right) < 0.5 && std::fabs(up) < 0.5,
+	      "a controller kept still doesn't turn the view despite drift");
+
+	// Counterclockwise around the vertical is to the left.
+	const double turnRight[3] = {0.0, -M_PI / 2, 0.0};
+	controller = SimulatedController();
+	simulate(controller, turnRight, true, 5.0, right, up);
+	printf("Turned right by 90 degrees: %.2f right, %.2f up\n", right, up);
+	check(std::fabs(right - 90.0) < 2.0 && std::fabs(up) < 1.0,
+	      "turning right by 90 degrees turns the view as much");
+
+	const double pitchUp[3] = {M_PI / 6, 0.0, 0.0};
+	controller = SimulatedController();
+	simulate(controller, pitchUp, false, 5.0, right, up);
+	printf("Pitched up by 30 degrees: %.2f right, %.2f up\n", right, up);
+	check(std::fabs(up - 30.0) < 1.0 && std::fabs(right) < 1.0,
+	      "pitching up by 30 degrees turns the view up as much");
+
+	controller = SimulatedController();
+	controller.roll(M_PI / 4);
+	simulate(controller, turnRight, true, 5.0, right, up);
+	printf("Rolled, turned right by 90 degrees: %.2f right, %.2f up\n",
+	       right, up);
+	check(std::fabs(right - 90.0) < 2.0 && std::fabs(up) < 1.0,
+	      "a rolled controller turns the view around the vertical");
+
+	// The drift is measured soon after start.
+	controller = SimulatedController();
+	SensorFusion fusion;
+	const double dt = 1.0 / 250;
+	for (int i = 0; i < 500; i++)
+	{
+		float gyro[3], accel[3];
+		controller.step(still, dt, gyro, accel);
+		fusion.addSample(dt, gyro, accel);
+	}
+	const double* bias = fusion.getBias();
+	check(std::fabs(bias[0] - controller.bias[0]) < 0.002
+	      && std::fabs(bias[1] - controller.bias[1]) < 0.002
+	      && std::fabs(bias[2] - controller.bias[2]) < 0.002,
+	      "the drift of the gyroscope is measured in 2 seconds");
+}
+
+//! Prints how the view would turn with the readings in a sensor trace.
+//! @param pathInterval if positive, the rotation so far is printed every
+//! that many seconds.
+static int
+replay(const char* path, double pathInterval)
+{
+	FILE* file = fopen(path, "r");
+	if (file == NULL)
+	{
+		fprintf(stderr, "Unable to open %s\n", path);
+		return 2;
+	}
+	SensorFusion fusion;
+	char line[256];
+	int count = 0;
+	double start = 0.0, previous = 0.0, nextPrint = 0.0;
+	double right = 0.0, up = 0.0;
+	while (fgets(line, sizeof(line), file))
+	{
+		double t;
+		float gyro[3], accel[3];
+		if (line[0] == '#'
+		    || sscanf(line, "%lf %f %f %f %f %f %f", &t, gyro, gyro + 1,
+		              gyro + 2, accel, accel + 1, accel + 2) != 7)
+			continue;
+		if (count++ == 0)
+			start = previous = nextPrint = t;
+		fusion.addSample(t - previous, gyro, accel);
+		previous = t;
+		double x, y;
+		fusion.takeRotation(x, y);
+		right += x * degreesPerRadian;
+		up += y * degreesPerRadian;
+		if (pathInterval > 0.0 && t >= nextPrint)
+		{
+			printf("%.3f %.3f %.3f\n", t - start, right, up);
+			nextPrint += pathInterval;
+		}
+	}
+	fclose(file);
+	if (count == 0)
+	{
+		fprintf(stderr, "No readings in %s\n", path);
+		return 2;
+	}
+
+	const double* bias = fusion.getBias();
+	const double* vertical = fusion.getUp();
+	printf("%d readings over %.2f s (%.0f Hz)\n", count, previous - start,
+	       count > 1 ? (count - 1) / (previous - start) : 0.0);
+	printf("Turned %.2f degrees right and %.2f up\n", right, up);
+	printf("Measured drift: %.4f %.4f %.4f rad/s\n",
+	       bias[0], bias[1], bias[2]);
+	printf("Upwards at the end: %.3f %.3f %.3f\n",
+	       vertical[0], vertical[1], vertical[2]);
+	return 0;
+}
+
+//! Writes the readings of the first game controller with motion sensors
+//! to a sensor trace for @p duration seconds.
+static int
+record(const char* path, double duration)
+{
+#if SDL_VERSION_ATLEAST(2, 0, 14)
+	if (SDL_Init(SDL_INIT_GAMECONTROLLER) != 0)
+	{
+		fprintf(stderr, "Unable to initialize SDL: %s\n", SDL_GetError());
+		return 2;
+	}
+	SDL_GameController* gamepad = NULL;
+	for (int i = 0; i < SDL_NumJoysticks() && gamepad == NULL; i++)
+	{
+		if (!SDL_IsGameController(i))
+			continue;
+		gamepad = SDL_GameControllerOpen(i);
+		if (gamepad
+		    && (SDL_GameControllerSetSensorEnabled(gamepad, SDL_SENSOR_GYRO,
+		                                           SDL_TRUE) != 0
+		        || SDL_GameControllerSetSensorEnabled(gamepad, SDL_SENSOR_ACCEL,
+		                                              SDL_TRUE) != 0))
+		{
+			SDL_GameControllerClose(gamepad);
+			gamepad = NULL;
+		}
+	}
+	if (gamepad == NULL)
+	{
+		fprintf(stderr, "No game controller with motion sensors.\n");
+		SDL_Quit();
+		return 1;
+	}
+	FILE* file = fopen(path, "w");
+	if (file == NULL)
+	{
+		fprintf(stderr, "Unable to write %s\n", path);
+		SDL_GameControllerClose(gamepad);
+		SDL_Quit();
+		return 2;
+	}
+	printf("Recording %s for %.0f seconds\n",
+	       SDL_GameControllerName(gamepad), duration);
+	fprintf(file, "# %s\n", SDL_GameControllerName(gamepad));
+
+	// Polled faster than any controller measures; only new readings
+	// are written.
+	const double secondsPerTick = 1.0 / SDL_GetPerformanceFrequency();
+	const Uint64 start = SDL_GetPerformanceCounter();
+	float last[6] = {0.f, 0.f, 0.f, 0.f, 0.f, 0.f};
+	int count = 0;
+	for (;;)
+	{
+		SDL_GameControllerUpdate();
+		double t = (SDL_GetPerformanceCounter() - start) * secondsPerTick;
+		if (t >= duration)
+			break;
+		float data[6];
+		if (SDL_GameControllerGetSensorData(gamepad, SDL_SENSOR_GYRO,
+		                                    data, 3) == 0
+		    && SDL_GameControllerGetSensorData(gamepad, SDL_SENSOR_ACCEL,
+		                                       data + 3, 3) == 0
+		    && memcmp(data, last, sizeof(data)) != 0)
+		{
+			fprintf(file, "%.6f %.6f %.6f %.6f %.4f %.4f %.4f\n", t,
+			        data[0], data[1], data[2], data[3], data[4], data[5]);
+			memcpy(last, data, sizeof(data));
+			count++;
+		}
+		SDL_Delay(1);
+	}
+	fclose(file);
+	printf("Recorded %d readings (%.0f Hz)\n", count, count / duration);
+	SDL_GameControllerClose(gamepad);
+	SDL_Quit();
+	return 0;
+#else
+	Q_UNUSED(path);
+	Q_UNUSED(duration);
+	fprintf(stderr, "Recording needs SDL 2.0.14 or later.\n");
+	return 2;
+#endif
+}
+
+int
+main(int argc, char* argv[])
+{
+	QCoreApplication app(argc, argv);
+	QStringList arguments = app.arguments();
+	QString tracePath;
+	QString recordPath;
+	double duration = 30.0;
+	double pathInterval = 0.0;
+	for (int i = 1; i < arguments.count(); i++)
+	{
+		if (arguments[i] == "--record" && i + 1 < arguments.count())
+			recordPath = arguments[++i];
+		else if (arguments[i] == "--seconds" && i + 1 < arguments.count())
+			duration = arguments[++i].toDouble();
+		else if (arguments[i] == "--path" && i + 1 < arguments.count())
+			pathInterval = arguments[++i].toDouble();
+		else if (!arguments[i].startsWith("--") && tracePath.isEmpty())
+			tracePath = arguments[i];
+		else
+		{
+			fprintf(stderr, "Usage: %s [--path SECONDS] [FILE]\n"
+			                "       %s --record FILE [--seconds S]\n",
+			        argv[0], argv[0]);
+			return 2;
+		}
+	}
+
+	if (!recordPath.isEmpty())
+		return record(recordPath.toLocal8Bit().constData(), duration);
+	if (!tracePath.isEmpty())
+		return replay(tracePath.toLocal8Bit().constData(), pathInterval);
+	runChecks();
+	return failureCount > 0 ? 1 : 0;
+}
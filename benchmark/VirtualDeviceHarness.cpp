@@ -0,0 +1,750 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// Exercises the plug-in's input path with SDL's virtual joysticks, so it can
+// run on machines without any controllers. Scripted changes of the devices'
+// state are checked against what reaches a mock of Stellarium's movement
+// manager, then opening, hot-plugging and updating the devices are timed.
+// Requires SDL 2.0.14 or later. The exit code is 1 if any check fails.
+// Real devices connected to the machine are opened as well; leave them idle.
+
+#include "AllocationCounter.hpp"
+#include "Checks.hpp"
+#include "DeviceDescriptorCache.hpp"
+#include "DeviceManager.hpp"
+#include "DeviceSet.hpp"
+#include "InputProcessor.hpp"
+#include "MovementSink.hpp"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QSettings>
+#include <QTemporaryFile>
+#include <QVector>
+
+#include <cmath>
+#include <cstdio>
+
+#if SDL_VERSION_ATLEAST(2, 0, 14)
+
+//! Stands in for StelMovementMgr and StelCore, remembering what it was told.
+class RecordingSink : public MovementSink
+{
+public:
+	RecordingSink() : movementFlags(0), panX(0.0), panY(0.0), fovChange(0.0)
+	{
+		for (int i = 0; i < BuiltinActionCount; i++)
+			actionCount[i] = 0;
+	}
+
+	virtual void performAction(int actionId, bool active)
+	{
+		if (actionId < BuiltinActionCount && active)
+			actionCount[actionId]++;
+	}
+	virtual void setMovementFlag(int actionId, bool active)
+	{
+		if (active)
+			movementFlags |= (1 << actionId);
+		else
+			movementFlags &= ~(1 << actionId);
+	}
+	virtual double getCurrentFov() {return 60.0;}
+	virtual void panView(double deltaAz, double deltaAlt)
+	{
+		panX += deltaAz;
+		panY += deltaAlt;
+	}
+	virtual void changeFov(double deltaFov) {fovChange += deltaFov;}
+
+	int movementFlags;
+	int actionCount[BuiltinActionCount];
+	double panX;
+	double panY;
+	double fovChange;
+};
+
+//! The device handling of JoystickSupport::update(), without Stellarium
+//! and without the background sampler.
+class Harness
+{
+public:
+	Harness(QSettings* conf) : conf(conf), clock(0), compileOnOpen(true)
+	{
+		processor.configure(conf);
+		processor.setSink(&sink);
+	}
+
+	void init()
+	{
+		manager.init();
+		openDevices();
+	}
+
+	//! Processes one frame. The snapshot is stamped with #clock, advanced
+	//! by @p deltaTime, so the movement doesn't depend on how fast
+	//! the harness runs.
+	void update(double deltaTime = 1.0 / 60.0)
+	{
+		SDL_JoystickUpdate();
+		if (manager.processEvents())
+			openDevices();
+		clock += Uint64(deltaTime * SDL_GetPerformanceFrequency());
+		if (devices.isEmpty())
+			return;
+		devices.read(devices.current);
+		devices.current.timestamp = clock;
+		processor.processSnapshot(devices, devices.current);
+		processor.finishFrame();
+	}
+
+	//! Closes the devices that have been disconnected and opens the new ones.
+	void openDevices()
+	{
+		for (int i = devices.count() - 1; i >= 0; i--)
+		{
+			int slot = devices.slot(i);
+			if (manager.findDeviceIndex(devices.device(slot).instanceId) < 0)
+				devices.close(slot);
+		}
+		for (int i = 0; i < manager.count(); i++)
+		{
+			const DeviceInfo& info = manager.device(i);
+			if (devices.findSlot(info.instanceId) >= 0)
+				continue;
+			int index = manager.findDeviceIndex(info.instanceId);
+			if (index >= 0)
+				devices.open(index);
+		}
+		if (compileOnOpen)
+			processor.compileBindings(conf, devices);
+	}
+
+	QSettings* conf;
+	DeviceManager manager;
+	DeviceSet devices;
+	InputProcessor processor;
+	RecordingSink sink;
+	//! Simulated time of the snapshots.
+	Uint64 clock;
+	//! If false, the bindings of opened devices are left to be installed
+	//! from an InputMapping, as JoystickSupport does.
+	bool compileOnOpen;
+};
+
+//! A virtual device, kept open by the harness to set its state.
+class VirtualDevice
+{
+public:
+	VirtualDevice() : joystick(NULL), instanceId(-1) {}
+
+	//! Attaches a game controller with the standard buttons and axes.
+	bool attachGamepad()
+	{
+		if (!attach(SDL_JOYSTICK_TYPE_GAMECONTROLLER,
+		            SDL_CONTROLLER_AXIS_MAX, SDL_CONTROLLER_BUTTON_MAX, 0))
+			return false;
+		// Virtual inputs in the order of SDL's enums, so button N of
+		// the device is SDL_GameControllerButton N. The triggers use only
+		// the positive half, so they are released at 0 like the sticks.
+		char guid[33];
+		SDL_JoystickGetGUIDString(SDL_JoystickGetGUID(joystick),
+		                          guid, sizeof(guid));
+		QByteArray mapping(guid);
+		mapping.append(",Virtual Gamepad,a:b0,b:b1,x:b2,y:b3,back:b4,guide:b5,"
+		               "start:b6,leftstick:b7,rightstick:b8,leftshoulder:b9,"
+		               "rightshoulder:b10,dpup:b11,dpdown:b12,dpleft:b13,"
+		               "dpright:b14,leftx:a0,lefty:a1,rightx:a2,righty:a3,"
+		               "lefttrigger:+a4,righttrigger:+a5,");
+		return SDL_GameControllerAddMapping(mapping.constData()) >= 0;
+	}
+
+	//! Attaches a device without a mapping, used as a joystick.
+	bool attachJoystick(int axes, int buttons, int hats)
+	{
+		return attach(SDL_JOYSTICK_TYPE_FLIGHT_STICK, axes, buttons, hats);
+	}
+
+	void detach()
+	{
+		if (joystick == NULL)
+			return;
+		int deviceCount = SDL_NumJoysticks();
+		for (int i = 0; i < deviceCount; i++)
+		{
+			if (SDL_JoystickGetDeviceInstanceID(i) == instanceId)
+			{
+				SDL_JoystickDetachVirtual(i);
+				break;
+			}
+		}
+		SDL_JoystickClose(joystick);
+		joystick = NULL;
+		instanceId = -1;
+	}
+
+	void setButton(int button, bool pressed)
+	{
+		SDL_JoystickSetVirtualButton(joystick, button,
+		                             pressed ? SDL_PRESSED : SDL_RELEASED);
+	}
+	void setAxis(int axis, Sint16 value)
+	{
+		SDL_JoystickSetVirtualAxis(joystick, axis, value);
+	}
+	void setHat(int hat, Uint8 value)
+	{
+		SDL_JoystickSetVirtualHat(joystick, hat, value);
+	}
+
+	SDL_Joystick* joystick;
+	SDL_JoystickID instanceId;
+
+private:
+	bool attach(SDL_JoystickType type, int axes, int buttons, int hats)
+	{
+		int index = SDL_JoystickAttachVirtual(type, axes, buttons, hats);
+		if (index < 0)
+			return false;
+		joystick = SDL_JoystickOpen(index);
+		if (joystick == NULL)
+		{
+			SDL_JoystickDetachVirtual(index);
+			return false;
+		}
+		instanceId = SDL_JoystickInstanceID(joystick);
+		return true;
+	}
+};
+
+//! Binds inputs past the defaults, on the last button and hat.
+static void
+writeBindings(QSettings& conf)
+{
+	conf.setValue("JoystickSupport_joystick/button0",
+	              "release:toggle_mount_mode");
+	conf.setValue("JoystickSupport_joystick/button127", "zoom_in");
+	conf.setValue("JoystickSupport_joystick/hat0_up", "turn_up");
+	conf.setValue("JoystickSupport_joystick/hat3_left", "turn_left");
+	conf.setValue("JoystickSupport_joystick/button2",
+	              QStringList() << "tap:set_time_now" << "long:auto_zoom_in"
+	                            << "double:auto_zoom_out");
+	conf.setValue("JoystickSupport_joystick/button3",
+	              "tap:set_zero_time_speed");
+	conf.setValue("JoystickSupport_joystick/button3+button4",
+	              "set_real_time_speed");
+	conf.setValue("JoystickSupport_joystick/button5+button6", "turn_right");
+	conf.sync();
+}
+
+//! Waits up to a second for a device to be opened in the background.
+static bool
+openInBackground(DeviceDescriptorCache& cache, SDL_JoystickID instanceId,
+                 DeviceState& device)
+{
+	cache.request(instanceId);
+	for (int i = 0; i < 100; i++)
+	{
+		if (cache.takeOpened(device))
+			return true;
+		SDL_Delay(10);
+	}
+	return false;
+}
+
+static void
+runChecks(Harness& harness)
+{
+	RecordingSink& sink = harness.sink;
+	const int baseline = harness.devices.count();
+
+	VirtualDevice gamepad;
+	check(gamepad.attachGamepad(), "attach a virtual game controller");
+	harness.update();
+	int slot = harness.devices.findSlot(gamepad.instanceId);
+	check(slot >= 0, "the game controller is opened on connection");
+	if (slot < 0)
+		return;
+	check(harness.devices.device(slot).caps.isGamepad,
+	      "the game controller is recognized as such");
+
+	double panY = sink.panY;
+	gamepad.setButton(SDL_CONTROLLER_BUTTON_DPAD_UP, true);
+	harness.update();
+	check(sink.panY > panY, "dpup starts turning up");
+	gamepad.setButton(SDL_CONTROLLER_BUTTON_DPAD_UP, false);
+	harness.update();
+	panY = sink.panY;
+	harness.update();
+	check(sink.panY == panY, "releasing dpup stops turning");
+
+	// The same deflection moves the view as far at any frame rate.
+	gamepad.setAxis(SDL_CONTROLLER_AXIS_LEFTY, -32768);
+	for (int i = 0; i < 6; i++)
+		harness.update(1.0 / 144.0);
+	double fastFrames = sink.panY - panY;
+	gamepad.setAxis(SDL_CONTROLLER_AXIS_LEFTY, 0);
+	harness.update(1.0 / 144.0);
+	panY = sink.panY;
+	gamepad.setAxis(SDL_CONTROLLER_AXIS_LEFTY, -32768);
+	harness.update(1.0 / 24.0);
+	double slowFrame = sink.panY - panY;
+	gamepad.setAxis(SDL_CONTROLLER_AXIS_LEFTY, 0);
+	harness.update();
+	check(fastFrames > 0.0
+	      && std::fabs(slowFrame - fastFrames) < 1e-6 * fastFrames,
+	      "the stick pans as far in 6 frames at 144 fps as in one at 24 fps");
+
+	gamepad.setButton(SDL_CONTROLLER_BUTTON_A, true);
+	for (int i = 0; i < 10; i++)
+		harness.update();
+	check(sink.actionCount[ActionToggleMountMode] == 1,
+	      "holding A toggles the mount mode once");
+	gamepad.setButton(SDL_CONTROLLER_BUTTON_A, false);
+	harness.update();
+
+	gamepad.setAxis(SDL_CONTROLLER_AXIS_LEFTX, 32767);
+	harness.update();
+	check(sink.panX > 0.0, "the left stick pans the view");
+	gamepad.setAxis(SDL_CONTROLLER_AXIS_LEFTX, 0);
+	harness.update();
+	double panX = sink.panX;
+	harness.update();
+	check(sink.panX == panX, "the view stops when the stick is released");
+
+	gamepad.setAxis(SDL_CONTROLLER_AXIS_LEFTX, 2000);
+	harness.update();
+	harness.update();
+	check(sink.panX == panX, "deflections within the deadzone are ignored");
+	gamepad.setAxis(SDL_CONTROLLER_AXIS_LEFTX, 0);
+
+	VirtualDevice joystick;
+	check(joystick.attachJoystick(16, 128, 4),
+	      "attach a virtual joystick with 16 axes, 128 buttons, 4 hats");
+	harness.update();
+	int joystickSlot = harness.devices.findSlot(joystick.instanceId);
+	check(joystickSlot >= 0
+	      && !harness.devices.device(joystickSlot).caps.isGamepad,
+	      "the joystick is opened as a joystick");
+	check(harness.devices.count() == baseline + 2,
+	      "both devices are open at the same time");
+	if (joystickSlot < 0)
+		return;
+
+	// The second time, the same model is opened with the cached descriptor.
+	DeviceDescriptorCache cache;
+	cache.start();
+	const DeviceCapabilities& caps = harness.devices.device(joystickSlot).caps;
+	for (int i = 0; i < 2; i++)
+	{
+		DeviceState opened;
+		bool isOpen = openInBackground(cache, joystick.instanceId, opened);
+		check(isOpen && opened.instanceId == joystick.instanceId
+		      && opened.caps.axisCount == caps.axisCount
+		      && opened.caps.buttonCount == caps.buttonCount
+		      && opened.caps.hatCount == caps.hatCount
+		      && !opened.caps.isGamepad,
+		      i == 0 ? "a device is opened in the background"
+		             : "a known device is opened again from the cache");
+		opened.close();
+	}
+	cache.stop();
+
+	double fovChange = sink.fovChange;
+	joystick.setButton(127, true);
+	harness.update();
+	check(sink.fovChange < fovChange, "the last button is bound");
+	joystick.setButton(127, false);
+	harness.update();
+	fovChange = sink.fovChange;
+	harness.update();
+	check(sink.fovChange == fovChange, "releasing it stops zooming");
+
+	panX = sink.panX;
+	joystick.setHat(3, SDL_HAT_LEFT);
+	harness.update();
+	check(sink.panX < panX, "the last hat is bound");
+	joystick.setHat(3, SDL_HAT_CENTERED);
+	harness.update();
+
+	int toggles = sink.actionCount[ActionToggleMountMode];
+	joystick.setButton(0, true);
+	harness.update();
+	check(sink.actionCount[ActionToggleMountMode] == toggles,
+	      "a release binding is not triggered by the press");
+	joystick.setButton(0, false);
+	harness.update();
+	check(sink.actionCount[ActionToggleMountMode] == toggles + 1,
+	      "a release binding is triggered by the release");
+
+	// Gestures, with the default long_press_time of 0.5 seconds and
+	// double_tap_time of 0.3 seconds.
+	int taps = sink.actionCount[ActionSetTimeNow];
+	joystick.setButton(2, true);
+	harness.update();
+	joystick.setButton(2, false);
+	harness.update();
+	check(sink.actionCount[ActionSetTimeNow] == taps,
+	      "a tap waits for a possible double tap");
+	for (int i = 0; i < 30; i++)
+		harness.update();
+	check(sink.actionCount[ActionSetTimeNow] == taps + 1,
+	      "a tap is triggered when the double tap time is over");
+
+	int doubleTaps = sink.actionCount[ActionAutoZoomOut];
+	for (int i = 0; i < 2; i++)
+	{
+		joystick.setButton(2, true);
+		harness.update();
+		joystick.setButton(2, false);
+		harness.update();
+	}
+	for (int i = 0; i < 30; i++)
+		harness.update();
+	check(sink.actionCount[ActionAutoZoomOut] == doubleTaps + 1
+	      && sink.actionCount[ActionSetTimeNow] == taps + 1,
+	      "a double tap is triggered instead of two taps");
+
+	int longPresses = sink.actionCount[ActionAutoZoomIn];
+	joystick.setButton(2, true);
+	for (int i = 0; i < 20; i++)
+		harness.update();
+	check(sink.actionCount[ActionAutoZoomIn] == longPresses,
+	      "a long press waits for its time");
+	for (int i = 0; i < 20; i++)
+		harness.update();
+	check(sink.actionCount[ActionAutoZoomIn] == longPresses + 1,
+	      "a long press is triggered while the button is held");
+	joystick.setButton(2, false);
+	for (int i = 0; i < 30; i++)
+		harness.update();
+	check(sink.actionCount[ActionSetTimeNow] == taps + 1,
+	      "a long press is not followed by a tap");
+
+	int chords = sink.actionCount[ActionSetRealTimeSpeed];
+	int shiftTaps = sink.actionCount[ActionSetZeroTimeSpeed];
+	joystick.setButton(3, true);
+	harness.update();
+	joystick.setButton(4, true);
+	harness.update();
+	check(sink.actionCount[ActionSetRealTimeSpeed] == chords + 1,
+	      "a chord is triggered by its last button");
+	joystick.setButton(3, false);
+	joystick.setButton(4, false);
+	harness.update();
+	check(sink.actionCount[ActionSetZeroTimeSpeed] == shiftTaps,
+	      "a button used in a chord is not tapped");
+	joystick.setButton(3, true);
+	harness.update();
+	joystick.setButton(3, false);
+	harness.update();
+	check(sink.actionCount[ActionSetZeroTimeSpeed] == shiftTaps + 1,
+	      "the same button is tapped on its own");
+
+	// All buttons of a chord pressed in the same snapshot.
+	chords = sink.actionCount[ActionSetRealTimeSpeed];
+	joystick.setButton(3, true);
+	joystick.setButton(4, true);
+	harness.update();
+	check(sink.actionCount[ActionSetRealTimeSpeed] == chords + 1,
+	      "a chord pressed at once is triggered once");
+	joystick.setButton(3, false);
+	joystick.setButton(4, false);
+	harness.update();
+	panX = sink.panX;
+	joystick.setButton(5, true);
+	joystick.setButton(6, true);
+	harness.update();
+	check(sink.panX > panX, "a held chord pressed at once starts turning");
+	joystick.setButton(5, false);
+	joystick.setButton(6, false);
+	harness.update();
+	panX = sink.panX;
+	harness.update();
+	check(sink.panX == panX
+	      && (sink.movementFlags & (1 << ActionTurnRight)) == 0,
+	      "releasing a chord pressed at once stops turning");
+
+	// Reloading the bindings while a device is open, as after editing them.
+	harness.conf->setValue("JoystickSupport_joystick/button127", "zoom_out");
+	InputMapping mapping;
+	mapping.describe(harness.devices);
+	mapping.compile(harness.conf, NULL,
+	                harness.processor.getDefaultDeadzone());
+	harness.conf->setValue("JoystickSupport_joystick/button127", "zoom_in");
+	check(harness.processor.installMapping(mapping, harness.devices),
+	      "a mapping compiled for the open devices is installed");
+	fovChange = sink.fovChange;
+	joystick.setButton(127, true);
+	harness.update();
+	check(sink.fovChange > fovChange, "the reloaded bindings take effect");
+	joystick.setButton(127, false);
+	harness.update();
+	check(harness.processor.installMapping(mapping, harness.devices),
+	      "the previous bindings are installed back");
+
+	// Inputs of different devices bound to the same action are merged.
+	gamepad.setButton(SDL_CONTROLLER_BUTTON_DPAD_UP, true);
+	joystick.setHat(0, SDL_HAT_UP);
+	harness.update();
+	gamepad.setButton(SDL_CONTROLLER_BUTTON_DPAD_UP, false);
+	harness.update();
+	panY = sink.panY;
+	harness.update();
+	check(sink.panY > panY,
+	      "an action stays active while another device holds it");
+	joystick.setHat(0, SDL_HAT_CENTERED);
+	harness.update();
+	panY = sink.panY;
+	harness.update();
+	check(sink.panY == panY, "the action stops when all devices release it");
+
+	// Disconnecting a device in the middle of an action.
+	gamepad.setButton(SDL_CONTROLLER_BUTTON_DPAD_LEFT, true);
+	harness.update();
+	gamepad.detach();
+	harness.update();
+	check(harness.devices.findSlot(gamepad.instanceId) < 0
+	      && harness.devices.count() == baseline + 1,
+	      "a disconnected device is closed");
+	panX = sink.panX;
+	harness.update();
+	check(sink.panX == panX,
+	      "movement stops when the device holding it is disconnected");
+
+	check(gamepad.attachGamepad(), "reconnect the game controller");
+	harness.update();
+	check(harness.devices.findSlot(gamepad.instanceId) >= 0,
+	      "a reconnected device is opened again");
+
+	// With the default idle_timeout of 5 seconds.
+	for (int i = 0; i < 6 * 60; i++)
+		harness.update();
+	check(harness.processor.isIdle(), "devices left at rest become idle");
+	joystick.setButton(1, true);
+	harness.update();
+	check(!harness.processor.isIdle(), "a button press ends the idle state");
+	joystick.setButton(1, false);
+	harness.update();
+
+	gamepad.detach();
+	joystick.detach();
+	harness.update();
+	check(harness.devices.count() == baseline, "all virtual devices are closed");
+}
+
+//! Installs the bindings only from an InputMapping, without ever calling
+//! InputProcessor::compileBindings(), as JoystickSupport does.
+static void
+runMappingChecks(QSettings* conf)
+{
+	Harness harness(conf);
+	harness.compileOnOpen = false;
+	harness.init();
+	VirtualDevice gamepad;
+	check(gamepad.attachGamepad(), "attach a virtual game controller");
+	harness.update();
+	InputMapping mapping;
+	mapping.describe(harness.devices);
+	mapping.compile(conf, NULL, harness.processor.getDefaultDeadzone());
+	check(harness.processor.installMapping(mapping, harness.devices),
+	      "a mapping is installed without compiling the bindings first");
+
+	gamepad.setAxis(SDL_CONTROLLER_AXIS_LEFTY, -32768);
+	harness.update();
+	double installedPan = harness.sink.panY;
+	gamepad.setAxis(SDL_CONTROLLER_AXIS_LEFTY, 0);
+	harness.update();
+
+	// The same deflection with the bindings compiled directly.
+	harness.processor.compileBindings(conf, harness.devices);
+	double panY = harness.sink.panY;
+	gamepad.setAxis(SDL_CONTROLLER_AXIS_LEFTY, -32768);
+	harness.update();
+	double compiledPan = harness.sink.panY - panY;
+	check(installedPan > 0.0
+	      && std::fabs(installedPan - compiledPan) < 1e-6 * compiledPan,
+	      "the stick pans at the same rate with an installed mapping");
+
+	gamepad.detach();
+	harness.update();
+	harness.devices.closeAll();
+}
+
+static void
+runTimings(Harness& harness, int frames)
+{
+	const int cycles = 200;
+	QElapsedTimer timer;
+
+	VirtualDevice joystick;
+	if (!joystick.attachJoystick(16, 128, 4))
+	{
+		printf("Unable to attach a virtual joystick: %s\n", SDL_GetError());
+		return;
+	}
+	harness.update();
+
+	// Opening and closing, as in openDevices() and closeDevice().
+	int index = harness.manager.findDeviceIndex(joystick.instanceId);
+	DeviceSet devices;
+	qint64 openTime = 0;
+	qint64 closeTime = 0;
+	for (int i = 0; i < cycles; i++)
+	{
+		timer.start();
+		int slot = devices.open(index);
+		openTime += timer.nsecsElapsed();
+		timer.start();
+		devices.close(slot);
+		closeTime += timer.nsecsElapsed();
+	}
+	printf("open device:  %9.1f us\n", openTime / 1000.0 / cycles);
+	printf("close device: %9.1f us\n", closeTime / 1000.0 / cycles);
+
+	// Hot-plugging: the frame that notices the device and opens it,
+	// and the one that closes it.
+	qint64 attachTime = 0;
+	qint64 detachTime = 0;
+	for (int i = 0; i < cycles; i++)
+	{
+		VirtualDevice device;
+		if (!device.attachGamepad())
+			break;
+		timer.start();
+		harness.update();
+		attachTime += timer.nsecsElapsed();
+		device.detach();
+		timer.start();
+		harness.update();
+		detachTime += timer.nsecsElapsed();
+	}
+	printf("frame handling a connection:    %9.1f us\n",
+	       attachTime / 1000.0 / cycles);
+	printf("frame handling a disconnection: %9.1f us\n",
+	       detachTime / 1000.0 / cycles);
+
+	// Steady state, with a game controller and two joysticks.
+	VirtualDevice gamepad;
+	VirtualDevice throttle;
+	gamepad.attachGamepad();
+	throttle.attachJoystick(8, 64, 1);
+	harness.update();
+	for (int moving = 0; moving < 2; moving++)
+	{
+		quint64 allocationsBefore = AllocationCounter::count();
+		timer.start();
+		for (int f = 0; f < frames; f++)
+		{
+			if (moving)
+			{
+				Sint16 value = Sint16((f * 517) & 0xffff);
+				gamepad.setAxis(SDL_CONTROLLER_AXIS_LEFTX, value);
+				joystick.setAxis(1, value);
+				joystick.setButton(f % 128, (f / 128) % 2);
+			}
+			harness.update();
+		}
+		qint64 elapsed = timer.nsecsElapsed();
+		quint64 allocations = AllocationCounter::count() - allocationsBefore;
+		printf("update(), 3 devices, %s: %9.1f us, %.2f allocations\n",
+		       moving ? "moving" : "idle  ",
+		       elapsed / 1000.0 / frames, double(allocations) / frames);
+		check(allocations == 0, "no allocations while updating");
+	}
+
+	// Qt allocates the storage of its containers with malloc() inside QtCore,
+	// so a QVector built in every frame is caught only if that is counted.
+	if (AllocationCounter::countsMalloc())
+	{
+		quint64 allocationsBefore = AllocationCounter::count();
+		for (int f = 0; f < 100; f++)
+		{
+			QVector<Sint16> axes(InputSnapshot::MaxAxes);
+			harness.update();
+			axes[0] = harness.devices.current.axis(0, 0);
+		}
+		quint64 allocations = AllocationCounter::count() - allocationsBefore;
+		check(allocations >= 100,
+		      "a QVector built in every frame is counted as allocations");
+	}
+	else
+		printf("SKIP: malloc() is not counted on this platform\n");
+
+	gamepad.detach();
+	throttle.detach();
+	joystick.detach();
+	harness.update();
+}
+
+int
+main(int argc, char* argv[])
+{
+	QCoreApplication app(argc, argv);
+	QStringList arguments = app.arguments();
+	int frames = 10000;
+	if (arguments.count() == 3 && arguments[1] == "--frames")
+		frames = qMax(1, arguments[2].toInt());
+	else if (arguments.count() != 1)
+	{
+		fprintf(stderr, "Usage: %s [--frames N]\n", argv[0]);
+		return 2;
+	}
+
+	if (SDL_Init(SDL_INIT_GAMECONTROLLER) != 0)
+	{
+		fprintf(stderr, "Unable to initialize SDL: %s\n", SDL_GetError());
+		return 2;
+	}
+
+	QTemporaryFile settingsFile;
+	if (!settingsFile.open())
+	{
+		fprintf(stderr, "Unable to create a temporary settings file.\n");
+		return 2;
+	}
+	QSettings conf(settingsFile.fileName(), QSettings::IniFormat);
+	writeBindings(conf);
+
+	Harness harness(&conf);
+	harness.init();
+	runChecks(harness);
+	runTimings(harness, frames);
+	harness.devices.closeAll();
+	runMappingChecks(&conf);
+	SDL_Quit();
+
+	if (failureCount > 0)
+	{
+		printf("%d checks failed.\n", failureCount);
+		return 1;
+	}
+	return 0;
+}
+
+#else
+
+int
+main(int, char* argv[])
+{
+	fprintf(stderr, "%s requires SDL 2.0.14 or later.\n", argv[0]);
+	return 2;
+}
+
+#endif
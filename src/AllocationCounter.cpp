@@ -0,0 +1,165 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// Compiled only if JOYSTICKSUPPORT_COUNT_ALLOCATIONS is set, see CMakeLists.txt
+
+#include "AllocationCounter.hpp"
+
+#include <cstdlib>
+#include <new>
+
+#if defined(_MSC_VER)
+#define THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__)
+// Initial-exec, so reading it can't call malloc() through __tls_get_addr()
+#define THREAD_LOCAL __thread __attribute__((tls_model("initial-exec")))
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+static THREAD_LOCAL quint64 allocationCount = 0;
+static THREAD_LOCAL int suspendDepth = 0;
+//! Set by the first counted call to malloc(), calloc() or realloc().
+//! Written only once, so the race between threads is harmless.
+static bool mallocCounted = false;
+
+quint64
+AllocationCounter::count()
+{
+	return allocationCount;
+}
+
+bool
+AllocationCounter::countsMalloc()
+{
+	return mallocCounted;
+}
+
+void
+AllocationCounter::suspend()
+{
+	suspendDepth++;
+}
+
+void
+AllocationCounter::resume()
+{
+	suspendDepth--;
+}
+
+static inline void
+countAllocation()
+{
+	if (suspendDepth == 0)
+		allocationCount++;
+}
+
+#if defined(__GLIBC__)
+// With glibc, the C allocation functions are replaced instead, which also
+// covers the default operator new and the allocations made inside other
+// libraries, e.g. the storage of Qt's containers. They are replaced for
+// the whole process only if defined in the executable or in a library
+// loaded with LD_PRELOAD, not in a plug-in loaded later.
+extern "C"
+{
+void* __libc_malloc(std::size_t size);
+void* __libc_calloc(std::size_t count, std::size_t size);
+void* __libc_realloc(void* memory, std::size_t size);
+
+void*
+malloc(std::size_t size) __THROW
+{
+	if (!mallocCounted)
+		mallocCounted = true;
+	countAllocation();
+	return __libc_malloc(size);
+}
+
+void*
+calloc(std::size_t count, std::size_t size) __THROW
+{
+	if (!mallocCounted)
+		mallocCounted = true;
+	countAllocation();
+	return __libc_calloc(count, size);
+}
+
+void*
+realloc(void* memory, std::size_t size) __THROW
+{
+	if (!mallocCounted)
+		mallocCounted = true;
+	// Shrinking to nothing frees the memory.
+	if (size != 0)
+		countAllocation();
+	return __libc_realloc(memory, size);
+}
+}
+#else
+static void*
+countedAllocate(std::size_t size)
+{
+	countAllocation();
+	void* memory = std::malloc(size ? size : 1);
+	if (memory == NULL)
+		throw std::bad_alloc();
+	return memory;
+}
+
+// The replacements allocate with malloc() like the default ones, so memory
+// allocated here can be released by the default operator delete and
+// vice versa.
+void*
+operator new(std::size_t size)
+{
+	return countedAllocate(size);
+}
+
+void*
+operator new[](std::size_t size)
+{
+	return countedAllocate(size);
+}
+
+void
+operator delete(void* memory) throw()
+{
+	std::free(memory);
+}
+
+void
+operator delete[](void* memory) throw()
+{
+	std::free(memory);
+}
+
+#ifdef __cpp_sized_deallocation
+void
+operator delete(void* memory, std::size_t) throw()
+{
+	std::free(memory);
+}
+
+void
+operator delete[](void* memory, std::size_t) throw()
+{
+	std::free(memory);
+}
+#endif
+#endif
@@ -0,0 +1,65 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef ALLOCATION_COUNTER_HPP
+#define ALLOCATION_COUNTER_HPP
+
+#include <QtGlobal>
+
+//! Counts the heap allocations made by the current thread, to check that
+//! the per-frame code doesn't allocate memory.
+//!
+//! Allocations are counted only if the plug-in is built with the CMake option
+//! JOYSTICKSUPPORT_COUNT_ALLOCATIONS (meant for debug builds). Otherwise all
+//! functions are empty.
+//! With glibc, malloc(), calloc() and realloc() are replaced, so everything
+//! is counted, including the storage of Qt's containers allocated inside
+//! QtCore. This works in the executables that link AllocationCounter.cpp, and
+//! in Stellarium if the library built from it is loaded with LD_PRELOAD.
+//! Elsewhere only the global operator new is replaced, which sees only
+//! the allocations made in the plug-in's own code; countsMalloc() tells
+//! which is the case.
+namespace AllocationCounter
+{
+#ifdef JOYSTICKSUPPORT_COUNT_ALLOCATIONS
+	//! Number of allocations made by the calling thread so far.
+	quint64 count();
+	//! True if the allocations made with malloc() anywhere in the process
+	//! are counted.
+	bool countsMalloc();
+	void suspend();
+	void resume();
+#else
+	inline quint64 count() {return 0;}
+	inline bool countsMalloc() {return false;}
+	inline void suspend() {}
+	inline void resume() {}
+#endif
+
+	//! Stops counting until the end of the scope, e.g. while calling
+	//! Stellarium, whose allocations are not the plug-in's responsibility.
+	class Suspender
+	{
+	public:
+		Suspender() {suspend();}
+		~Suspender() {resume();}
+	};
+}
+
+#endif//ALLOCATION_COUNTER_HPP
@@ -0,0 +1,269 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "AxisCalibration.hpp"
+
+#include <QSettings>
+#include <QStringList>
+
+#include <algorithm>
+#include <cmath>
+
+//! How long the axes of a new device are measured, in seconds.
+static const double measureTime = 0.5;
+//! Larger changes mean that the device is being touched.
+static const int restingRange = 3277;
+//! Axes resting further from the middle than this are one-sided
+//! (triggers, throttles) and keep their center.
+static const int maxCenterOffset = 8192;
+//! Even a quiet stick doesn't return to exactly the same spot.
+static const float minDeadzone = 0.04f;
+
+void
+DeviceCalibration::setDefaults(const DeviceCapabilities& caps,
+                               float defaultDeadzone)
+{
+	for (int a = 0; a < InputSnapshot::MaxAxes; a++)
+	{
+		axes[a] = AxisCalibration();
+		axes[a].deadzone = defaultDeadzone;
+		partner[a] = -1;
+	}
+	if (caps.isGamepad)
+	{
+		pair(SDL_CONTROLLER_AXIS_LEFTX, SDL_CONTROLLER_AXIS_LEFTY);
+		pair(SDL_CONTROLLER_AXIS_RIGHTX, SDL_CONTROLLER_AXIS_RIGHTY);
+	}
+	else if (caps.axisCount >= 2)
+		pair(0, 1);
+}
+
+void
+DeviceCalibration::load(QSettings* store, const QString& guid)
+{
+	Q_ASSERT(store);
+	store->beginGroup(guid);
+	for (int a = 0; a < InputSnapshot::MaxAxes; a++)
+	{
+		AxisCalibration& axis = axes[a];
+		QString prefix = QString("axis%1_").arg(a);
+		axis.center = store->value(prefix + "center", axis.center).toInt();
+		axis.minimum = store->value(prefix + "minimum", axis.minimum).toInt();
+		axis.maximum = store->value(prefix + "maximum", axis.maximum).toInt();
+		axis.deadzone = store->value(prefix + "deadzone",
+		                             axis.deadzone).toFloat();
+	}
+	if (store->contains("pairs"))
+	{
+		for (int a = 0; a < InputSnapshot::MaxAxes; a++)
+			partner[a] = -1;
+		QStringList pairs = store->value("pairs").toStringList();
+		for (int i = 0; i < pairs.count(); i++)
+		{
+			QStringList axisNumbers = pairs[i].trimmed().split(':');
+			bool ok1 = false, ok2 = false;
+			if (axisNumbers.count() == 2)
+			{
+				int a = axisNumbers[0].toInt(&ok1);
+				int b = axisNumbers[1].toInt(&ok2);
+				if (ok1 && ok2)
+					pair(a, b);
+			}
+		}
+	}
+	store->endGroup();
+}
+
+void
+DeviceCalibration::save(QSettings* store, const QString& guid,
+                        int axisCount) const
+{
+	Q_ASSERT(store);
+	store->beginGroup(guid);
+	for (int a = 0; a < axisCount; a++)
+	{
+		QString prefix = QString("axis%1_").arg(a);
+		store->setValue(prefix + "center", axes[a].center);
+		store->setValue(prefix + "deadzone", axes[a].deadzone);
+	}
+	store->endGroup();
+}
+
+void
+DeviceCalibration::pair(int a, int b)
+{
+	if (a < 0 || b < 0 || a == b
+	    || a >= InputSnapshot::MaxAxes || b >= InputSnapshot::MaxAxes)
+		return;
+	partner[a] = b;
+	partner[b] = a;
+}
+
+
+AxisCalibrator::AxisCalibrator() :
+    measuringSlots(0),
+    failedSlots(0)
+{
+	DeviceCalibration calibration;
+	DeviceCapabilities caps;
+	caps.isGamepad = false;
+	caps.axisCount = 0;
+	calibration.setDefaults(caps, 0.f);
+	for (int slot = 0; slot < InputSnapshot::MaxDevices; slot++)
+	{
+		compile(slot, calibration);
+		measureStart[slot] = 0;
+		measureCount[slot] = 0;
+	}
+}
+
+void
+AxisCalibrator::compile(int slot, const DeviceCalibration& calibration)
+{
+	for (int a = 0; a < InputSnapshot::MaxAxes; a++)
+	{
+		const AxisCalibration& axis = calibration.axes[a];
+		int i = slot * InputSnapshot::MaxAxes + a;
+		int middle = qBound(-32767, axis.center, 32766);
+		center[i] = middle;
+		negativeScale[i] = 1.f / qMax(1, middle - axis.minimum);
+		positiveScale[i] = 1.f / qMax(1, axis.maximum - middle);
+		int other = calibration.partner[a];
+		// A circle, even if the axes were measured differently.
+		float radius = axis.deadzone;
+		if (other >= 0)
+			radius = qMax(radius, calibration.axes[other].deadzone);
+		deadzone[i] = qBound(0.f, radius, 0.99f);
+		deadzoneScale[i] = 1.f / (1.f - deadzone[i]);
+		partner[i] = (other < 0) ? a : other;
+		pairWeight[i] = (other < 0) ? 0.f : 1.f;
+	}
+}
+
+void
+AxisCalibrator::process(InputSnapshot& snapshot, const DeviceSet& devices) const
+{
+	for (int d = 0; d < devices.count(); d++)
+	{
+		const int first = devices.slot(d) * InputSnapshot::MaxAxes;
+		Sint16* axes = snapshot.axes + first;
+
+		// Normalized to [-1, 1] around the center...
+		float value[InputSnapshot::MaxAxes];
+		for (int a = 0; a < InputSnapshot::MaxAxes; a++)
+		{
+			int i = first + a;
+			float x = axes[a] - center[i];
+			x *= (x < 0.f) ? negativeScale[i] : positiveScale[i];
+			value[a] = std::min(std::max(x, -1.f), 1.f);
+		}
+		// ...then the deadzone is cut out of the magnitude, which for
+		// paired axes is the length of the stick's vector.
+		for (int a = 0; a < InputSnapshot::MaxAxes; a++)
+		{
+			int i = first + a;
+			float other = value[partner[i]];
+			float magnitude = std::sqrt(value[a] * value[a]
+			                            + pairWeight[i] * other * other);
+			float live = std::max(std::min(magnitude, 1.f) - deadzone[i], 0.f);
+			float y = value[a] * live * deadzoneScale[i]
+			          / std::max(magnitude, 1e-6f);
+			axes[a] = Sint16(y * 32767.f + (y >= 0.f ? 0.5f : -0.5f));
+		}
+	}
+}
+
+void
+AxisCalibrator::startMeasuring(int slot)
+{
+	measuringSlots |= (1 << slot);
+	failedSlots &= ~(1 << slot);
+	measureStart[slot] = 0;
+	measureCount[slot] = 0;
+}
+
+void
+AxisCalibrator::stopMeasuring(int slot)
+{
+	measuringSlots &= ~(1 << slot);
+}
+
+int
+AxisCalibrator::measure(const InputSnapshot& raw)
+{
+	int finished = 0;
+	for (int slot = 0; slot < InputSnapshot::MaxDevices; slot++)
+	{
+		if ((measuringSlots & (1 << slot)) == 0)
+			continue;
+		const int first = slot * InputSnapshot::MaxAxes;
+		const Sint16* axes = raw.axes + first;
+		if (measureCount[slot] == 0)
+		{
+			measureStart[slot] = raw.timestamp;
+			for (int a = 0; a < InputSnapshot::MaxAxes; a++)
+			{
+				lowest[first + a] = highest[first + a] = axes[a];
+				sum[first + a] = 0;
+			}
+		}
+		measureCount[slot]++;
+		bool moved = false;
+		for (int a = 0; a < InputSnapshot::MaxAxes; a++)
+		{
+			int i = first + a;
+			lowest[i] = qMin(lowest[i], axes[a]);
+			highest[i] = qMax(highest[i], axes[a]);
+			sum[i] += axes[a];
+			moved |= (highest[i] - lowest[i] > restingRange);
+		}
+
+		double elapsed = double(raw.timestamp - measureStart[slot])
+		                 / SDL_GetPerformanceFrequency();
+		if (moved)
+			failedSlots |= (1 << slot);
+		if (moved || (elapsed >= measureTime && measureCount[slot] >= 10))
+		{
+			measuringSlots &= ~(1 << slot);
+			finished |= (1 << slot);
+		}
+	}
+	return finished;
+}
+
+bool
+AxisCalibrator::getMeasurement(int slot, int axisCount,
+                               DeviceCalibration& calibration) const
+{
+	if (failedSlots & (1 << slot) || measureCount[slot] == 0)
+		return false;
+	for (int a = 0; a < axisCount; a++)
+	{
+		int i = slot * InputSnapshot::MaxAxes + a;
+		int mean = int(qRound64(double(sum[i]) / measureCount[slot]));
+		if (qAbs(mean) > maxCenterOffset)
+			continue;
+		// Twice the noise, as the center a stick returns to varies too.
+		int noise = qMax(highest[i] - mean, mean - lowest[i]);
+		AxisCalibration& axis = calibration.axes[a];
+		axis.center = mean;
+		axis.deadzone = qBound(minDeadzone, 2.f * noise / 32768.f + 0.02f, 0.5f);
+	}
+	return true;
+}
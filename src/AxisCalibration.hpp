@@ -0,0 +1,123 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef AXIS_CALIBRATION_HPP
+#define AXIS_CALIBRATION_HPP
+
+#include "DeviceSet.hpp"
+
+class QSettings;
+
+//! Calibration of one axis.
+struct AxisCalibration
+{
+	AxisCalibration() : center(0), minimum(-32768), maximum(32767),
+	                    deadzone(0.15f) {}
+
+	//! Raw values of the axis at rest and at the ends of its travel.
+	int center;
+	int minimum;
+	int maximum;
+	//! Fraction of the travel on either side of the center that is ignored.
+	//! For paired axes, the radius of a circular deadzone.
+	float deadzone;
+};
+
+//! The calibration of all axes of a device, stored per device GUID.
+//!
+//! The axes of a stick are paired, so their deadzone is a circle instead of
+//! a cross, and diagonal movements are not cut off. By default, the left and
+//! right sticks of game controllers and the first two axes of joysticks are
+//! paired.
+struct DeviceCalibration
+{
+	//! Resets all axes to the full range with the given deadzone and pairs
+	//! the axes of the sticks.
+	void setDefaults(const DeviceCapabilities& caps, float defaultDeadzone);
+	//! Reads the values in the group named after the GUID, where present:
+	//! "axisN_center", "axisN_minimum", "axisN_maximum", "axisN_deadzone"
+	//! and "pairs", a list of paired axes such as "0:1, 3:4".
+	void load(QSettings* store, const QString& guid);
+	//! Writes the centers and deadzones of all axes.
+	void save(QSettings* store, const QString& guid, int axisCount) const;
+	void pair(int a, int b);
+
+	AxisCalibration axes[InputSnapshot::MaxAxes];
+	//! For each axis, the other axis of its stick, or -1.
+	int partner[InputSnapshot::MaxAxes];
+};
+
+//! Applies the calibration of the open devices to snapshots and measures
+//! the resting state of newly opened devices.
+//!
+//! Calibrations are compiled into per-axis coefficients in flat arrays,
+//! so calibrating a snapshot is a single pass over the axes of the open
+//! devices. The result is in the usual range of an axis, with the deadzone
+//! removed and the remaining travel stretched to the full range, so nothing
+//! downstream needs to know about calibration.
+class AxisCalibrator
+{
+public:
+	enum { AxisCount = InputSnapshot::MaxDevices * InputSnapshot::MaxAxes };
+
+	AxisCalibrator();
+
+	//! Sets the calibration of the device in a slot.
+	void compile(int slot, const DeviceCalibration& calibration);
+	//! Calibrates the axes of the open devices in place.
+	void process(InputSnapshot& snapshot, const DeviceSet& devices) const;
+
+	//! Starts measuring the noise of a device's axes at rest.
+	void startMeasuring(int slot);
+	void stopMeasuring(int slot);
+	bool isMeasuring() const {return measuringSlots != 0;}
+	//! Adds a raw snapshot to the measurements.
+	//! @returns the mask of the slots whose measurement has ended.
+	int measure(const InputSnapshot& raw);
+	//! Sets the centers and deadzones of the axes that were at rest during
+	//! a finished measurement.
+	//! @returns false if the device was touched during the measurement.
+	bool getMeasurement(int slot, int axisCount,
+	                    DeviceCalibration& calibration) const;
+
+private:
+	// The compiled calibration, in the order of InputSnapshot::axes.
+	float center[AxisCount];
+	//! 1 / the travel on each side of the center.
+	float negativeScale[AxisCount];
+	float positiveScale[AxisCount];
+	float deadzone[AxisCount];
+	//! 1 / (1 - deadzone), stretching the rest of the travel.
+	float deadzoneScale[AxisCount];
+	//! Index of the paired axis on the same device (the axis itself if
+	//! none), and 1 if paired, 0 if not.
+	int partner[AxisCount];
+	float pairWeight[AxisCount];
+
+	// Measurements of the raw values, for each slot and axis.
+	int measuringSlots;
+	int failedSlots;
+	Uint64 measureStart[InputSnapshot::MaxDevices];
+	int measureCount[InputSnapshot::MaxDevices];
+	Sint16 lowest[AxisCount];
+	Sint16 highest[AxisCount];
+	qint64 sum[AxisCount];
+};
+
+#endif//AXIS_CALIBRATION_HPP
@@ -0,0 +1,99 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "AxisFilter.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+//! Stands for "no filtering": the filter follows the input exactly.
+static const float unfilteredCutoff = 1e9f;
+
+AxisFilter::AxisFilter() :
+    derivativeCutoff(1.0f),
+    lastTimestamp(0),
+    enabled(false)
+{
+	secondsPerTick = 1.0 / SDL_GetPerformanceFrequency();
+	for (int i = 0; i < AxisCount; i++)
+	{
+		minCutoff[i] = unfilteredCutoff;
+		beta[i] = 0.f;
+		estimate[i] = speed[i] = 0.f;
+	}
+}
+
+void
+AxisFilter::setParameters(int axis, float minCutoff, float beta)
+{
+	Q_ASSERT(axis >= 0 && axis < InputSnapshot::MaxAxes);
+	for (int d = 0; d < InputSnapshot::MaxDevices; d++)
+	{
+		int i = d * InputSnapshot::MaxAxes + axis;
+		this->minCutoff[i] = (minCutoff > 0.f) ? minCutoff : unfilteredCutoff;
+		this->beta[i] = (minCutoff > 0.f) ? beta : 0.f;
+	}
+	enabled = false;
+	for (int i = 0; i < AxisCount; i++)
+		enabled |= (this->minCutoff[i] != unfilteredCutoff);
+}
+
+void
+AxisFilter::process(InputSnapshot& snapshot)
+{
+	Sint16* axes = snapshot.axes;
+	const float scale = 1.f / 32768.f;
+
+	// Start from the current values after a reset or a long pause (e.g.
+	// no devices), instead of sweeping from where the filter stopped.
+	double dt = (snapshot.timestamp - lastTimestamp) * secondsPerTick;
+	if (lastTimestamp == 0 || snapshot.timestamp <= lastTimestamp || dt > 0.5)
+	{
+		lastTimestamp = snapshot.timestamp;
+		for (int i = 0; i < AxisCount; i++)
+		{
+			estimate[i] = axes[i] * scale;
+			speed[i] = 0.f;
+		}
+		return;
+	}
+	lastTimestamp = snapshot.timestamp;
+
+	// The smoothing factor for a cutoff f is 1 / (1 + tau / dt), where
+	// tau = 1 / (2 pi f), i.e. k / (1 + k) with k = 2 pi f dt.
+	const float rate = float(1.0 / dt);
+	const float kPerHz = float(2.0 * M_PI * dt);
+	const float kSpeed = kPerHz * derivativeCutoff;
+	const float alphaSpeed = kSpeed / (1.f + kSpeed);
+	for (int i = 0; i < AxisCount; i++)
+	{
+		float x = axes[i] * scale;
+		float s = speed[i] + alphaSpeed * ((x - estimate[i]) * rate - speed[i]);
+		speed[i] = s;
+		float k = kPerHz * (minCutoff[i] + beta[i] * std::fabs(s));
+		float e = estimate[i] + k / (1.f + k) * (x - estimate[i]);
+		estimate[i] = e;
+		float value = std::min(std::max(e * 32768.f, -32768.f), 32767.f);
+		axes[i] = Sint16(value + (value >= 0.f ? 0.5f : -0.5f));
+	}
+}
@@ -0,0 +1,76 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef AXIS_FILTER_HPP
+#define AXIS_FILTER_HPP
+
+#include "DeviceState.hpp"
+
+//! Smooths the axes of all devices with One-Euro filters, removing the jitter
+//! of cheap sticks without adding noticeable lag to fast movements.
+//!
+//! A One-Euro filter is a low-pass filter whose cutoff frequency rises with
+//! the speed of the axis: minCutoff applies when the axis is still, beta
+//! sets how fast the cutoff rises. With beta 0, it's a plain low-pass filter.
+//! See Casiez et al., "1 Euro Filter: A Simple Speed-based Low-pass Filter
+//! for Noisy Input in Interactive Systems", CHI 2012.
+//!
+//! The state of the filters is kept in contiguous float arrays in the same
+//! order as InputSnapshot::axes, so all axes of all devices are filtered in
+//! one branch-free loop that the compiler can vectorize.
+class AxisFilter
+{
+public:
+	enum { AxisCount = InputSnapshot::MaxDevices * InputSnapshot::MaxAxes };
+
+	AxisFilter();
+
+	//! Sets the parameters of an axis on all devices.
+	//! @param axis is the index of the axis on a device.
+	//! @param minCutoff is the cutoff frequency in Hz when the axis is still;
+	//! 0 disables filtering of the axis.
+	//! @param beta is how much the cutoff frequency rises with the speed of
+	//! the axis, in Hz per full travel per second.
+	void setParameters(int axis, float minCutoff, float beta);
+	//! Sets the cutoff frequency used for estimating the speed of the axes.
+	void setDerivativeCutoff(float hz) {derivativeCutoff = hz;}
+	//! True if any axis is filtered.
+	bool isEnabled() const {return enabled;}
+
+	//! Restarts all filters from the next sample, e.g. when devices change.
+	void reset() {lastTimestamp = 0;}
+	//! Filters the axes of a snapshot in place.
+	void process(InputSnapshot& snapshot);
+
+private:
+	//! Cutoff frequency at rest, very high for the axes that are not filtered.
+	float minCutoff[AxisCount];
+	float beta[AxisCount];
+	//! The filtered values, normalized to [-1, 1].
+	float estimate[AxisCount];
+	//! The filtered speed of the axes, in full travels per second.
+	float speed[AxisCount];
+	float derivativeCutoff;
+	//! Timestamp of the previous snapshot, 0 after reset().
+	Uint64 lastTimestamp;
+	double secondsPerTick;
+	bool enabled;
+};
+
+#endif//AXIS_FILTER_HPP
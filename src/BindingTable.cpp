@@ -0,0 +1,891 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "BindingTable.hpp"
+
+#include <QDebug>
+#include <QSettings>
+
+#include <algorithm>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+//! Names of the built-in actions, in the order of BuiltinAction.
+static const char* builtinActionNames[BuiltinActionCount] =
+{
+	"turn_up",
+	"turn_down",
+	"turn_left",
+	"turn_right",
+	"zoom_in",
+	"zoom_out",
+	"move_slow",
+	"toggle_mount_mode",
+	"auto_zoom_in",
+	"auto_zoom_out",
+	"set_time_now",
+	"increase_time_speed",
+	"decrease_time_speed",
+	"set_real_time_speed",
+	"set_zero_time_speed",
+	"dump_latency_stats"
+};
+
+//! The bindings used if there is nothing in the configuration file.
+//! They reproduce the original hard-coded controls.
+static const char* defaultGamepadBindings[][2] =
+{
+	{"dpup", "turn_up"},
+	{"dpdown", "turn_down"},
+	{"dpleft", "turn_left"},
+	{"dpright", "turn_right"},
+	{"a", "toggle_mount_mode"},
+	{"b", "move_slow"},
+	{"leftstick", "move_slow"},
+	{"rightstick", "move_slow"},
+	{"x", "auto_zoom_out"},
+	{"y", "set_time_now"},
+	{"leftshoulder", "decrease_time_speed"},
+	{"rightshoulder", "increase_time_speed"},
+	{NULL, NULL}
+};
+
+static const char* defaultJoystickBindings[][2] =
+{
+	{"button0", "release:toggle_mount_mode"},
+	{"button1", "move_slow"},
+	{"hat0_up", "turn_up"},
+	{"hat0_down", "turn_down"},
+	{"hat0_left", "turn_left"},
+	{"hat0_right", "turn_right"},
+	{"hat1_up", "turn_up"},
+	{"hat1_down", "turn_down"},
+	{"hat1_left", "turn_left"},
+	{"hat1_right", "turn_right"},
+	{NULL, NULL}
+};
+
+//! Axis values past this are considered "pressed".
+static const Sint16 axisButtonThreshold = 16384;
+
+static inline bool
+isInputActive(const BindingTable::Binding& binding, const InputSnapshot& state)
+{
+	switch (binding.source)
+	{
+	case BindingTable::SourceButton:
+		return state.button(binding.device, binding.index);
+	case BindingTable::SourceHat:
+		return (state.hat(binding.device, binding.index) & binding.mask) != 0;
+	case BindingTable::SourceAxisPositive:
+		return state.axis(binding.device, binding.index) > axisButtonThreshold;
+	case BindingTable::SourceAxisNegative:
+		return state.axis(binding.device, binding.index) < -axisButtonThreshold;
+	default:
+		return false;
+	}
+}
+
+
+//! Position of a button binding's input among all buttons of all devices.
+static inline int
+buttonInput(const BindingTable::Binding& binding)
+{
+	return binding.device * InputSnapshot::MaxButtons + binding.index;
+}
+
+//! Orders button bindings first, by input.
+static bool
+bindingLessThan(const BindingTable::Binding& a, const BindingTable::Binding& b)
+{
+	bool aIsButton = (a.source == BindingTable::SourceButton);
+	bool bIsButton = (b.source == BindingTable::SourceButton);
+	if (aIsButton != bIsButton)
+		return aIsButton;
+	return aIsButton && buttonInput(a) < buttonInput(b);
+}
+
+//! Orders chords by device, the largest first.
+static bool
+chordLessThan(const BindingTable::Chord& a, const BindingTable::Chord& b)
+{
+	if (a.device != b.device)
+		return a.device < b.device;
+	return a.size > b.size;
+}
+
+//! True if at least @p ticks have passed from @p since to @p now.
+static inline bool
+hasElapsed(Uint64 since, Uint64 now, Uint64 ticks)
+{
+	return now >= since && now - since >= ticks;
+}
+
+//! Index of the lowest set bit. The value must not be zero.
+static inline int
+lowestSetBit(quint64 value)
+{
+#if defined(__GNUC__)
+	return __builtin_ctzll(value);
+#elif defined(_MSC_VER) && defined(_WIN64)
+	unsigned long index;
+	_BitScanForward64(&index, value);
+	return index;
+#else
+	int index = 0;
+	while ((value & 1) == 0)
+	{
+		value >>= 1;
+		index++;
+	}
+	return index;
+#endif
+}
+
+
+BindingTable::BindingTable() :
+    otherFirst(0),
+    needsResync(false),
+    longPressTicks(0),
+    doubleTapTicks(0)
+{
+	for (int w = 0; w < ButtonWordCount; w++)
+	{
+		suppressedButtons[w] = 0;
+		timedButtons[w] = 0;
+	}
+	setGestureTimes(0.5, 0.3);
+}
+
+void
+BindingTable::clear()
+{
+	bindings.clear();
+	externalActions.clear();
+	heldActions.clear();
+	heldCount.clear();
+	buttonMasks.fill(0, ButtonWordCount);
+	buttonFirst.fill(0, ButtonInputCount + 1);
+	otherFirst = 0;
+	chords.clear();
+	chordActive.clear();
+	chordMasks.fill(0, ButtonWordCount);
+	gestures.clear();
+	gestureMasks.fill(0, ButtonWordCount);
+	for (int w = 0; w < ButtonWordCount; w++)
+	{
+		suppressedButtons[w] = 0;
+		timedButtons[w] = 0;
+	}
+}
+
+void
+BindingTable::addDevice(QSettings* conf, const QStringList& sections,
+                        bool isGamepad, int device)
+{
+	Q_ASSERT(conf);
+	int firstBinding = count();
+	for (int s = 0; s < sections.count() && count() == firstBinding; s++)
+	{
+		conf->beginGroup(sections[s]);
+		QStringList inputs = conf->childKeys();
+		for (int i = 0; i < inputs.count(); i++)
+		{
+			// A value with commas is read as a list of actions.
+			QStringList actions = conf->value(inputs[i]).toStringList();
+			for (int a = 0; a < actions.count(); a++)
+			{
+				if (!addBinding(inputs[i], actions[a], isGamepad, device))
+					qWarning() << "JoystickSupport: ignoring invalid binding in"
+					           << sections[s] << ':' << inputs[i] << '='
+					           << actions[a];
+			}
+		}
+		conf->endGroup();
+	}
+
+	if (count() == firstBinding)
+		addDefaults(isGamepad, device);
+}
+
+void
+BindingTable::addDefaults(bool isGamepad, int device)
+{
+	const char* (*defaults)[2] = isGamepad ? defaultGamepadBindings
+	                                       : defaultJoystickBindings;
+	for (int i = 0; defaults[i][0] != NULL; i++)
+		addBinding(defaults[i][0], defaults[i][1], isGamepad, device);
+}
+
+void
+BindingTable::evaluate(const InputSnapshot& current,
+                       const InputSnapshot& previous,
+                       ActionTarget& target)
+{
+	if (needsResync)
+		resync(previous, target);
+
+	// Buttons: the edges of all bound buttons are found a word at a time
+	// and only the buttons that have changed are dispatched, so an idle
+	// device costs a few XORs per frame regardless of its button count.
+	const quint64* masks = buttonMasks.constData();
+	quint64 changed[ButtonWordCount];
+	quint64 anyChanged = 0;
+	for (int w = 0; w < ButtonWordCount; w++)
+	{
+		changed[w] = (current.buttons[w] ^ previous.buttons[w]) & masks[w];
+		anyChanged |= changed[w];
+	}
+	if (anyChanged)
+	{
+		const quint64* chordBits = chordMasks.constData();
+		const quint64* gestureBits = gestureMasks.constData();
+		for (int w = 0; w < ButtonWordCount; w++)
+		{
+			quint64 bits = changed[w];
+			while (bits)
+			{
+				int bit = lowestSetBit(bits);
+				bits &= bits - 1;
+				quint64 flag = Q_UINT64_C(1) << bit;
+				bool active = (current.buttons[w] & flag) != 0;
+				int input = w * 64 + bit;
+				// Chords come first, so the button that completes one
+				// is kept from triggering its own bindings.
+				bool suppressed;
+				if (active)
+				{
+					if ((chordBits[w] & flag)
+					    && pressChord(input, current, target))
+						suppressedButtons[w] |= flag;
+					suppressed = (suppressedButtons[w] & flag) != 0;
+				}
+				else
+				{
+					if (chordBits[w] & flag)
+						releaseChords(input, target);
+					suppressed = (suppressedButtons[w] & flag) != 0;
+					suppressedButtons[w] &= ~flag;
+				}
+
+				if (!suppressed)
+				{
+					const Binding* first = bindings.constData()
+					                       + buttonFirst[input];
+					const Binding* last = bindings.constData()
+					                      + buttonFirst[input + 1];
+					for (; first != last; ++first)
+						dispatch(first->trigger, first->action, active, target);
+				}
+				if (gestureBits[w] & flag)
+				{
+					Gesture& gesture = gestures[gestureIndex[input]];
+					if (active)
+						pressGesture(gesture, current.timestamp, target);
+					else
+						releaseGesture(gesture, current.timestamp, target);
+				}
+			}
+		}
+	}
+	checkGestureTimes(current.timestamp, target);
+
+	// Hats and axes used as buttons are few, so they are checked one by one.
+	const Binding* binding = bindings.constData() + otherFirst;
+	const Binding* end = bindings.constData() + bindings.count();
+	for (; binding != end; ++binding)
+	{
+		bool active = isInputActive(*binding, current);
+		if (active != isInputActive(*binding, previous))
+			dispatch(binding->trigger, binding->action, active, target);
+	}
+}
+
+void
+BindingTable::dispatch(int trigger, int action, bool active,
+                       ActionTarget& target)
+{
+	switch (trigger)
+	{
+	case TriggerPress:
+		if (active)
+			target.performAction(action, true);
+		break;
+	case TriggerRelease:
+		if (!active)
+			target.performAction(action, true);
+		break;
+	case TriggerHold:
+		// Several inputs may hold the same action, so only the first one
+		// activated and the last one released are reported.
+	{
+		quint16& count = heldCount[action];
+		if (active)
+		{
+			if (count++ == 0)
+				target.performAction(action, true);
+		}
+		else if (count > 0)
+		{
+			if (--count == 0)
+				target.performAction(action, false);
+		}
+	}
+		break;
+	}
+}
+
+bool
+BindingTable::pressChord(int input, const InputSnapshot& state,
+                         ActionTarget& target)
+{
+	int device = input / InputSnapshot::MaxButtons;
+	int button = input % InputSnapshot::MaxButtons;
+	int word = button >> 6;
+	quint64 flag = Q_UINT64_C(1) << (button & 63);
+	const quint64* held = state.buttons + device * InputSnapshot::ButtonWords;
+	bool inActiveChord = false;
+	for (int c = chordFirst[device]; c < chordFirst[device + 1]; c++)
+	{
+		const Chord& chord = chords[c];
+		if (!(chord.buttons[word] & flag))
+			continue;
+		// Completed by another button pressed in the same snapshot. It's
+		// released only once, so it must not be pressed again.
+		if (chordActive[c])
+		{
+			inActiveChord = true;
+			continue;
+		}
+		bool complete = true;
+		for (int w = 0; w < InputSnapshot::ButtonWords; w++)
+			complete &= ((held[w] & chord.buttons[w]) == chord.buttons[w]);
+		if (!complete)
+			continue;
+
+		// The chords are sorted from the largest, so this is the one.
+		chordActive[c] = true;
+		dispatch(chord.trigger, chord.action, true, target);
+		consumeGestures(chord, target);
+		return true;
+	}
+	return inActiveChord;
+}
+
+void
+BindingTable::releaseChords(int input, ActionTarget& target)
+{
+	int device = input / InputSnapshot::MaxButtons;
+	int button = input % InputSnapshot::MaxButtons;
+	int word = button >> 6;
+	quint64 flag = Q_UINT64_C(1) << (button & 63);
+	for (int c = chordFirst[device]; c < chordFirst[device + 1]; c++)
+	{
+		const Chord& chord = chords[c];
+		if (chordActive[c] && (chord.buttons[word] & flag))
+		{
+			chordActive[c] = false;
+			dispatch(chord.trigger, chord.action, false, target);
+		}
+	}
+}
+
+void
+BindingTable::consumeGestures(const Chord& chord, ActionTarget& target)
+{
+	const quint64* masks = gestureMasks.constData()
+	                       + chord.device * InputSnapshot::ButtonWords;
+	for (int w = 0; w < InputSnapshot::ButtonWords; w++)
+	{
+		quint64 bits = chord.buttons[w] & masks[w];
+		while (bits)
+		{
+			int bit = lowestSetBit(bits);
+			bits &= bits - 1;
+			int input = chord.device * InputSnapshot::MaxButtons + w * 64 + bit;
+			Gesture& gesture = gestures[gestureIndex[input]];
+			// A tap that was waiting for a second one is over.
+			if (gesture.state == GestureTapped && gesture.tapAction != NoAction)
+				target.performAction(gesture.tapAction, true);
+			gesture.state = GestureConsumed;
+			setTimed(input, false);
+		}
+	}
+}
+
+void
+BindingTable::pressGesture(Gesture& gesture, Uint64 time,
+                           ActionTarget& target)
+{
+	if (gesture.state == GestureConsumed)
+		return;
+	if (gesture.state == GestureTapped)
+	{
+		if (!hasElapsed(gesture.time, time, doubleTapTicks + 1))
+		{
+			target.performAction(gesture.doubleAction, true);
+			gesture.state = GestureConsumed;
+			setTimed(gesture.input, false);
+			return;
+		}
+		// Its time ran out between the last snapshot and this one.
+		if (gesture.tapAction != NoAction)
+			target.performAction(gesture.tapAction, true);
+	}
+	gesture.state = GesturePressed;
+	gesture.time = time;
+	setTimed(gesture.input, gesture.longAction != NoAction);
+}
+
+void
+BindingTable::releaseGesture(Gesture& gesture, Uint64 time,
+                             ActionTarget& target)
+{
+	int state = gesture.state;
+	gesture.state = GestureIdle;
+	setTimed(gesture.input, false);
+	if (state != GesturePressed)
+		return;
+
+	if (gesture.longAction != NoAction
+	    && hasElapsed(gesture.time, time, longPressTicks))
+		target.performAction(gesture.longAction, true);
+	else if (gesture.doubleAction != NoAction)
+	{
+		gesture.state = GestureTapped;
+		gesture.time = time;
+		setTimed(gesture.input, true);
+	}
+	else if (gesture.tapAction != NoAction)
+		target.performAction(gesture.tapAction, true);
+}
+
+void
+BindingTable::checkGestureTimes(Uint64 time, ActionTarget& target)
+{
+	for (int w = 0; w < ButtonWordCount; w++)
+	{
+		quint64 bits = timedButtons[w];
+		while (bits)
+		{
+			int bit = lowestSetBit(bits);
+			bits &= bits - 1;
+			int input = w * 64 + bit;
+			Gesture& gesture = gestures[gestureIndex[input]];
+			if (gesture.state == GesturePressed
+			    && hasElapsed(gesture.time, time, longPressTicks))
+			{
+				target.performAction(gesture.longAction, true);
+				gesture.state = GestureLongDone;
+				setTimed(input, false);
+			}
+			else if (gesture.state == GestureTapped
+			         && hasElapsed(gesture.time, time, doubleTapTicks + 1))
+			{
+				if (gesture.tapAction != NoAction)
+					target.performAction(gesture.tapAction, true);
+				gesture.state = GestureIdle;
+				setTimed(input, false);
+			}
+		}
+	}
+}
+
+void
+BindingTable::setTimed(int input, bool timed)
+{
+	quint64 flag = Q_UINT64_C(1) << (input & 63);
+	if (timed)
+		timedButtons[input >> 6] |= flag;
+	else
+		timedButtons[input >> 6] &= ~flag;
+}
+
+void
+BindingTable::setGestureTimes(double longPress, double doubleTap)
+{
+	Uint64 frequency = SDL_GetPerformanceFrequency();
+	longPressTicks = Uint64(qMax(0.0, longPress) * frequency);
+	doubleTapTicks = Uint64(qMax(0.0, doubleTap) * frequency);
+}
+
+QString
+BindingTable::getActionName(int actionId) const
+{
+	int index = actionId - BuiltinActionCount;
+	if (index < 0 || index >= externalActions.count())
+		return QString();
+	return externalActions[index];
+}
+
+bool
+BindingTable::addBinding(const QString& input,
+                         const QString& action,
+                         bool isGamepad,
+                         int device)
+{
+	QString name = action.trimmed();
+	int trigger = TriggerPress;
+	bool explicitTrigger = true;
+	if (name.startsWith("press:"))
+		trigger = TriggerPress;
+	else if (name.startsWith("release:"))
+		trigger = TriggerRelease;
+	else if (name.startsWith("hold:"))
+		trigger = TriggerHold;
+	else if (name.startsWith("tap:"))
+		trigger = TriggerTap;
+	else if (name.startsWith("long:"))
+		trigger = TriggerLong;
+	else if (name.startsWith("double:"))
+		trigger = TriggerDouble;
+	else
+		explicitTrigger = false;
+	if (explicitTrigger)
+		name = name.section(':', 1);
+
+	// A trailing "+" is the direction of an axis, not a chord.
+	QString inputName = input.trimmed().toLower();
+	bool isChord = inputName.indexOf('+') > 0 && !inputName.endsWith('+');
+	Binding binding;
+	Chord chord;
+	if (isChord)
+	{
+		if (trigger >= TriggerTap
+		    || !parseChord(inputName, isGamepad, chord))
+			return false;
+	}
+	else
+	{
+		if (!parseInput(inputName, isGamepad, binding))
+			return false;
+		if (trigger >= TriggerTap && binding.source != SourceButton)
+			return false;
+	}
+
+	int actionId = findAction(name);
+	if (actionId < 0)
+		return false;
+	// Movement actions control a state, everything else is a one-time event.
+	if (!explicitTrigger && actionId <= ActionMoveSlow)
+		trigger = TriggerHold;
+
+	if (isChord)
+	{
+		chord.device = device;
+		chord.trigger = trigger;
+		chord.action = actionId;
+		chords.append(chord);
+		return true;
+	}
+	binding.device = device;
+	if (trigger >= TriggerTap)
+		return addGesture(buttonInput(binding), trigger, actionId);
+	binding.trigger = trigger;
+	binding.action = actionId;
+	bindings.append(binding);
+	return true;
+}
+
+bool
+BindingTable::parseChord(const QString& input, bool isGamepad, Chord& chord)
+{
+	chord.size = 0;
+	for (int w = 0; w < InputSnapshot::ButtonWords; w++)
+		chord.buttons[w] = 0;
+
+	QStringList names = input.split('+');
+	for (int i = 0; i < names.count(); i++)
+	{
+		Binding button;
+		if (!parseInput(names[i].trimmed(), isGamepad, button)
+		    || button.source != SourceButton)
+			return false;
+		quint64& word = chord.buttons[button.index >> 6];
+		quint64 flag = Q_UINT64_C(1) << (button.index & 63);
+		if (word & flag)
+			return false;
+		word |= flag;
+		chord.size++;
+	}
+	return true;
+}
+
+bool
+BindingTable::addGesture(int input, int trigger, int actionId)
+{
+	// Gestures are one-time events, they can't hold a movement.
+	if (actionId <= ActionMoveSlow)
+		return false;
+	int g = 0;
+	while (g < gestures.count() && gestures[g].input != input)
+		g++;
+	if (g == gestures.count())
+	{
+		Gesture gesture;
+		gesture.input = input;
+		gesture.tapAction = NoAction;
+		gesture.longAction = NoAction;
+		gesture.doubleAction = NoAction;
+		gesture.state = GestureIdle;
+		gesture.time = 0;
+		gestures.append(gesture);
+	}
+
+	Gesture& gesture = gestures[g];
+	quint16& slot = (trigger == TriggerTap) ? gesture.tapAction
+	                : (trigger == TriggerLong) ? gesture.longAction
+	                : gesture.doubleAction;
+	if (slot != NoAction)
+		return false;
+	slot = actionId;
+	return true;
+}
+
+bool
+BindingTable::parseInput(const QString& input,
+                         bool isGamepad,
+                         Binding& binding)
+{
+	binding.index = 0;
+	binding.mask = 0;
+	bool ok = false;
+	if (isGamepad)
+	{
+		QByteArray name = input.toLatin1();
+		SDL_GameControllerButton button =
+		        SDL_GameControllerGetButtonFromString(name.constData());
+		if (button != SDL_CONTROLLER_BUTTON_INVALID
+		    && static_cast<int>(button) < InputSnapshot::MaxButtons)
+		{
+			binding.source = SourceButton;
+			binding.index = button;
+			return true;
+		}
+
+		binding.source = SourceAxisPositive;
+		if (name.endsWith('-'))
+			binding.source = SourceAxisNegative;
+		if (name.endsWith('-') || name.endsWith('+'))
+			name.chop(1);
+		SDL_GameControllerAxis axis =
+		        SDL_GameControllerGetAxisFromString(name.constData());
+		if (axis == SDL_CONTROLLER_AXIS_INVALID)
+			return false;
+		binding.index = axis;
+		return true;
+	}
+
+	if (input.startsWith("button"))
+	{
+		int index = input.mid(6).toInt(&ok);
+		if (!ok || index < 0 || index >= InputSnapshot::MaxButtons)
+			return false;
+		binding.source = SourceButton;
+		binding.index = index;
+		return true;
+	}
+	if (input.startsWith("hat"))
+	{
+		int index = input.section('_', 0, 0).mid(3).toInt(&ok);
+		if (!ok || index < 0 || index >= InputSnapshot::MaxHats)
+			return false;
+		QString direction = input.section('_', 1);
+		if (direction == "up")
+			binding.mask = SDL_HAT_UP;
+		else if (direction == "down")
+			binding.mask = SDL_HAT_DOWN;
+		else if (direction == "left")
+			binding.mask = SDL_HAT_LEFT;
+		else if (direction == "right")
+			binding.mask = SDL_HAT_RIGHT;
+		else
+			return false;
+		binding.source = SourceHat;
+		binding.index = index;
+		return true;
+	}
+	if (input.startsWith("axis") && input.length() > 5)
+	{
+		QString sign = input.right(1);
+		if (sign != "+" && sign != "-")
+			return false;
+		int index = input.mid(4, input.length() - 5).toInt(&ok);
+		if (!ok || index < 0 || index >= InputSnapshot::MaxAxes)
+			return false;
+		binding.source = (sign == "+") ? SourceAxisPositive
+		                               : SourceAxisNegative;
+		binding.index = index;
+		return true;
+	}
+	return false;
+}
+
+int
+BindingTable::findAction(const QString& name)
+{
+	if (name.isEmpty())
+		return -1;
+	for (int i = 0; i < BuiltinActionCount; i++)
+	{
+		if (name == builtinActionNames[i])
+			return i;
+	}
+	// Anything else is assumed to be a StelAction ID, checked later.
+	int index = externalActions.indexOf(name);
+	if (index < 0)
+	{
+		index = externalActions.count();
+		externalActions.append(name);
+	}
+	return BuiltinActionCount + index;
+}
+
+void
+BindingTable::finish()
+{
+	// Button bindings are sorted by input and indexed, the rest follow.
+	std::stable_sort(bindings.begin(), bindings.end(), bindingLessThan);
+
+	buttonMasks.fill(0, ButtonWordCount);
+	buttonFirst.fill(0, ButtonInputCount + 1);
+	otherFirst = 0;
+	while (otherFirst < bindings.count()
+	       && bindings[otherFirst].source == SourceButton)
+	{
+		int input = buttonInput(bindings[otherFirst]);
+		buttonMasks[input >> 6] |= Q_UINT64_C(1) << (input & 63);
+		buttonFirst[input + 1]++;
+		otherFirst++;
+	}
+	// Turns the counts into the positions of the first binding of each input.
+	for (int i = 0; i < ButtonInputCount; i++)
+		buttonFirst[i + 1] += buttonFirst[i];
+
+	std::stable_sort(chords.begin(), chords.end(), chordLessThan);
+	chordFirst.fill(0, InputSnapshot::MaxDevices + 1);
+	chordMasks.fill(0, ButtonWordCount);
+	for (int c = 0; c < chords.count(); c++)
+	{
+		const Chord& chord = chords[c];
+		chordFirst[chord.device + 1]++;
+		for (int w = 0; w < InputSnapshot::ButtonWords; w++)
+			chordMasks[chord.device * InputSnapshot::ButtonWords + w]
+			        |= chord.buttons[w];
+	}
+	for (int d = 0; d < InputSnapshot::MaxDevices; d++)
+		chordFirst[d + 1] += chordFirst[d];
+
+	gestureIndex.fill(NoAction, ButtonInputCount);
+	gestureMasks.fill(0, ButtonWordCount);
+	for (int g = 0; g < gestures.count(); g++)
+	{
+		int input = gestures[g].input;
+		gestureIndex[input] = g;
+		gestureMasks[input >> 6] |= Q_UINT64_C(1) << (input & 63);
+	}
+	for (int w = 0; w < ButtonWordCount; w++)
+		buttonMasks[w] |= chordMasks[w] | gestureMasks[w];
+
+	heldActions.clear();
+	for (int i = 0; i < bindings.count(); i++)
+	{
+		if (bindings[i].trigger == TriggerHold
+		    && !heldActions.contains(bindings[i].action))
+			heldActions.append(bindings[i].action);
+	}
+	for (int c = 0; c < chords.count(); c++)
+	{
+		if (chords[c].trigger == TriggerHold
+		    && !heldActions.contains(chords[c].action))
+			heldActions.append(chords[c].action);
+	}
+	restart();
+}
+
+void
+BindingTable::restart()
+{
+	heldCount.fill(0, getActionCount());
+	chordActive.fill(false, chords.count());
+	for (int g = 0; g < gestures.count(); g++)
+		gestures[g].state = GestureIdle;
+	for (int w = 0; w < ButtonWordCount; w++)
+	{
+		suppressedButtons[w] = 0;
+		timedButtons[w] = 0;
+	}
+	needsResync = true;
+}
+
+void
+BindingTable::swap(BindingTable& other)
+{
+	bindings.swap(other.bindings);
+	buttonMasks.swap(other.buttonMasks);
+	buttonFirst.swap(other.buttonFirst);
+	qSwap(otherFirst, other.otherFirst);
+	externalActions.swap(other.externalActions);
+	heldActions.swap(other.heldActions);
+	heldCount.swap(other.heldCount);
+	qSwap(needsResync, other.needsResync);
+	chords.swap(other.chords);
+	chordFirst.swap(other.chordFirst);
+	chordActive.swap(other.chordActive);
+	chordMasks.swap(other.chordMasks);
+	gestures.swap(other.gestures);
+	gestureIndex.swap(other.gestureIndex);
+	gestureMasks.swap(other.gestureMasks);
+	for (int w = 0; w < ButtonWordCount; w++)
+	{
+		qSwap(suppressedButtons[w], other.suppressedButtons[w]);
+		qSwap(timedButtons[w], other.timedButtons[w]);
+	}
+}
+
+void
+BindingTable::resync(const InputSnapshot& state, ActionTarget& target)
+{
+	needsResync = false;
+	for (int i = 0; i < bindings.count(); i++)
+	{
+		if (bindings[i].trigger == TriggerHold
+		    && isInputActive(bindings[i], state))
+			dispatch(TriggerHold, bindings[i].action, true, target);
+	}
+	// Held chords are activated as if completed, the others wait for
+	// their buttons to be pressed again.
+	for (int c = 0; c < chords.count(); c++)
+	{
+		const Chord& chord = chords[c];
+		if (chord.trigger != TriggerHold)
+			continue;
+		const quint64* held = state.buttons
+		                      + chord.device * InputSnapshot::ButtonWords;
+		bool complete = true;
+		for (int w = 0; w < InputSnapshot::ButtonWords; w++)
+			complete &= ((held[w] & chord.buttons[w]) == chord.buttons[w]);
+		if (complete)
+		{
+			chordActive[c] = true;
+			dispatch(TriggerHold, chord.action, true, target);
+		}
+	}
+}
@@ -0,0 +1,333 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef BINDING_TABLE_HPP
+#define BINDING_TABLE_HPP
+
+#include "DeviceState.hpp"
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+class QSettings;
+
+//! Actions implemented by the plug-in itself, mostly calls to
+//! StelMovementMgr and StelCore that don't have a StelAction.
+//! Any other action ID refers to a StelAction, see BindingTable::getActionName().
+enum BuiltinAction
+{
+	// Actions controlling a state come first, up to ActionMoveSlow.
+	// JoystickSupport keeps them as bits of a single byte.
+	ActionTurnUp = 0,
+	ActionTurnDown,
+	ActionTurnLeft,
+	ActionTurnRight,
+	ActionZoomIn,
+	ActionZoomOut,
+	ActionMoveSlow,
+	ActionToggleMountMode,
+	ActionAutoZoomIn,
+	ActionAutoZoomOut,
+	ActionSetTimeNow,
+	ActionIncreaseTimeSpeed,
+	ActionDecreaseTimeSpeed,
+	ActionSetRealTimeSpeed,
+	ActionSetZeroTimeSpeed,
+	ActionDumpLatencyStats,
+	BuiltinActionCount
+};
+
+//! Receives the actions triggered by a BindingTable.
+class ActionTarget
+{
+public:
+	virtual ~ActionTarget() {}
+	//! @param active is always true for one-time actions. For actions bound
+	//! as "held", it's true once when any of their inputs is activated and
+	//! false once when all of them are released.
+	virtual void performAction(int actionId, bool active) = 0;
+};
+
+//! A list of input-to-action bindings, compiled from the configuration
+//! and evaluated by comparing consecutive states of the devices.
+//!
+//! Only the inputs that have changed are dispatched. Button edges are found
+//! by comparing the button bits of all devices a 64-bit word at a time,
+//! masked by the buttons that are bound to something, so devices with many
+//! idle buttons cost almost nothing. The few hat and axis bindings are
+//! checked in a linear pass over the end of the table.
+//!
+//! The bindings of all open devices are kept in the same table, so inputs
+//! from different devices are merged into a single stream of actions:
+//! a "held" action is active while any of its inputs on any device is.
+//!
+//! Buttons can also be combined into chords and bound to gestures (tap,
+//! long press and double tap). These are compiled into flat state machines:
+//! a few bits per button, kept in words parallel to the button state, and
+//! a Gesture record for each button that has gestures. They advance only
+//! on button edges and on the timestamps of the snapshots, so there are no
+//! timers and evaluate() never allocates. The deadlines are checked only
+//! for the buttons whose bit is set in #timedButtons.
+//!
+//! Bindings are read from a section of the configuration file where each key
+//! names an input and each value names an action, optionally prefixed with
+//! the trigger ("press:", "release:", "hold:", "tap:", "long:" or
+//! "double:"). A value can list several actions, separated by commas, and
+//! a key can name several buttons of the device joined by "+", e.g.
+//! @code
+//! [JoystickSupport_gamepad]
+//! a = toggle_mount_mode
+//! b = move_slow
+//! back = press:actionShow_Constellation_Lines
+//! x = tap:auto_zoom_out, long:auto_zoom_in, double:set_time_now
+//! leftshoulder = tap:decrease_time_speed
+//! leftshoulder+a = actionShow_Equatorial_Grid
+//! @endcode
+//! A chord is completed by pressing the last of its buttons while the others
+//! are held, in any order; if several chords are completed at once, only
+//! the one with the most buttons is. The button that completes a chord
+//! doesn't trigger its own bindings until it's released again, and none of
+//! the chord's buttons triggers a gesture until then. This way a button whose
+//! own action is bound with "tap:" can act as a shift for the others.
+//! For game controllers, inputs are named as in SDL's mapping strings
+//! ("a", "dpup", "leftshoulder"...), axes can be used as buttons with
+//! an optional sign ("lefttrigger", "rightx-"). For joysticks, inputs are
+//! "button<N>", "hat<N>_up" (or _down, _left, _right) and "axis<N>+" or
+//! "axis<N>-", counting from 0.
+class BindingTable
+{
+public:
+	//! How a binding reacts to its input.
+	enum Trigger
+	{
+		TriggerPress,   //!< Once, when the input is activated.
+		TriggerRelease, //!< Once, when the input is released.
+		TriggerHold,    //!< Active while the input is active.
+		//! Once, when a button is released before the long press time and,
+		//! if it has a double tap binding, isn't pressed again in time.
+		TriggerTap,
+		//! Once, when a button has been held for the long press time.
+		TriggerLong,
+		//! Once, when a button is pressed again within the double tap time
+		//! of being tapped.
+		TriggerDouble
+	};
+
+	//! Kind of input that activates a binding.
+	enum Source
+	{
+		SourceButton,
+		SourceHat,         //!< Active if any of the hat's bits in the mask is set.
+		SourceAxisPositive, //!< Active if the axis is past half of its travel.
+		SourceAxisNegative
+	};
+
+	//! One compiled binding. Kept small so the table fits in a few cache lines.
+	struct Binding
+	{
+		quint8 source;
+		quint8 trigger;
+		//! Slot of the device in the InputSnapshot.
+		quint8 device;
+		quint8 index;
+		quint8 mask;
+		quint16 action;
+	};
+
+	//! Buttons of a device bound together.
+	struct Chord
+	{
+		//! Slot of the device in the InputSnapshot.
+		quint8 device;
+		quint8 trigger;
+		//! Number of buttons, for preferring larger chords.
+		quint8 size;
+		quint16 action;
+		//! The buttons, in the same format as the device's part of
+		//! InputSnapshot::buttons.
+		quint64 buttons[InputSnapshot::ButtonWords];
+	};
+
+	//! State of a button in recognizing its gestures.
+	enum GestureState
+	{
+		GestureIdle,     //!< Released, or pressed before the table was compiled.
+		GesturePressed,  //!< Pressed, and may become a tap or a long press.
+		GestureLongDone, //!< Held after its long press was triggered.
+		GestureTapped,   //!< Released, waiting for a second tap.
+		GestureConsumed  //!< Used by a chord or a double tap until released.
+	};
+
+	//! The gesture bindings of a button and its state.
+	struct Gesture
+	{
+		//! Position of the button among all buttons of all devices.
+		quint16 input;
+		//! Actions of each gesture, or NoAction.
+		quint16 tapAction;
+		quint16 longAction;
+		quint16 doubleAction;
+		quint8 state;
+		//! Timestamp of the last press or, in GestureTapped, release.
+		Uint64 time;
+	};
+
+	enum {NoAction = 0xffff};
+
+	BindingTable();
+
+	//! Removes all bindings. Call addDevice() for each open device and
+	//! then finish() to compile a new table.
+	void clear();
+	//! Adds the bindings of a device from the first configuration section
+	//! in the list that is not empty. If all are empty or missing,
+	//! the default bindings are used.
+	//! @param isGamepad selects how input names are interpreted and which
+	//! default bindings are used.
+	//! @param device is the slot of the device in the InputSnapshot.
+	void addDevice(QSettings* conf, const QStringList& sections,
+	               bool isGamepad, int device);
+	//! Finishes compilation: indexes the button bindings, chords and
+	//! gestures and allocates the state of "held" actions.
+	void finish();
+	//! Forgets the state of the held actions, chords and gestures, as after
+	//! finish(), e.g. because a device has been closed. The next evaluate()
+	//! reports again the hold actions whose inputs are active.
+	void restart();
+	//! Exchanges the contents of two tables without copying them.
+	//! The gesture times are not exchanged, as they are not compiled.
+	void swap(BindingTable& other);
+	//! Sets how long a button must be held for a long press and how soon
+	//! after a tap it must be pressed again for a double tap, in seconds.
+	void setGestureTimes(double longPress, double doubleTap);
+
+	//! Compares two consecutive states of the devices and triggers the bound
+	//! actions. Hold actions are reported only when they change.
+	//! The first call after finish() also reports the hold actions whose
+	//! inputs are already active in @p previous.
+	//! Gestures are timed by the snapshots' timestamps, in the ticks of
+	//! SDL_GetPerformanceCounter().
+	void evaluate(const InputSnapshot& current,
+	              const InputSnapshot& previous,
+	              ActionTarget& target);
+
+	int count() const
+	{
+		return bindings.count() + chords.count() + gestures.count();
+	}
+	//! True if the action is bound with TriggerHold to any input.
+	bool isHeldAction(int actionId) const {return heldActions.contains(actionId);}
+
+	//! Number of possible action IDs - built-in actions plus StelActions.
+	int getActionCount() const {return BuiltinActionCount + externalActions.count();}
+	//! Returns the name of a StelAction bound to an input, by action ID.
+	//! Empty for built-in actions.
+	QString getActionName(int actionId) const;
+
+private:
+	//! Adds the default bindings for a device.
+	void addDefaults(bool isGamepad, int device);
+	//! Parses a single binding and adds it to the table.
+	//! @returns false if the input or the action is not recognized.
+	bool addBinding(const QString& input, const QString& action,
+	                bool isGamepad, int device);
+	//! Parses the buttons of a chord, named in @p input and joined by "+".
+	bool parseChord(const QString& input, bool isGamepad, Chord& chord);
+	//! Adds a gesture to the record of a button, creating it if needed.
+	bool addGesture(int input, int trigger, int actionId);
+	bool parseInput(const QString& input, bool isGamepad, Binding& binding);
+	int findAction(const QString& name);
+	//! Triggers an action whose input has changed.
+	void dispatch(int trigger, int action, bool active, ActionTarget& target);
+	//! Reports the hold actions whose inputs are active in a state.
+	void resync(const InputSnapshot& state, ActionTarget& target);
+
+	//! Activates the largest chord completed by pressing a button, skipping
+	//! the ones already active.
+	//! @returns true if there was one or the button belongs to an active
+	//! chord, so the button's own bindings are skipped.
+	bool pressChord(int input, const InputSnapshot& state,
+	                ActionTarget& target);
+	//! Deactivates the active chords that include a released button.
+	void releaseChords(int input, ActionTarget& target);
+	//! Stops the gestures of the buttons of an activated chord.
+	void consumeGestures(const Chord& chord, ActionTarget& target);
+	void pressGesture(Gesture& gesture, Uint64 time, ActionTarget& target);
+	void releaseGesture(Gesture& gesture, Uint64 time, ActionTarget& target);
+	//! Triggers the long presses and taps whose time has come.
+	void checkGestureTimes(Uint64 time, ActionTarget& target);
+	//! Sets or clears the bit of a button in #timedButtons.
+	void setTimed(int input, bool timed);
+
+	enum
+	{
+		ButtonWordCount = InputSnapshot::MaxDevices * InputSnapshot::ButtonWords,
+		ButtonInputCount = InputSnapshot::MaxDevices * InputSnapshot::MaxButtons
+	};
+
+	//! Button bindings first, sorted by device and button, then the rest.
+	QVector<Binding> bindings;
+	//! For each word of InputSnapshot::buttons, the bits of the buttons that
+	//! are bound to something.
+	QVector<quint64> buttonMasks;
+	//! For each button of each device, the position of its first binding.
+	//! Its bindings end where those of the next button start.
+	QVector<quint16> buttonFirst;
+	//! Position of the first binding that is not for a button.
+	int otherFirst;
+	//! IDs of StelActions, in order of their action IDs.
+	QStringList externalActions;
+	//! IDs of all actions that are bound as "held", without duplicates.
+	QVector<quint16> heldActions;
+	//! For each action ID, the number of active inputs holding it.
+	//! Preallocated in finish().
+	QVector<quint16> heldCount;
+	//! Set by finish(), so the next evaluate() picks up held inputs.
+	bool needsResync;
+
+	//! Sorted by device and then from the largest.
+	QVector<Chord> chords;
+	//! For each device, the position of its first chord. Its chords end
+	//! where those of the next device start.
+	QVector<quint16> chordFirst;
+	//! For each chord, true while its buttons are held after completing it.
+	QVector<quint8> chordActive;
+	//! For each word of InputSnapshot::buttons, the bits of the buttons
+	//! that are part of a chord.
+	QVector<quint64> chordMasks;
+	//! Buttons with gesture bindings, in no particular order.
+	QVector<Gesture> gestures;
+	//! For each button of each device, the position of its Gesture,
+	//! or NoAction.
+	QVector<quint16> gestureIndex;
+	//! For each word of InputSnapshot::buttons, the bits of the buttons
+	//! with gesture bindings.
+	QVector<quint64> gestureMasks;
+	//! Bits of the buttons whose press completed a chord, so their own
+	//! bindings ignore them until they are released.
+	quint64 suppressedButtons[ButtonWordCount];
+	//! Bits of the buttons with a gesture waiting for its time to pass.
+	quint64 timedButtons[ButtonWordCount];
+	//! Gesture times in performance counter ticks, see setGestureTimes().
+	Uint64 longPressTicks;
+	Uint64 doubleTapTicks;
+};
+
+#endif//BINDING_TABLE_HPP
@@ -0,0 +1,146 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#include "CommandBuffer.hpp"
+
+//! Actions of which only the last one triggered in a frame is performed,
+//! because each repeats or cancels the others. 0 for the rest.
+static int
+exclusiveGroup(int actionId)
+{
+	switch (actionId)
+	{
+	case ActionAutoZoomIn:
+	case ActionAutoZoomOut:
+		return 1;
+	case ActionSetRealTimeSpeed:
+	case ActionSetZeroTimeSpeed:
+		return 2;
+	case ActionSetTimeNow:
+		return 3;
+	case ActionDumpLatencyStats:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+CommandBuffer::CommandBuffer() :
+    touchedCount(0),
+    triggeredCount(0)
+{
+	//
+}
+
+void
+CommandBuffer::setActionCount(int count)
+{
+	heldStates.fill(0, count);
+	touchedCount = triggeredCount = 0;
+}
+
+void
+CommandBuffer::clear(ActionTarget* target)
+{
+	flush(target);
+	for (int action = 0; action < heldStates.count(); action++)
+	{
+		if (target && (heldStates[action] & HeldAsserted))
+			target->performAction(action, false);
+	}
+	heldStates.fill(0);
+}
+
+void
+CommandBuffer::trigger(int actionId)
+{
+	Q_ASSERT(!isFull());
+	triggered[triggeredCount++] = actionId;
+}
+
+void
+CommandBuffer::hold(int actionId, bool active)
+{
+	Q_ASSERT(!isFull());
+	if (actionId < 0 || actionId >= heldStates.count())
+		return;
+	quint8& state = heldStates[actionId];
+	if (!(state & HeldPending))
+	{
+		touched[touchedCount++] = actionId;
+		state |= HeldPending;
+	}
+	if (active)
+		state |= HeldRequested | HeldActivated;
+	else
+		state &= ~HeldRequested;
+}
+
+int
+CommandBuffer::flush(ActionTarget* target)
+{
+	int calls = 0;
+	for (int i = 0; i < touchedCount; i++)
+	{
+		const int action = touched[i];
+		quint8& state = heldStates[action];
+		const bool asserted = (state & HeldAsserted);
+		const bool requested = (state & HeldRequested);
+		if (target && requested != asserted)
+		{
+			target->performAction(action, requested);
+			calls++;
+		}
+		else if (target && !asserted && (state & HeldActivated))
+		{
+			target->performAction(action, true);
+			target->performAction(action, false);
+			calls += 2;
+		}
+		state = requested ? (HeldAsserted | HeldRequested) : 0;
+	}
+	touchedCount = 0;
+
+	int toggles = 0;
+	for (int i = 0; i < triggeredCount; i++)
+	{
+		if (triggered[i] == ActionToggleMountMode)
+			toggles++;
+	}
+	// Performed once, in place of the last one, unless they cancel out.
+	const bool toggleMountMode = (toggles % 2 != 0);
+	for (int i = 0; i < triggeredCount && target; i++)
+	{
+		const int action = triggered[i];
+		if (action == ActionToggleMountMode
+		    && (--toggles > 0 || !toggleMountMode))
+			continue;
+		bool superseded = false;
+		const int group = exclusiveGroup(action);
+		for (int j = i + 1; group != 0 && j < triggeredCount; j++)
+			superseded |= (exclusiveGroup(triggered[j]) == group);
+		if (superseded)
+			continue;
+		target->performAction(action, true);
+		calls++;
+	}
+	triggeredCount = 0;
+	return calls;
+}
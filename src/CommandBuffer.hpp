@@ -0,0 +1,100 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#ifndef COMMAND_BUFFER_HPP
+#define COMMAND_BUFFER_HPP
+
+#include "BindingTable.hpp"
+
+#include <QVector>
+
+//! Collects the actions triggered while the samples of a frame are processed
+//! and performs them at once at the end of the frame, resolved by fixed rules
+//! that don't depend on the order of the bindings or of the devices:
+//!  - A held action gets only its final state, and only if it differs from
+//!    the state last performed. If it's activated and released within
+//!    a frame, it's still performed as activated and then released, so
+//!    a short press isn't lost.
+//!  - One-time actions are performed after the held ones, in the order they
+//!    were triggered, except that only the last one of a group of actions
+//!    that repeat or cancel each other is performed (auto_zoom_in and
+//!    auto_zoom_out; set_real_time_speed and set_zero_time_speed;
+//!    set_time_now; dump_latency_stats), and toggle_mount_mode triggered
+//!    an even number of times is not performed at all.
+//!
+//! The movement actions don't get here: InputProcessor combines them with
+//! the axes in its InputIntegrator.
+//! The buffer has a fixed capacity, so filling it doesn't allocate memory.
+class CommandBuffer
+{
+public:
+	enum { Capacity = 128 };
+
+	CommandBuffer();
+
+	//! Sets the number of action IDs, after the bindings are compiled.
+	void setActionCount(int count);
+	//! Performs the pending commands and releases the held actions that are
+	//! active, e.g. before the bindings are compiled again.
+	//! @param target may be NULL to forget them instead.
+	void clear(ActionTarget* target);
+
+	//! True if there is no room for another command.
+	bool isFull() const
+	{
+		return triggeredCount == Capacity || touchedCount == Capacity;
+	}
+	//! Queues a one-time action. The buffer must not be full.
+	void trigger(int actionId);
+	//! Queues a change of the state of a held action. The buffer must not
+	//! be full.
+	void hold(int actionId, bool active);
+
+	//! Performs the resolved commands and empties the buffer.
+	//! @param target may be NULL to forget them instead.
+	//! @returns the number of calls to @p target.
+	int flush(ActionTarget* target);
+
+private:
+	//! Bits of #heldStates.
+	enum HeldState
+	{
+		//! The state last performed.
+		HeldAsserted = 1,
+		//! The state requested by the latest command.
+		HeldRequested = 2,
+		//! Activated since the last flush().
+		HeldActivated = 4,
+		//! In #touched.
+		HeldPending = 8
+	};
+
+	//! For each action ID, a combination of HeldState bits.
+	QVector<quint8> heldStates;
+	//! Held actions changed since the last flush(), in order of their first
+	//! change.
+	quint16 touched[Capacity];
+	int touchedCount;
+	//! One-time actions in the order they were triggered.
+	quint16 triggered[Capacity];
+	int triggeredCount;
+};
+
+#endif//COMMAND_BUFFER_HPP
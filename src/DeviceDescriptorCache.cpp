@@ -0,0 +1,175 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "DeviceDescriptorCache.hpp"
+#include "DeviceManager.hpp"
+
+#include <QDebug>
+#include <QMutexLocker>
+
+DeviceDescriptorCache::DeviceDescriptorCache() :
+    stopRequested(0),
+    openedCount(0)
+{
+	//
+}
+
+DeviceDescriptorCache::~DeviceDescriptorCache()
+{
+	stop();
+}
+
+void
+DeviceDescriptorCache::request(SDL_JoystickID instanceId)
+{
+	QMutexLocker locker(&mutex);
+	if (pendingIds.contains(instanceId))
+		return;
+	pendingIds.append(instanceId);
+	requests.append(instanceId);
+	wakeUp.release();
+}
+
+bool
+DeviceDescriptorCache::hasOpened() const
+{
+	return const_cast<QAtomicInt&>(openedCount).fetchAndAddRelaxed(0) > 0;
+}
+
+bool
+DeviceDescriptorCache::takeOpened(DeviceState& device)
+{
+	if (!hasOpened())
+		return false;
+	QMutexLocker locker(&mutex);
+	if (opened.isEmpty())
+		return false;
+	device = opened.first();
+	opened.remove(0);
+	openedCount.fetchAndStoreRelaxed(opened.count());
+	pendingIds.remove(pendingIds.indexOf(device.instanceId));
+	return true;
+}
+
+void
+DeviceDescriptorCache::stop()
+{
+	if (isRunning())
+	{
+		stopRequested.fetchAndStoreOrdered(1);
+		wakeUp.release();
+		wait();
+		stopRequested.fetchAndStoreOrdered(0);
+	}
+	QMutexLocker locker(&mutex);
+	for (int i = 0; i < opened.count(); i++)
+		opened[i].close();
+	opened.clear();
+	openedCount.fetchAndStoreRelaxed(0);
+	requests.clear();
+	pendingIds.clear();
+}
+
+void
+DeviceDescriptorCache::run()
+{
+	while (stopRequested.fetchAndAddRelaxed(0) == 0)
+	{
+		wakeUp.acquire();
+		mutex.lock();
+		if (requests.isEmpty())
+		{
+			mutex.unlock();
+			continue;
+		}
+		SDL_JoystickID instanceId = requests.first();
+		requests.remove(0);
+		mutex.unlock();
+
+		// Opening may take a while, so nothing is locked in the meantime.
+		DeviceState device;
+		bool isOpen = openDevice(instanceId, device);
+
+		QMutexLocker locker(&mutex);
+		if (isOpen)
+		{
+			opened.append(device);
+			openedCount.fetchAndStoreRelease(opened.count());
+		}
+		else
+			pendingIds.remove(pendingIds.indexOf(instanceId));
+	}
+}
+
+bool
+DeviceDescriptorCache::openDevice(SDL_JoystickID instanceId,
+                                  DeviceState& device)
+{
+	// The indices change when other devices are connected or disconnected,
+	// so the device opened may turn out to be another one. Then the requested
+	// one is looked up again.
+	for (int attempt = 0; attempt < 3; attempt++)
+	{
+		int deviceIndex = DeviceManager::findDeviceIndex(instanceId);
+		// Disconnected since the request.
+		if (deviceIndex < 0)
+			return false;
+
+		SDL_JoystickGUID guid = SDL_JoystickGetDeviceGUID(deviceIndex);
+		QByteArray key(reinterpret_cast<const char*>(guid.data),
+		               sizeof(guid.data));
+		bool isKnown = descriptors.contains(key);
+		DeviceCapabilities knownCaps;
+		if (isKnown)
+			knownCaps = descriptors.value(key);
+		if (!device.open(deviceIndex, isKnown ? &knownCaps : NULL))
+		{
+			qWarning() << "JoystickSupport: unable to open device"
+			           << QString(SDL_JoystickNameForIndex(deviceIndex))
+			           << SDL_GetError();
+			return false;
+		}
+		if (device.instanceId != instanceId)
+		{
+			device.close();
+			continue;
+		}
+
+		if (!isKnown || knownCaps.isGamepad != device.caps.isGamepad)
+		{
+			descriptors.insert(key, device.caps);
+			printDescriptor(device.caps);
+		}
+		return true;
+	}
+	return false;
+}
+
+void
+DeviceDescriptorCache::printDescriptor(const DeviceCapabilities& caps)
+{
+	qDebug() << "JoystickSupport:" << caps.name
+	         << (caps.isGamepad ? "is a game controller." : "is a joystick.");
+	qDebug() << "It has"
+	         << caps.axisCount << "axes,"
+	         << caps.ballCount << "balls,"
+	         << caps.buttonCount << "buttons,"
+	         << caps.hatCount << "hats.";
+	if (caps.isGamepad)
+		qDebug() << "Mapping:" << caps.mapping;
+}
@@ -0,0 +1,94 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef DEVICE_DESCRIPTOR_CACHE_HPP
+#define DEVICE_DESCRIPTOR_CACHE_HPP
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QSemaphore>
+#include <QThread>
+#include <QVector>
+
+#include "DeviceState.hpp"
+
+//! Background thread opening newly connected devices, so that slow devices
+//! (e.g. behind USB hubs) don't hold up a frame.
+//!
+//! The capabilities of each model (name, GUID, counts and mapping) are
+//! queried and written to the log once, then kept by GUID and reused for
+//! every other device of the same model. The opened devices are handed
+//! over as DeviceStates, to be added to the DeviceSet as they are, without
+//! opening them a second time.
+//!
+//! SDL serializes its joystick functions internally, so the thread may
+//! open a device while another thread reads or updates the others.
+class DeviceDescriptorCache : public QThread
+{
+public:
+	DeviceDescriptorCache();
+	~DeviceDescriptorCache();
+
+	//! Asks for a connected device to be opened. Does nothing if it's
+	//! already being opened or waiting to be taken.
+	void request(SDL_JoystickID instanceId);
+	//! True if there are opened devices to take. Cheap enough to be
+	//! checked every frame.
+	bool hasOpened() const;
+	//! Retrieves an opened device, if any. The caller must close it or pass
+	//! it to a DeviceSet.
+	//! @returns false if no device is waiting to be taken.
+	bool takeOpened(DeviceState& device);
+
+	//! Asks the thread to exit and waits until it does. Closes the devices
+	//! that haven't been taken and discards the pending requests, but keeps
+	//! the descriptors.
+	void stop();
+
+protected:
+	virtual void run();
+
+private:
+	//! Opens a device, using or adding its descriptor.
+	//! @returns false if the device has been disconnected or can't be opened.
+	bool openDevice(SDL_JoystickID instanceId, DeviceState& device);
+	//! Writes the descriptor of a newly seen model to the log.
+	static void printDescriptor(const DeviceCapabilities& caps);
+
+	QAtomicInt stopRequested;
+	//! Released by request() and stop() to wake up the thread.
+	QSemaphore wakeUp;
+	//! Guards #requests, #opened and #pendingIds.
+	QMutex mutex;
+	//! Devices waiting to be opened, in order of request.
+	QVector<SDL_JoystickID> requests;
+	//! Devices opened and waiting to be taken.
+	QVector<DeviceState> opened;
+	//! Instance IDs of all devices in #requests, being opened or in #opened.
+	QVector<SDL_JoystickID> pendingIds;
+	//! Size of #opened, read without locking by hasOpened().
+	QAtomicInt openedCount;
+	//! Capabilities of the models opened so far, by GUID. Used only by
+	//! the thread.
+	QHash<QByteArray, DeviceCapabilities> descriptors;
+};
+
+#endif//DEVICE_DESCRIPTOR_CACHE_HPP
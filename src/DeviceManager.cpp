@@ -0,0 +1,141 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "DeviceManager.hpp"
+#include "GamepadDatabase.hpp"
+
+#include <QDebug>
+
+DeviceManager::DeviceManager(QObject* parent) :
+    QObject(parent),
+    gamepadDatabase(NULL),
+    fallbackDatabase(NULL)
+{
+	//
+}
+
+void
+DeviceManager::setGamepadDatabases(const GamepadDatabase* database,
+                                   const GamepadDatabase* fallback)
+{
+	gamepadDatabase = database;
+	fallbackDatabase = fallback;
+}
+
+void
+DeviceManager::init()
+{
+	// Disabling an event type also discards any queued events of that type,
+	// e.g. the ones generated for the devices found by SDL_Init().
+	SDL_JoystickEventState(SDL_IGNORE);
+	SDL_GameControllerEventState(SDL_IGNORE);
+	SDL_EventState(SDL_JOYDEVICEADDED, SDL_ENABLE);
+	SDL_EventState(SDL_JOYDEVICEREMOVED, SDL_ENABLE);
+
+	devices.clear();
+	int deviceCount = SDL_NumJoysticks();
+	if (deviceCount < 0)
+	{
+		qWarning() << "JoystickSupport: error finding number of devices:"
+		           << SDL_GetError();
+		return;
+	}
+	for (int i = 0; i < deviceCount; i++)
+		addDevice(i);
+}
+
+bool
+DeviceManager::processEvents()
+{
+	const int bufferSize = 8;
+	SDL_Event events[bufferSize];
+	int count;
+	bool changed = false;
+	do
+	{
+		count = SDL_PeepEvents(events, bufferSize, SDL_GETEVENT,
+		                       SDL_JOYDEVICEADDED, SDL_JOYDEVICEREMOVED);
+		if (count > 0)
+			changed = true;
+		for (int i = 0; i < count; i++)
+		{
+			// For "added" events, "which" is the device index,
+			// for "removed" events, it's the instance ID.
+			if (events[i].type == SDL_JOYDEVICEADDED)
+				addDevice(events[i].jdevice.which);
+			else
+				removeDevice(events[i].jdevice.which);
+		}
+	}
+	while (count == bufferSize);
+	return changed;
+}
+
+int
+DeviceManager::findDeviceIndex(SDL_JoystickID instanceId)
+{
+	int deviceCount = SDL_NumJoysticks();
+	for (int i = 0; i < deviceCount; i++)
+	{
+		if (SDL_JoystickGetDeviceInstanceID(i) == instanceId)
+			return i;
+	}
+	return -1;
+}
+
+void
+DeviceManager::addDevice(int deviceIndex)
+{
+	DeviceInfo info;
+	info.instanceId = SDL_JoystickGetDeviceInstanceID(deviceIndex);
+	if (info.instanceId < 0)
+		return;
+	for (int i = 0; i < devices.count(); i++)
+	{
+		if (devices[i].instanceId == info.instanceId)
+			return;
+	}
+	info.guid = SDL_JoystickGetDeviceGUID(deviceIndex);
+	// SDL needs the mapping to recognize the device as a game controller.
+	if (!(gamepadDatabase && gamepadDatabase->addMappingFor(info.guid))
+	    && fallbackDatabase)
+		fallbackDatabase->addMappingFor(info.guid);
+	info.name = QString(SDL_JoystickNameForIndex(deviceIndex));
+	info.isGamepad = (SDL_IsGameController(deviceIndex) == SDL_TRUE);
+	devices.append(info);
+
+	qDebug() << "JoystickSupport: device connected:" << info.name;
+	emit deviceAttached(info.instanceId, info.name);
+}
+
+void
+DeviceManager::removeDevice(SDL_JoystickID instanceId)
+{
+	for (int i = 0; i < devices.count(); i++)
+	{
+		if (devices[i].instanceId == instanceId)
+		{
+			qDebug() << "JoystickSupport: device disconnected:"
+			         << devices[i].name;
+			devices.remove(i);
+			emit deviceDetached(instanceId);
+			return;
+		}
+	}
+}
@@ -0,0 +1,102 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef DEVICE_MANAGER_HPP
+#define DEVICE_MANAGER_HPP
+
+#ifndef SDL_MAIN_HANDLED
+#define SDL_MAIN_HANDLED
+#endif
+#include "SDL.h"
+
+#include <QObject>
+#include <QString>
+#include <QVector>
+
+class GamepadDatabase;
+
+//! What is known about a connected device without opening it.
+struct DeviceInfo
+{
+	//! SDL's instance ID. Unlike the device index, it doesn't change
+	//! while the device remains connected.
+	SDL_JoystickID instanceId;
+	SDL_JoystickGUID guid;
+	QString name;
+	bool isGamepad;
+};
+
+//! Keeps track of connected devices using SDL's device events.
+//!
+//! All other SDL joystick and game controller events remain disabled,
+//! so the event queue doesn't fill up with axis motion. The device table is
+//! built once in init() and after that is changed only by device events,
+//! so checking for changes costs the same regardless of how many devices
+//! are connected.
+//! @note SDL detects hot-plugged devices in SDL_JoystickUpdate(), which must
+//! be called regularly (by the plug-in or by the background sampler).
+class DeviceManager : public QObject
+{
+	Q_OBJECT
+
+public:
+	DeviceManager(QObject* parent = 0);
+
+	//! Enables the device events and lists the already connected devices.
+	//! Requires SDL's joystick subsystem to be initialized.
+	void init();
+
+	//! Sets the databases used to look up the mappings of connected devices.
+	//! A mapping in @p database takes precedence over one in @p fallback.
+	//! Must be called before init() to affect the devices connected at start.
+	void setGamepadDatabases(const GamepadDatabase* database,
+	                         const GamepadDatabase* fallback);
+
+	//! Applies any pending device events to the device table.
+	//! Emits deviceAttached() and deviceDetached() accordingly.
+	//! @returns true if the table has changed.
+	bool processEvents();
+
+	//! Number of connected devices.
+	int count() const {return devices.count();}
+	//! Information about a connected device, in order of connection.
+	const DeviceInfo& device(int i) const {return devices[i];}
+
+	//! Finds the current SDL device index of a connected device.
+	//! The index is needed to open the device and may change when other
+	//! devices are connected or disconnected.
+	//! @returns -1 if there is no such device.
+	static int findDeviceIndex(SDL_JoystickID instanceId);
+
+signals:
+	void deviceAttached(int instanceId, const QString& name);
+	void deviceDetached(int instanceId);
+
+private:
+	//! Adds a device to the table, unless it's already there.
+	void addDevice(int deviceIndex);
+	void removeDevice(SDL_JoystickID instanceId);
+
+	QVector<DeviceInfo> devices;
+	const GamepadDatabase* gamepadDatabase;
+	//! The database embedded in the plug-in.
+	const GamepadDatabase* fallbackDatabase;
+};
+
+#endif//DEVICE_MANAGER_HPP
@@ -0,0 +1,140 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "DeviceSet.hpp"
+
+#include <cstring>
+
+DeviceSet::DeviceSet() :
+    openCount(0)
+{
+	memset(&current, 0, sizeof(current));
+	memset(&previous, 0, sizeof(previous));
+}
+
+int
+DeviceSet::open(int deviceIndex)
+{
+	int slot = findFreeSlot();
+	if (slot < 0 || !devices[slot].open(deviceIndex))
+		return -1;
+	addSlot(slot);
+	return slot;
+}
+
+int
+DeviceSet::add(const DeviceState& device)
+{
+	int slot = findFreeSlot();
+	if (slot < 0)
+		return -1;
+	devices[slot] = device;
+	addSlot(slot);
+	return slot;
+}
+
+int
+DeviceSet::openReplayed(const DeviceCapabilities& caps,
+                        SDL_JoystickID instanceId)
+{
+	int slot = findFreeSlot();
+	if (slot < 0)
+		return -1;
+	devices[slot].openReplayed(caps, instanceId);
+	addSlot(slot);
+	return slot;
+}
+
+void
+DeviceSet::close(int slot)
+{
+	if (slot < 0 || slot >= MaxDevices || !devices[slot].isOpen())
+		return;
+
+	devices[slot].close();
+	current.clearDevice(slot);
+	previous.clearDevice(slot);
+	for (int i = 0; i < openCount; i++)
+	{
+		if (openSlots[i] == slot)
+		{
+			// Keeps the order of the remaining devices.
+			memmove(openSlots + i, openSlots + i + 1,
+			        (openCount - i - 1) * sizeof(openSlots[0]));
+			openCount--;
+			break;
+		}
+	}
+}
+
+float
+DeviceSet::enableMotionSensors()
+{
+	float rate = -1.f;
+	for (int i = 0; i < openCount; i++)
+		rate = qMax(rate, devices[openSlots[i]].enableMotionSensors());
+	return rate;
+}
+
+void
+DeviceSet::closeAll()
+{
+	while (openCount > 0)
+		close(openSlots[openCount - 1]);
+}
+
+int
+DeviceSet::findSlot(SDL_JoystickID instanceId) const
+{
+	for (int i = 0; i < openCount; i++)
+	{
+		if (devices[openSlots[i]].instanceId == instanceId)
+			return openSlots[i];
+	}
+	return -1;
+}
+
+void
+DeviceSet::read(InputSnapshot& snapshot) const
+{
+	memset(&snapshot, 0, sizeof(snapshot));
+	snapshot.timestamp = SDL_GetPerformanceCounter();
+	for (int i = 0; i < openCount; i++)
+		devices[openSlots[i]].read(snapshot, openSlots[i]);
+}
+
+int
+DeviceSet::findFreeSlot() const
+{
+	for (int i = 0; i < MaxDevices; i++)
+	{
+		if (!devices[i].isOpen())
+			return i;
+	}
+	return -1;
+}
+
+void
+DeviceSet::addSlot(int slot)
+{
+	// Nothing is pressed before the first update.
+	current.clearDevice(slot);
+	previous.clearDevice(slot);
+	openSlots[openCount++] = slot;
+}
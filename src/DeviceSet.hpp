@@ -0,0 +1,89 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef DEVICE_SET_HPP
+#define DEVICE_SET_HPP
+
+#include "DeviceState.hpp"
+
+//! All open devices, each assigned a slot in the shared InputSnapshot.
+//!
+//! The open slots are also kept in a compact list in the order in which
+//! the devices were opened, so reading and processing the input costs
+//! the same regardless of which slots are used. This order is also
+//! the priority order when the input of several devices is combined.
+class DeviceSet
+{
+public:
+	enum { MaxDevices = InputSnapshot::MaxDevices };
+
+	DeviceSet();
+
+	//! Opens a device in the first free slot.
+	//! @param deviceIndex is the logical device index as used in SDL.
+	//! @returns the slot, or -1 if the device can't be opened or there
+	//! are no free slots.
+	int open(int deviceIndex);
+	//! Adds a device opened elsewhere, e.g. by a DeviceDescriptorCache,
+	//! in the first free slot. The set takes over closing it.
+	//! @returns the slot, or -1 if there are no free slots.
+	int add(const DeviceState& device);
+	//! Opens a device without an SDL device behind it, e.g. when replaying
+	//! a trace, in the first free slot.
+	//! @returns the slot, or -1 if there are no free slots.
+	int openReplayed(const DeviceCapabilities& caps, SDL_JoystickID instanceId);
+	//! Turns on the motion sensors of the open devices that have them.
+	//! @returns the highest rate of their readings in Hz (0 if unknown),
+	//! or -1 if no device has them.
+	float enableMotionSensors();
+	//! Closes the device in a slot and clears its state.
+	void close(int slot);
+	void closeAll();
+
+	//! Number of open devices.
+	int count() const {return openCount;}
+	bool isEmpty() const {return openCount == 0;}
+	//! Slot of the i-th open device, in the order of opening.
+	int slot(int i) const {return openSlots[i];}
+	const DeviceState& device(int slot) const {return devices[slot];}
+	//! Finds the slot of an open device.
+	//! @returns -1 if the device is not open.
+	int findSlot(SDL_JoystickID instanceId) const;
+
+	//! Reads the current state of all open devices into a snapshot.
+	//! Does not call SDL_JoystickUpdate().
+	void read(InputSnapshot& snapshot) const;
+
+	//! Latest state of the devices.
+	InputSnapshot current;
+	//! State of the devices before #current.
+	InputSnapshot previous;
+
+private:
+	//! @returns -1 if all slots are used.
+	int findFreeSlot() const;
+	//! Clears the state of a newly opened device and adds it to the list.
+	void addSlot(int slot);
+
+	DeviceState devices[MaxDevices];
+	int openSlots[MaxDevices];
+	int openCount;
+};
+
+#endif//DEVICE_SET_HPP
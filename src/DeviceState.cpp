@@ -0,0 +1,230 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "DeviceState.hpp"
+
+#include <QDebug>
+
+#include <cstring>
+
+void
+InputSnapshot::clearDevice(int device)
+{
+	memset(axes + device * MaxAxes, 0, MaxAxes * sizeof(axes[0]));
+	memset(buttons + device * ButtonWords, 0, ButtonWords * sizeof(buttons[0]));
+	memset(hats + device * MaxHats, 0, MaxHats * sizeof(hats[0]));
+	memset(balls + device * MaxBalls * 2, 0, MaxBalls * 2 * sizeof(balls[0]));
+	motion[device * 2] = motion[device * 2 + 1] = 0.f;
+}
+
+
+DeviceState::DeviceState() :
+    joystick(NULL),
+    gamepad(NULL),
+    instanceId(-1),
+    replayed(false),
+    hasMotionSensors(false)
+{
+	memset(&caps.guid, 0, sizeof(caps.guid));
+	caps.axisCount = caps.buttonCount = caps.hatCount = caps.ballCount = 0;
+	caps.isGamepad = false;
+}
+
+bool
+DeviceState::open(int deviceIndex, const DeviceCapabilities* knownCaps)
+{
+	close();
+
+	if (SDL_IsGameController(deviceIndex))
+	{
+		gamepad = SDL_GameControllerOpen(deviceIndex);
+		joystick = SDL_GameControllerGetJoystick(gamepad);
+		if (joystick == NULL)
+		{
+			SDL_GameControllerClose(gamepad);
+			gamepad = NULL;
+		}
+	}
+	else
+		joystick = SDL_JoystickOpen(deviceIndex);
+
+	if (joystick == NULL)
+		return false;
+
+	instanceId = SDL_JoystickInstanceID(joystick);
+	if (knownCaps && knownCaps->isGamepad == (gamepad != NULL))
+	{
+		caps = *knownCaps;
+		return true;
+	}
+
+	caps.guid = SDL_JoystickGetGUID(joystick);
+	caps.name = QString(SDL_JoystickName(joystick));
+	caps.ballCount = SDL_JoystickNumBalls(joystick);
+	caps.isGamepad = (gamepad != NULL);
+	caps.mapping.clear();
+	if (gamepad)
+	{
+		caps.axisCount = SDL_CONTROLLER_AXIS_MAX;
+		caps.buttonCount = SDL_CONTROLLER_BUTTON_MAX;
+		caps.hatCount = 0;
+		char* mapping = SDL_GameControllerMapping(gamepad);
+		if (mapping)
+		{
+			caps.mapping = QByteArray(mapping);
+			SDL_free(mapping);
+		}
+	}
+	else
+	{
+		caps.axisCount = SDL_JoystickNumAxes(joystick);
+		caps.buttonCount = SDL_JoystickNumButtons(joystick);
+		caps.hatCount = SDL_JoystickNumHats(joystick);
+	}
+	if (caps.axisCount > InputSnapshot::MaxAxes
+	    || caps.buttonCount > InputSnapshot::MaxButtons
+	    || caps.hatCount > InputSnapshot::MaxHats
+	    || caps.ballCount > InputSnapshot::MaxBalls)
+		qWarning() << "JoystickSupport: some of the controls of" << caps.name
+		           << "are not supported.";
+	caps.axisCount = qBound(0, caps.axisCount, int(InputSnapshot::MaxAxes));
+	caps.buttonCount = qBound(0, caps.buttonCount,
+	                          int(InputSnapshot::MaxButtons));
+	caps.hatCount = qBound(0, caps.hatCount, int(InputSnapshot::MaxHats));
+	caps.ballCount = qBound(0, caps.ballCount, int(InputSnapshot::MaxBalls));
+	return true;
+}
+
+void
+DeviceState::openReplayed(const DeviceCapabilities& caps,
+                          SDL_JoystickID instanceId)
+{
+	close();
+	this->caps = caps;
+	this->instanceId = instanceId;
+	replayed = true;
+}
+
+void
+DeviceState::close()
+{
+	if (gamepad)
+		SDL_GameControllerClose(gamepad);
+	else if (joystick)
+		SDL_JoystickClose(joystick);
+
+	gamepad = NULL;
+	joystick = NULL;
+	instanceId = -1;
+	replayed = false;
+	hasMotionSensors = false;
+}
+
+float
+DeviceState::enableMotionSensors()
+{
+	hasMotionSensors = false;
+#if SDL_VERSION_ATLEAST(2, 0, 14)
+	if (gamepad == NULL
+	    || !SDL_GameControllerHasSensor(gamepad, SDL_SENSOR_GYRO)
+	    || !SDL_GameControllerHasSensor(gamepad, SDL_SENSOR_ACCEL))
+		return -1.f;
+	if (SDL_GameControllerSetSensorEnabled(gamepad, SDL_SENSOR_GYRO,
+	                                       SDL_TRUE) != 0
+	    || SDL_GameControllerSetSensorEnabled(gamepad, SDL_SENSOR_ACCEL,
+	                                          SDL_TRUE) != 0)
+	{
+		qWarning() << "JoystickSupport: unable to enable the motion sensors of"
+		           << caps.name << SDL_GetError();
+		return -1.f;
+	}
+	hasMotionSensors = true;
+#if SDL_VERSION_ATLEAST(2, 0, 16)
+	return SDL_GameControllerGetSensorDataRate(gamepad, SDL_SENSOR_GYRO);
+#else
+	return 0.f;
+#endif
+#else
+	return -1.f;
+#endif
+}
+
+bool
+DeviceState::readMotionSensors(float gyro[3], float accel[3]) const
+{
+#if SDL_VERSION_ATLEAST(2, 0, 14)
+	return hasMotionSensors
+	       && SDL_GameControllerGetSensorData(gamepad, SDL_SENSOR_GYRO,
+	                                          gyro, 3) == 0
+	       && SDL_GameControllerGetSensorData(gamepad, SDL_SENSOR_ACCEL,
+	                                          accel, 3) == 0;
+#else
+	Q_UNUSED(gyro);
+	Q_UNUSED(accel);
+	return false;
+#endif
+}
+
+void
+DeviceState::read(InputSnapshot& snapshot, int slot) const
+{
+	Sint16* axes = snapshot.axes + slot * InputSnapshot::MaxAxes;
+	quint64* buttons = snapshot.buttons + slot * InputSnapshot::ButtonWords;
+	Uint8* hats = snapshot.hats + slot * InputSnapshot::MaxHats;
+	int* balls = snapshot.balls + slot * InputSnapshot::MaxBalls * 2;
+	if (replayed)
+		return;
+
+	// SDL accumulates the motion of a trackball until it's read, so no
+	// motion is lost between snapshots, however far apart they are.
+	for (int i = 0; i < caps.ballCount; i++)
+		SDL_JoystickGetBall(joystick, i, balls + i * 2, balls + i * 2 + 1);
+
+	// SDL has no way of reading all buttons at once, but at least they are
+	// packed into words without branching.
+	if (gamepad)
+	{
+		for (int i = 0; i < caps.axisCount; i++)
+		{
+			SDL_GameControllerAxis axis = static_cast<SDL_GameControllerAxis>(i);
+			axes[i] = SDL_GameControllerGetAxis(gamepad, axis);
+		}
+		quint64 bits = 0;
+		for (int i = 0; i < caps.buttonCount; i++)
+		{
+			SDL_GameControllerButton button = static_cast<SDL_GameControllerButton>(i);
+			bits |= quint64(SDL_GameControllerGetButton(gamepad, button) != 0) << i;
+		}
+		buttons[0] = bits;
+		return;
+	}
+
+	for (int i = 0; i < caps.axisCount; i++)
+		axes[i] = SDL_JoystickGetAxis(joystick, i);
+	for (int w = 0; w * 64 < caps.buttonCount; w++)
+	{
+		int count = qMin(64, caps.buttonCount - w * 64);
+		quint64 bits = 0;
+		for (int i = 0; i < count; i++)
+			bits |= quint64(SDL_JoystickGetButton(joystick, w * 64 + i) != 0) << i;
+		buttons[w] = bits;
+	}
+	for (int i = 0; i < caps.hatCount; i++)
+		hats[i] = SDL_JoystickGetHat(joystick, i);
+}
@@ -0,0 +1,161 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef DEVICE_STATE_HPP
+#define DEVICE_STATE_HPP
+
+#ifndef SDL_MAIN_HANDLED
+#define SDL_MAIN_HANDLED
+#endif
+#include "SDL.h"
+
+#include <QByteArray>
+#include <QString>
+#include <QtGlobal>
+
+//! State of all controls of all open devices at a given moment.
+//!
+//! The state is kept as a structure of arrays: the axes of all devices are
+//! contiguous, as are the button bits and the hats, each device using
+//! a fixed-size block indexed by its slot in DeviceSet. Processing the input
+//! of several devices therefore walks a few small arrays instead of jumping
+//! between per-device structures.
+//! For a game controller, the axes and buttons are indexed by
+//! SDL_GameControllerAxis and SDL_GameControllerButton and there are no hats.
+//! Controls beyond the fixed limits are ignored.
+struct InputSnapshot
+{
+	enum Limits
+	{
+		MaxDevices = 8,
+		MaxAxes = 16,
+		MaxButtons = 128,
+		//! 64-bit words of button bits per device.
+		ButtonWords = MaxButtons / 64,
+		MaxHats = 4,
+		MaxBalls = 2
+	};
+
+	Sint16 axis(int device, int i) const
+	{
+		return axes[device * MaxAxes + i];
+	}
+	bool button(int device, int i) const
+	{
+		return (buttons[device * ButtonWords + (i >> 6)] >> (i & 63)) & 1;
+	}
+	void setButton(int device, int i)
+	{
+		buttons[device * ButtonWords + (i >> 6)] |= Q_UINT64_C(1) << (i & 63);
+	}
+	Uint8 hat(int device, int i) const
+	{
+		return hats[device * MaxHats + i];
+	}
+	int ballX(int device, int i) const
+	{
+		return balls[(device * MaxBalls + i) * 2];
+	}
+	int ballY(int device, int i) const
+	{
+		return balls[(device * MaxBalls + i) * 2 + 1];
+	}
+	float motionRight(int device) const {return motion[device * 2];}
+	float motionUp(int device) const {return motion[device * 2 + 1];}
+	//! Sets all controls of a device to their rest state.
+	void clearDevice(int device);
+
+	//! Value of SDL_GetPerformanceCounter() when the state was read.
+	Uint64 timestamp;
+	Sint16 axes[MaxDevices * MaxAxes];
+	//! One bit per button, the first button in the lowest bit.
+	quint64 buttons[MaxDevices * ButtonWords];
+	Uint8 hats[MaxDevices * MaxHats];
+	//! Motion of each trackball since the previous snapshot, x and y.
+	int balls[MaxDevices * MaxBalls * 2];
+	//! Rotation of each device since the previous snapshot, as measured by
+	//! its motion sensors (see SensorFusion), in radians, right and up.
+	float motion[MaxDevices * 2];
+};
+
+//! What an open device has, queried once when it's opened.
+//! The counts are limited to what fits in an InputSnapshot.
+struct DeviceCapabilities
+{
+	int axisCount;
+	int buttonCount;
+	int hatCount;
+	int ballCount;
+	//! True if the device is used as a game controller.
+	bool isGamepad;
+	SDL_JoystickGUID guid;
+	QString name;
+	//! SDL's mapping string for game controllers, empty for joysticks.
+	QByteArray mapping;
+};
+
+//! Everything the plug-in needs to know about an open device, except its
+//! state, which is kept in an InputSnapshot shared by all devices.
+struct DeviceState
+{
+	DeviceState();
+
+	//! Opens a device and queries its capabilities.
+	//! @param deviceIndex is the logical device index as used in SDL.
+	//! @param knownCaps are the capabilities of the same model (GUID),
+	//! queried before, or NULL. They are used instead of querying them again
+	//! if the device is opened in the same way (as a game controller or not).
+	//! @returns false if the device can't be opened.
+	bool open(int deviceIndex, const DeviceCapabilities* knownCaps = NULL);
+	//! Marks the device as open without an SDL device behind it, e.g. when
+	//! replaying a trace. read() leaves its state untouched.
+	void openReplayed(const DeviceCapabilities& caps, SDL_JoystickID instanceId);
+	//! Closes the device, if open.
+	void close();
+	bool isOpen() const {return joystick != NULL || replayed;}
+	//! Turns on the gyroscope and accelerometer of a game controller,
+	//! if it has both. They are off by default, as they drain the battery.
+	//! @returns the rate of their readings in Hz (0 if unknown), or -1 if
+	//! the device has no motion sensors.
+	float enableMotionSensors();
+	//! Reads the sensors turned on by enableMotionSensors().
+	//! Does not call SDL_JoystickUpdate().
+	//! @returns false if they are not on.
+	bool readMotionSensors(float gyro[3], float accel[3]) const;
+
+	//! Reads the current state of the device into its block of a snapshot.
+	//! The block is expected to be cleared. Does not call SDL_JoystickUpdate().
+	//! @param slot is the index of the device's block.
+	void read(InputSnapshot& snapshot, int slot) const;
+
+	//! The device, null if none is opened.
+	SDL_Joystick* joystick;
+	//! Null if the device is not a game controller. A value implies that
+	//! #joystick is not null and contains the underlying joystick device.
+	SDL_GameController* gamepad;
+	//! SDL's instance ID, -1 if none is opened.
+	SDL_JoystickID instanceId;
+	//! True if opened by openReplayed().
+	bool replayed;
+	//! True if enableMotionSensors() has turned them on.
+	bool hasMotionSensors;
+	DeviceCapabilities caps;
+};
+
+#endif//DEVICE_STATE_HPP
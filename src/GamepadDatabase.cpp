@@ -0,0 +1,363 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "GamepadDatabase.hpp"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QFileInfo>
+#include <QResource>
+#include <QVector>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+// The index file consists of an IndexHeader, a sorted array of IndexEntry
+// and the mapping strings, each terminated by a null character.
+// It's written in the native byte order, as it is never moved to
+// another machine.
+
+struct IndexHeader
+{
+	char magic[8];
+	//! IndexVersion, also catches the byte order.
+	quint32 version;
+	quint32 count;
+	//! Size of the whole index file.
+	qint64 totalSize;
+	//! Size, modification time (ms since the epoch) and SHA-1 of the text file.
+	qint64 textSize;
+	qint64 textModified;
+	char textHash[20];
+	//! SDL_GetPlatform() - only the mappings for this platform are included.
+	char platform[32];
+};
+
+struct IndexEntry
+{
+	Uint8 guid[16];
+	//! Position of the mapping string from the start of the file.
+	quint32 offset;
+	quint32 length;
+};
+
+static const char indexMagic[8] = {'J', 'S', 'G', 'C', 'D', 'B', 'I', 'X'};
+static const quint32 indexVersion = 1;
+
+static bool
+entryLessThan(const IndexEntry& a, const IndexEntry& b)
+{
+	return memcmp(a.guid, b.guid, sizeof(a.guid)) < 0;
+}
+
+static bool
+entryEqual(const IndexEntry& a, const IndexEntry& b)
+{
+	return memcmp(a.guid, b.guid, sizeof(a.guid)) == 0;
+}
+
+
+GamepadDatabase::GamepadDatabase() :
+    data(NULL),
+    dataSize(0)
+{
+	//
+}
+
+GamepadDatabase::~GamepadDatabase()
+{
+	close();
+}
+
+bool
+GamepadDatabase::open(const QString& textPath)
+{
+	close();
+
+	QFileInfo textInfo(textPath);
+	QString indexPath = textInfo.absolutePath() + "/gamecontrollerdb.idx";
+	indexFile.setFileName(indexPath);
+	if (isIndexValid(textInfo))
+		return true;
+
+	close();
+	qDebug() << "JoystickSupport: indexing the game controller database...";
+	if (!buildIndex(textPath, textInfo))
+		return false;
+
+	// Save the index for the next start. If that's impossible (e.g. the text
+	// file is in Stellarium's installation directory), use it from memory.
+	indexFile.setFileName(indexPath);
+	if (indexFile.open(QIODevice::WriteOnly | QIODevice::Truncate)
+	    && indexFile.write(built) == built.size())
+	{
+		indexFile.close();
+		if (indexFile.open(QIODevice::ReadOnly))
+		{
+			const uchar* mapped = indexFile.map(0, built.size());
+			if (mapped)
+			{
+				data = mapped;
+				built.clear();
+				return true;
+			}
+		}
+	}
+	indexFile.close();
+	data = reinterpret_cast<const uchar*>(built.constData());
+	return true;
+}
+
+void
+GamepadDatabase::close()
+{
+	data = NULL;
+	dataSize = 0;
+	built.clear();
+	if (indexFile.isOpen())
+		indexFile.close(); // Also unmaps it
+}
+
+int
+GamepadDatabase::count() const
+{
+	if (data == NULL)
+		return 0;
+	return reinterpret_cast<const IndexHeader*>(data)->count;
+}
+
+bool
+GamepadDatabase::addMappingFor(const SDL_JoystickGUID& guid) const
+{
+	const char* mapping = findMapping(guid);
+	if (mapping == NULL)
+		return false;
+
+	if (SDL_GameControllerAddMapping(mapping) < 0)
+	{
+		qWarning() << "JoystickSupport: invalid mapping in database:"
+		           << SDL_GetError();
+		return false;
+	}
+	return true;
+}
+
+bool
+GamepadDatabase::openResource(const QString& resourcePath)
+{
+	close();
+
+	QResource resource(resourcePath);
+	if (!resource.isValid())
+		return false;
+
+	// rcc may have compressed the file, in which case it has to be unpacked.
+	// Otherwise it's indexed directly from the resource's memory.
+	QByteArray text;
+	if (resource.isCompressed())
+		text = qUncompress(resource.data(), resource.size());
+	else
+		text = QByteArray::fromRawData(
+		           reinterpret_cast<const char*>(resource.data()),
+		           resource.size());
+	if (text.isEmpty())
+		return false;
+
+	indexText(text, 0, 0);
+	data = reinterpret_cast<const uchar*>(built.constData());
+	return true;
+}
+
+bool
+GamepadDatabase::isIndexValid(const QFileInfo& textInfo)
+{
+	if (!indexFile.open(QIODevice::ReadOnly))
+		return false;
+	qint64 size = indexFile.size();
+	if (size < qint64(sizeof(IndexHeader)))
+		return false;
+	uchar* mapped = indexFile.map(0, size);
+	if (mapped == NULL)
+		return false;
+
+	const IndexHeader* header = reinterpret_cast<const IndexHeader*>(mapped);
+	if (memcmp(header->magic, indexMagic, sizeof(indexMagic)) != 0
+	    || header->version != indexVersion
+	    || header->totalSize != size
+	    || qint64(sizeof(IndexHeader))
+	       + qint64(header->count) * qint64(sizeof(IndexEntry)) > size
+	    || qstrncmp(header->platform, SDL_GetPlatform(),
+	                sizeof(header->platform)) != 0)
+		return false;
+
+	data = mapped;
+	dataSize = size;
+	qint64 modified = textInfo.lastModified().toMSecsSinceEpoch();
+	if (!textInfo.exists()
+	    || (header->textSize == textInfo.size()
+	        && header->textModified == modified))
+		return true;
+
+	// The file may have been copied or touched without being changed.
+	QFile textFile(textInfo.absoluteFilePath());
+	if (!textFile.open(QIODevice::ReadOnly))
+		return true;
+	QByteArray hash = QCryptographicHash::hash(textFile.readAll(),
+	                                           QCryptographicHash::Sha1);
+	if (hash.size() != int(sizeof(header->textHash))
+	    || memcmp(hash.constData(), header->textHash, hash.size()) != 0)
+	{
+		data = NULL;
+		dataSize = 0;
+		return false;
+	}
+
+	// Remember the new size and time, so that the hash is not computed again
+	// at every start. If the index is read-only, that's what happens.
+	qint64 textStamp[2] = {textInfo.size(), modified};
+	QFile updatedFile(indexFile.fileName());
+	if (updatedFile.open(QIODevice::ReadWrite)
+	    && updatedFile.seek(offsetof(IndexHeader, textSize)))
+		updatedFile.write(reinterpret_cast<const char*>(textStamp),
+		                  sizeof(textStamp));
+	return true;
+}
+
+bool
+GamepadDatabase::buildIndex(const QString& textPath,
+                            const QFileInfo& textInfo)
+{
+	QFile textFile(textPath);
+	if (!textFile.open(QIODevice::ReadOnly))
+	{
+		qWarning() << "JoystickSupport: unable to read" << textPath
+		           << textFile.errorString();
+		return false;
+	}
+	QByteArray text = textFile.readAll();
+	textFile.close();
+
+	indexText(text, textInfo.size(),
+	          textInfo.lastModified().toMSecsSinceEpoch());
+	return true;
+}
+
+void
+GamepadDatabase::indexText(const QByteArray& text, qint64 textSize,
+                           qint64 textModified)
+{
+	const QByteArray platform(SDL_GetPlatform());
+	QVector<IndexEntry> entries;
+	QByteArray strings;
+	const QList<QByteArray> lines = text.split('\n');
+	for (int i = 0; i < lines.count(); i++)
+	{
+		QByteArray line = lines[i].trimmed();
+		if (line.isEmpty() || line.startsWith('#'))
+			continue;
+		int guidEnd = line.indexOf(',');
+		if (guidEnd != 32)
+			continue;
+		// Mappings without a platform apply to all of them.
+		int platformStart = line.indexOf("platform:");
+		if (platformStart >= 0)
+		{
+			platformStart += 9;
+			int platformEnd = line.indexOf(',', platformStart);
+			if (platformEnd < 0)
+				platformEnd = line.length();
+			if (line.mid(platformStart, platformEnd - platformStart) != platform)
+				continue;
+		}
+
+		IndexEntry entry;
+		SDL_JoystickGUID guid = SDL_JoystickGetGUIDFromString(line.left(32).constData());
+		memcpy(entry.guid, guid.data, sizeof(entry.guid));
+		entry.offset = strings.size(); // Relative for now
+		entry.length = line.size();
+		entries.append(entry);
+		strings.append(line);
+		strings.append('\0');
+	}
+
+	// If a GUID is listed more than once, the last mapping wins, as in SDL.
+	std::reverse(entries.begin(), entries.end());
+	std::stable_sort(entries.begin(), entries.end(), entryLessThan);
+	int count = std::unique(entries.begin(), entries.end(), entryEqual)
+	            - entries.begin();
+
+	IndexHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, indexMagic, sizeof(indexMagic));
+	header.version = indexVersion;
+	header.count = count;
+	qint64 stringsStart = sizeof(IndexHeader) + count * sizeof(IndexEntry);
+	header.totalSize = stringsStart + strings.size();
+	header.textSize = textSize;
+	header.textModified = textModified;
+	QByteArray hash = QCryptographicHash::hash(text, QCryptographicHash::Sha1);
+	memcpy(header.textHash, hash.constData(),
+	       qMin<int>(hash.size(), sizeof(header.textHash)));
+	qstrncpy(header.platform, platform.constData(), sizeof(header.platform));
+
+	built.clear();
+	built.reserve(header.totalSize);
+	built.append(reinterpret_cast<const char*>(&header), sizeof(header));
+	for (int i = 0; i < count; i++)
+	{
+		entries[i].offset += stringsStart;
+		built.append(reinterpret_cast<const char*>(&entries[i]),
+		             sizeof(IndexEntry));
+	}
+	built.append(strings);
+	dataSize = built.size();
+
+	qDebug() << "JoystickSupport: indexed" << count << "mappings for" << platform;
+}
+
+const char*
+GamepadDatabase::findMapping(const SDL_JoystickGUID& guid) const
+{
+	if (data == NULL)
+		return NULL;
+
+	const IndexHeader* header = reinterpret_cast<const IndexHeader*>(data);
+	const IndexEntry* first = reinterpret_cast<const IndexEntry*>(data + sizeof(IndexHeader));
+	const IndexEntry* last = first + header->count;
+
+	// Newer versions of SDL put a CRC of the name in bytes 2-3 and
+	// a version in bytes 12-13 of the GUID, which the database may not have.
+	IndexEntry key;
+	memcpy(key.guid, guid.data, sizeof(key.guid));
+	for (int attempt = 0; attempt < 3; attempt++)
+	{
+		if (attempt == 1)
+			key.guid[2] = key.guid[3] = 0;
+		else if (attempt == 2)
+			key.guid[12] = key.guid[13] = 0;
+
+		const IndexEntry* entry = std::lower_bound(first, last, key, entryLessThan);
+		if (entry != last && entryEqual(*entry, key)
+		    && qint64(entry->offset) + entry->length < dataSize)
+			return reinterpret_cast<const char*>(data + entry->offset);
+	}
+	return NULL;
+}
@@ -0,0 +1,94 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef GAMEPAD_DATABASE_HPP
+#define GAMEPAD_DATABASE_HPP
+
+#ifndef SDL_MAIN_HANDLED
+#define SDL_MAIN_HANDLED
+#endif
+#include "SDL.h"
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+
+class QFileInfo;
+
+//! Index of SDL's game controller database (gamecontrollerdb.txt),
+//! keyed by device GUID.
+//!
+//! Instead of passing thousands of mappings for all platforms to SDL at
+//! start-up, the text file is parsed once into a compact binary index that
+//! contains only the mappings for the current platform, sorted by GUID.
+//! The index is saved next to the text file (as "gamecontrollerdb.idx")
+//! and memory-mapped on the next start, so opening the database doesn't
+//! depend on its size. The saved index is rebuilt if the size, modification
+//! time and SHA-1 hash of the text file don't match.
+//! The copy embedded in the plug-in is indexed in memory at every start
+//! instead, which costs less than letting SDL parse and register all of it.
+//! Mappings are passed to SDL one at a time, when a device with a matching
+//! GUID is connected.
+class GamepadDatabase
+{
+public:
+	GamepadDatabase();
+	~GamepadDatabase();
+
+	//! Opens the index for the given text file, building it if necessary.
+	//! @returns false if neither the index nor the text file can be read.
+	bool open(const QString& textPath);
+	//! Opens a database in a Qt resource file, indexing it in memory.
+	//! Used for the copy of the database embedded in the plug-in, which
+	//! can't be indexed on disk.
+	//! @returns false if the resource can't be read.
+	bool openResource(const QString& resourcePath);
+	void close();
+	bool isOpen() const {return data != NULL;}
+
+	//! Number of mappings in the index.
+	int count() const;
+
+	//! Passes the mapping for a device to SDL, if there is one.
+	//! Should be called before checking if the device is a game controller.
+	//! @returns true if a mapping was found.
+	bool addMappingFor(const SDL_JoystickGUID& guid) const;
+
+
+private:
+	//! Checks if the saved index matches the text file.
+	bool isIndexValid(const QFileInfo& textInfo);
+	//! Parses the text file into #built.
+	bool buildIndex(const QString& textPath, const QFileInfo& textInfo);
+	//! Parses the contents of a database into #built, recording the size
+	//! and modification time of its file in the header.
+	void indexText(const QByteArray& text, qint64 textSize,
+	               qint64 textModified);
+	//! Finds the mapping string for a GUID, null if none.
+	const char* findMapping(const SDL_JoystickGUID& guid) const;
+
+	QFile indexFile;
+	//! Used if the index could not be saved or mapped.
+	QByteArray built;
+	//! Start of the index, either mapped from #indexFile or in #built.
+	const uchar* data;
+	qint64 dataSize;
+};
+
+#endif//GAMEPAD_DATABASE_HPP
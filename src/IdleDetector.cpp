@@ -0,0 +1,86 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#include "IdleDetector.hpp"
+
+#include <cstring>
+
+IdleDetector::IdleDetector() :
+    timeout(0),
+    resting(false),
+    restSince(0),
+    idle(false)
+{
+	//
+}
+
+void
+IdleDetector::setTimeout(double seconds)
+{
+	timeout = Uint64(qMax(0.0, seconds) * SDL_GetPerformanceFrequency());
+	reset();
+}
+
+void
+IdleDetector::reset()
+{
+	resting = false;
+	idle = false;
+}
+
+void
+IdleDetector::update(const InputSnapshot& state, const InputSnapshot& previous,
+                     bool moving)
+{
+	if (moving || timeout == 0 || !isAtRest(state)
+	    || memcmp(state.axes, previous.axes, sizeof(state.axes)) != 0)
+	{
+		reset();
+		return;
+	}
+	// Also when the timestamps start again, e.g. in a replayed trace.
+	if (!resting || state.timestamp < restSince)
+	{
+		resting = true;
+		restSince = state.timestamp;
+	}
+	idle = (state.timestamp - restSince >= timeout);
+}
+
+bool
+IdleDetector::isAtRest(const InputSnapshot& state)
+{
+	const int buttonWords = InputSnapshot::MaxDevices * InputSnapshot::ButtonWords;
+	const int hatCount = InputSnapshot::MaxDevices * InputSnapshot::MaxHats;
+	const int ballValues = InputSnapshot::MaxDevices * InputSnapshot::MaxBalls * 2;
+	quint64 buttons = 0;
+	for (int i = 0; i < buttonWords; i++)
+		buttons |= state.buttons[i];
+	int hats = 0;
+	for (int i = 0; i < hatCount; i++)
+		hats |= state.hats[i];
+	int balls = 0;
+	for (int i = 0; i < ballValues; i++)
+		balls |= state.balls[i];
+	bool rotated = false;
+	for (int i = 0; i < InputSnapshot::MaxDevices * 2; i++)
+		rotated |= (state.motion[i] != 0.f);
+	return buttons == 0 && hats == 0 && balls == 0 && !rotated;
+}
@@ -0,0 +1,67 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#ifndef IDLE_DETECTOR_HPP
+#define IDLE_DETECTOR_HPP
+
+#include "DeviceState.hpp"
+
+//! Notices when nobody is touching the devices, so they can be checked only
+//! a few times per second instead of in every frame or sample.
+//!
+//! The devices are idle when, for a given time, all buttons have been
+//! released, all hats centered, no trackball or device has moved, the axes
+//! haven't changed and the view hasn't been moved. The snapshots are expected
+//! to be calibrated, so the jitter of a stick within its deadzone doesn't
+//! count as a change.
+class IdleDetector
+{
+public:
+	//! How many times per second idle devices are checked.
+	enum { CheckRate = 10 };
+
+	IdleDetector();
+
+	//! Sets how long the devices must be at rest to become idle.
+	//! 0 disables the detection.
+	void setTimeout(double seconds);
+	//! Starts again, e.g. when devices change.
+	void reset();
+	//! Updates the state with a processed snapshot.
+	//! @param previous is the snapshot processed before @p state.
+	//! @param moving is true if the input is moving the view.
+	void update(const InputSnapshot& state, const InputSnapshot& previous,
+	            bool moving);
+	bool isIdle() const {return idle;}
+
+private:
+	//! True if nothing in @p state is held or moving.
+	static bool isAtRest(const InputSnapshot& state);
+
+	//! #setTimeout() in performance counter ticks, 0 if disabled.
+	Uint64 timeout;
+	//! True if the devices have been at rest since #restSince.
+	bool resting;
+	//! Timestamp of the first snapshot of the current rest.
+	Uint64 restSince;
+	bool idle;
+};
+
+#endif//IDLE_DETECTOR_HPP
@@ -0,0 +1,137 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#include "InputIntegrator.hpp"
+
+#include <cmath>
+
+const double InputIntegrator::StepTime = 1.0 / 240;
+const double InputIntegrator::MaxHoldTime = 0.1;
+
+InputIntegrator::InputIntegrator()
+{
+	secondsPerTick = 1.0 / SDL_GetPerformanceFrequency();
+	reset();
+}
+
+void
+InputIntegrator::reset()
+{
+	started = false;
+	origin = 0;
+	time = 0.0;
+	step = 0;
+	for (int i = 0; i < 3; i++)
+		rates[i] = partial[i] = 0.0;
+	stepPan[0] = stepPan[1] = 0.0;
+	stepZoom = 0.0;
+}
+
+void
+InputIntegrator::addSample(Uint64 timestamp, double panX, double panY,
+                           double zoom)
+{
+	double sampleTime = double(qint64(timestamp - origin)) * secondsPerTick;
+	if (!started || sampleTime < time)
+	{
+		// The current step continues from the new origin.
+		started = true;
+		origin = timestamp;
+		time = 0.0;
+		step = 0;
+		sampleTime = 0.0;
+	}
+
+	// Samples read once per frame report only what is held at the frame,
+	// so the rates are applied to the time before the sample, not after it.
+	// This doesn't delay the movement until the next sample.
+	if (sampleTime - MaxHoldTime > time)
+		integrate(sampleTime - MaxHoldTime);
+	rates[0] = panX;
+	rates[1] = panY;
+	rates[2] = zoom;
+	integrate(sampleTime);
+}
+
+void
+InputIntegrator::addDistance(double panX, double panY, double zoom)
+{
+	partial[0] += panX;
+	partial[1] += panY;
+	partial[2] += zoom;
+}
+
+bool
+InputIntegrator::takeMovement(double& panX, double& panY, double& zoom)
+{
+	double scale = std::exp(stepZoom);
+	panX = stepPan[0] + partial[0] * scale;
+	panY = stepPan[1] + partial[1] * scale;
+	zoom = stepZoom + partial[2];
+
+	// The start of the step relative to the view after this movement,
+	// computed exactly as in finishStep(), so if nothing is added to
+	// the step, finishing it moves the view by exactly zero.
+	stepZoom = -partial[2];
+	scale = std::exp(stepZoom);
+	stepPan[0] = -(partial[0] * scale);
+	stepPan[1] = -(partial[1] * scale);
+	return panX != 0.0 || panY != 0.0 || zoom != 0.0;
+}
+
+void
+InputIntegrator::integrate(double until)
+{
+	const bool still = (rates[0] == 0.0 && rates[1] == 0.0 && rates[2] == 0.0);
+	double stepEnd = (step + 1) * StepTime;
+	while (until >= stepEnd)
+	{
+		if (!still)
+		{
+			for (int i = 0; i < 3; i++)
+				partial[i] += rates[i] * (stepEnd - time);
+		}
+		finishStep();
+		step++;
+		// Steps without movement change nothing, however many there are.
+		if (still)
+			step = qMax(step, qint64(std::floor(until / StepTime)));
+		time = step * StepTime;
+		stepEnd = (step + 1) * StepTime;
+	}
+	if (!still)
+	{
+		for (int i = 0; i < 3; i++)
+			partial[i] += rates[i] * (until - time);
+	}
+	time = until;
+}
+
+void
+InputIntegrator::finishStep()
+{
+	// The panning of a step is scaled by the field of view at its start.
+	double scale = std::exp(stepZoom);
+	stepPan[0] += partial[0] * scale;
+	stepPan[1] += partial[1] * scale;
+	stepZoom += partial[2];
+	for (int i = 0; i < 3; i++)
+		partial[i] = 0.0;
+}
@@ -0,0 +1,103 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#ifndef INPUT_INTEGRATOR_HPP
+#define INPUT_INTEGRATOR_HPP
+
+#ifndef SDL_MAIN_HANDLED
+#define SDL_MAIN_HANDLED
+#endif
+#include "SDL.h"
+
+#include <QtGlobal>
+
+//! Turns the rates of movement reported by the input into the movement of
+//! the view, independently of the frame rate.
+//!
+//! The rates of each sample are integrated over the time since the previous
+//! sample, at a fixed internal timestep: the panning in each step is scaled
+//! by the field of view at its start, as changed by the zooming of the
+//! previous steps. The path of the view therefore depends only on the input
+//! and its timing, not on when the frames happen to be drawn. At a frame,
+//! takeMovement() returns the movement up to the last sample, including the
+//! part of the current step so far, and the rest of the step is corrected
+//! when it's finished.
+//!
+//! Movement is expressed in fields of view (panning) and in natural
+//! logarithms of the change of the field of view (zooming), relative to
+//! the view after the previous takeMovement().
+class InputIntegrator
+{
+public:
+	//! Length of the internal timestep in seconds.
+	static const double StepTime;
+	//! Longest time a sample's rates are assumed to have held before it.
+	//! Before that, e.g. if the samples were interrupted or a trace left out
+	//! samples that didn't change, the previous sample's rates continue.
+	static const double MaxHoldTime;
+
+	InputIntegrator();
+
+	//! Forgets the rates and any movement not taken yet. The next sample
+	//! starts the clock again.
+	void reset();
+	//! Integrates the rates of a sample back to the previous one.
+	//! A timestamp earlier than the previous one (e.g. a trace replayed
+	//! again) restarts the clock, without integrating anything.
+	//! @param timestamp is the value of SDL_GetPerformanceCounter() when
+	//! the sample was read.
+	//! @param panX, panY are the rates of panning right and down,
+	//! in fields of view per second.
+	//! @param zoom is the rate of zooming out, in natural logarithms of the
+	//! field of view per second.
+	void addSample(Uint64 timestamp, double panX, double panY, double zoom);
+	//! Adds movement that happened at once at the time of the last sample,
+	//! e.g. the motion of a trackball, in the same units as takeMovement().
+	void addDistance(double panX, double panY, double zoom);
+	//! Returns the movement since the previous call, up to the last sample.
+	//! @returns false if the view hasn't moved.
+	bool takeMovement(double& panX, double& panY, double& zoom);
+
+private:
+	//! Integrates the current rates up to a time, finishing the steps
+	//! that end before it.
+	void integrate(double until);
+	//! Applies the integrals of the current step to #stepPan and #stepZoom.
+	void finishStep();
+
+	double secondsPerTick;
+	//! False until the first sample after reset().
+	bool started;
+	//! Timestamp of the first sample, the origin of #time.
+	Uint64 origin;
+	//! Time up to which the rates are integrated, in seconds since #origin.
+	double time;
+	//! Index of the current step, which ends at (step + 1) * StepTime.
+	qint64 step;
+	//! Rates of the last sample: pan x, pan y and zoom.
+	double rates[3];
+	//! Integrals of the rates over the current step, up to #time.
+	double partial[3];
+	//! Panning and zooming at the start of the current step.
+	double stepPan[2];
+	double stepZoom;
+};
+
+#endif//INPUT_INTEGRATOR_HPP
@@ -0,0 +1,105 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "InputMapping.hpp"
+
+#include <QSettings>
+#include <QStringList>
+
+InputMapping::InputMapping() :
+    openCount(0),
+    filesChanged(true)
+{
+	for (int slot = 0; slot < InputSnapshot::MaxDevices; slot++)
+		instanceIds[slot] = -1;
+}
+
+void
+InputMapping::describe(const DeviceSet& devices)
+{
+	openCount = devices.count();
+	for (int slot = 0; slot < InputSnapshot::MaxDevices; slot++)
+		instanceIds[slot] = -1;
+	for (int i = 0; i < openCount; i++)
+	{
+		int slot = devices.slot(i);
+		openSlots[i] = slot;
+		instanceIds[slot] = devices.device(slot).instanceId;
+		caps[slot] = devices.device(slot).caps;
+	}
+}
+
+bool
+InputMapping::matches(const DeviceSet& devices) const
+{
+	if (devices.count() != openCount)
+		return false;
+	for (int i = 0; i < openCount; i++)
+	{
+		int slot = devices.slot(i);
+		if (slot != openSlots[i]
+		    || devices.device(slot).instanceId != instanceIds[slot])
+			return false;
+	}
+	return true;
+}
+
+void
+InputMapping::compile(QSettings* conf, QSettings* calibrationStore,
+                      float defaultDeadzone)
+{
+	bindings.clear();
+	for (int i = 0; i < openCount; i++)
+	{
+		int slot = openSlots[i];
+		bindings.addDevice(conf, bindingSections(caps[slot]),
+		                   caps[slot].isGamepad, slot);
+		loadCalibration(calibrations[slot], caps[slot], calibrationStore,
+		                defaultDeadzone);
+	}
+	bindings.finish();
+}
+
+QStringList
+InputMapping::bindingSections(const DeviceCapabilities& caps)
+{
+	char guid[33];
+	SDL_JoystickGetGUIDString(caps.guid, guid, sizeof(guid));
+	QStringList sections;
+	sections << QString("JoystickSupport_%1").arg(guid);
+	if (caps.isGamepad)
+		sections << "JoystickSupport_gamepad";
+	else
+		sections << "JoystickSupport_joystick";
+	return sections;
+}
+
+void
+InputMapping::loadCalibration(DeviceCalibration& calibration,
+                              const DeviceCapabilities& caps,
+                              QSettings* store, float defaultDeadzone)
+{
+	calibration.setDefaults(caps, defaultDeadzone);
+	if (store)
+	{
+		char guid[33];
+		SDL_JoystickGetGUIDString(caps.guid, guid, sizeof(guid));
+		calibration.load(store, guid);
+	}
+}
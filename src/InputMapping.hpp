@@ -0,0 +1,71 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef INPUT_MAPPING_HPP
+#define INPUT_MAPPING_HPP
+
+#include "AxisCalibration.hpp"
+#include "BindingTable.hpp"
+#include "DeviceSet.hpp"
+
+class QSettings;
+
+//! The bindings and calibrations of a given set of open devices, compiled
+//! away from the frame by a MappingCompiler and installed all at once by
+//! InputProcessor::installMapping().
+struct InputMapping
+{
+	InputMapping();
+
+	//! Records which devices are open, for compile() and for checking that
+	//! they are still the same when the mapping is installed.
+	void describe(const DeviceSet& devices);
+	//! True if the same devices are open in the same slots as described.
+	bool matches(const DeviceSet& devices) const;
+	//! Compiles the bindings and reads the calibrations of the described
+	//! devices.
+	//! @param calibrationStore may be NULL, then the defaults are used.
+	void compile(QSettings* conf, QSettings* calibrationStore,
+	             float defaultDeadzone);
+
+	//! Configuration sections with the bindings of a device, in order of
+	//! precedence: a section for the specific model, e.g. for telling apart
+	//! a stick and a throttle, then the generic one.
+	static QStringList bindingSections(const DeviceCapabilities& caps);
+	//! Reads the calibration of a device from the group named after its GUID,
+	//! with the defaults for anything that is not there.
+	static void loadCalibration(DeviceCalibration& calibration,
+	                            const DeviceCapabilities& caps,
+	                            QSettings* store, float defaultDeadzone);
+
+	//! Slots of the described devices, in the order of DeviceSet.
+	int openSlots[InputSnapshot::MaxDevices];
+	int openCount;
+	SDL_JoystickID instanceIds[InputSnapshot::MaxDevices];
+	DeviceCapabilities caps[InputSnapshot::MaxDevices];
+
+	BindingTable bindings;
+	//! The calibration of the device in each slot.
+	DeviceCalibration calibrations[InputSnapshot::MaxDevices];
+	//! False if the files were the same as for the previous mapping, so
+	//! it was compiled only for a different set of devices.
+	bool filesChanged;
+};
+
+#endif//INPUT_MAPPING_HPP
@@ -0,0 +1,526 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "InputProcessor.hpp"
+
+#include <QDebug>
+#include <QSettings>
+#include <QStringList>
+
+#include <cmath>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+InputProcessor::InputProcessor() :
+    sink(NULL),
+    latencyStats(NULL),
+    sampleTime(0),
+    movementTime(0),
+    ratesTime(0),
+    commandTime(0),
+    axisArbitration(ArbitrationMaxMagnitude),
+    calibrationStore(NULL),
+    calibrationWritable(true),
+    autoCalibrate(false),
+    measuredSlots(0),
+    panSpeed(0.5),
+    zoomSpeed(1.0),
+    horizontalRate(0.f),
+    verticalRate(0.f),
+    zoomRate(0.f),
+    ballPanGain(0.001),
+    ballZoomGain(0.002),
+    ballPanX(0),
+    ballPanY(0),
+    ballZoom(0),
+    gyroGain(1.0),
+    motionRight(0.0),
+    motionUp(0.0),
+    pointingRight(0.0),
+    pointingUp(0.0),
+    requestedMovement(0),
+    assertedMovement(0)
+{
+	for (int slot = 0; slot < InputSnapshot::MaxDevices; slot++)
+		calibratedIds[slot] = -1;
+}
+
+void
+InputProcessor::configure(QSettings* conf)
+{
+	Q_ASSERT(conf);
+	conf->beginGroup("JoystickSupport");
+	axisCurve.deadzone = conf->value("axis_deadzone",
+	                                 axisCurve.deadzone).toFloat();
+	axisCurve.expo = conf->value("axis_expo", axisCurve.expo).toFloat();
+	axisCurve.saturation = conf->value("axis_saturation",
+	                                   axisCurve.saturation).toFloat();
+	panSpeed = conf->value("pan_speed", panSpeed).toDouble();
+	zoomSpeed = conf->value("zoom_speed", zoomSpeed).toDouble();
+	ballPanGain = conf->value("ball_pan_gain", ballPanGain).toDouble();
+	ballZoomGain = conf->value("ball_zoom_gain", ballZoomGain).toDouble();
+	gyroGain = conf->value("gyro_gain", gyroGain).toDouble();
+	autoCalibrate = conf->value("auto_calibrate", false).toBool();
+	idleDetector.setTimeout(conf->value("idle_timeout", 5.0).toDouble());
+	bindings.setGestureTimes(conf->value("long_press_time", 0.5).toDouble(),
+	                         conf->value("double_tap_time", 0.3).toDouble());
+	QString arbitration = conf->value("axis_arbitration", "max").toString();
+	// A single value applies to all axes, a list gives a value for each
+	// axis in order, the last one applying to the rest.
+	QStringList cutoffs = conf->value("axis_filter_min_cutoff").toStringList();
+	QStringList betas = conf->value("axis_filter_beta").toStringList();
+	axisFilter.setDerivativeCutoff(
+	            conf->value("axis_filter_derivative_cutoff", 1.0).toFloat());
+	conf->endGroup();
+
+	for (int axis = 0; axis < InputSnapshot::MaxAxes; axis++)
+	{
+		float cutoff = cutoffs.isEmpty() ? 0.f
+		               : cutoffs[qMin(axis, cutoffs.count() - 1)].toFloat();
+		float beta = betas.isEmpty() ? 0.f
+		             : betas[qMin(axis, betas.count() - 1)].toFloat();
+		axisFilter.setParameters(axis, cutoff, beta);
+	}
+
+	if (arbitration == "priority")
+		axisArbitration = ArbitrationPriority;
+	else
+	{
+		if (arbitration != "max")
+			qWarning() << "JoystickSupport: unknown axis_arbitration:"
+			           << arbitration;
+		axisArbitration = ArbitrationMaxMagnitude;
+	}
+	// Built here, as mappings compiled in the background are installed
+	// without compileBindings(). The deadzone is removed by the calibration.
+	ResponseCurve curve = axisCurve;
+	curve.deadzone = 0.f;
+	axisResponse.build(curve);
+	// The calibrations include the default deadzone.
+	for (int slot = 0; slot < InputSnapshot::MaxDevices; slot++)
+		calibratedIds[slot] = -1;
+}
+
+void
+InputProcessor::compileBindings(QSettings* conf, const DeviceSet& devices)
+{
+	// Pending commands use the action IDs of the old bindings. Held actions
+	// are released, the ones still held are reported again by the next
+	// BindingTable::evaluate().
+	commands.clear(sink);
+	commandTime = 0;
+	bindings.clear();
+	for (int i = 0; i < devices.count(); i++)
+	{
+		int slot = devices.slot(i);
+		const DeviceState& device = devices.device(slot);
+		bindings.addDevice(conf, InputMapping::bindingSections(device.caps),
+		                   device.caps.isGamepad, slot);
+	}
+	bindings.finish();
+	commands.setActionCount(bindings.getActionCount());
+	compileCalibrations(devices, NULL);
+	resetMovement();
+}
+
+void
+InputProcessor::removeDevices(const DeviceSet& devices)
+{
+	// The bindings of the closed devices are left in the table, as their
+	// inputs are never active again (until a new mapping is installed).
+	// As in compileBindings(), the held actions are released and the ones
+	// still held on other devices are reported again.
+	commands.clear(sink);
+	commandTime = 0;
+	bindings.restart();
+	compileCalibrations(devices, NULL);
+	resetMovement();
+}
+
+void
+InputProcessor::resetMovement()
+{
+	horizontalRate = verticalRate = zoomRate = 0.f;
+	ballPanX = ballPanY = ballZoom = 0;
+	motionRight = motionUp = 0.0;
+	pointingRight = pointingUp = 0.0;
+	axisFilter.reset();
+	integrator.reset();
+	idleDetector.reset();
+
+	// Don't leave the view moving if a device is disconnected while
+	// a button is held down. Actions still held on other devices are
+	// reported again by the next BindingTable::evaluate().
+	requestedMovement = 0;
+	movementTime = ratesTime = 0;
+	flushMovementFlags();
+}
+
+bool
+InputProcessor::installMapping(InputMapping& mapping, const DeviceSet& devices)
+{
+	if (!mapping.matches(devices))
+		return false;
+
+	// As in compileBindings(), except that the movement goes on: the held
+	// movement actions are reported again by the next evaluate(), before
+	// the movement flags are passed to the sink at the end of the frame.
+	commands.clear(sink);
+	commandTime = 0;
+	bindings.swap(mapping.bindings);
+	commands.setActionCount(bindings.getActionCount());
+	requestedMovement = 0;
+	movementTime = 0;
+	compileCalibrations(devices, &mapping);
+	// Newly added devices are in use.
+	idleDetector.reset();
+	return true;
+}
+
+void
+InputProcessor::processSnapshot(DeviceSet& devices,
+                                const InputSnapshot& rawState)
+{
+	if (calibrator.isMeasuring())
+		measuredSlots |= calibrator.measure(rawState);
+	calibratedState = rawState;
+	if (axisFilter.isEnabled())
+		axisFilter.process(calibratedState);
+	calibrator.process(calibratedState, devices);
+	const InputSnapshot& state = calibratedState;
+
+	const float oldRates[3] = {horizontalRate, verticalRate, zoomRate};
+	sampleTime = state.timestamp;
+
+	// The rates are combined from all devices, in the order of priority.
+	horizontalRate = verticalRate = zoomRate = 0.f;
+	ballPanX = ballPanY = ballZoom = 0;
+	motionRight = motionUp = 0.0;
+	for (int i = 0; i < devices.count(); i++)
+	{
+		int slot = devices.slot(i);
+		const DeviceState& device = devices.device(slot);
+		if (device.caps.isGamepad)
+			handleGamepadAxes(state, slot);
+		else
+			handleJoystickAxes(state, device, slot);
+		if (device.caps.ballCount > 0)
+			handleJoystickBalls(state, device, slot);
+		// Zero unless the device's motion sensors are used.
+		motionRight += state.motionRight(slot);
+		motionUp += state.motionUp(slot);
+	}
+	if (latencyStats && ratesTime == 0
+	    && (horizontalRate != oldRates[0] || verticalRate != oldRates[1]
+	        || zoomRate != oldRates[2] || motionRight != 0.0
+	        || motionUp != 0.0))
+		ratesTime = sampleTime;
+	bindings.evaluate(state, devices.previous, *this);
+	const quint8 movementActions = ~(1 << ActionMoveSlow);
+	idleDetector.update(state, devices.previous,
+	                    horizontalRate != 0.f || verticalRate != 0.f
+	                    || zoomRate != 0.f
+	                    || (requestedMovement & movementActions) != 0);
+	devices.previous = state;
+	integrateSnapshot();
+}
+
+bool
+InputProcessor::saveCalibrations(const DeviceSet& devices)
+{
+	if (measuredSlots == 0)
+		return false;
+
+	for (int slot = 0; slot < InputSnapshot::MaxDevices; slot++)
+	{
+		if ((measuredSlots & (1 << slot)) == 0)
+			continue;
+		const DeviceState& device = devices.device(slot);
+		if (!device.isOpen() || calibratedIds[slot] != device.instanceId)
+			continue;
+		DeviceCalibration& calibration = calibrations[slot];
+		if (!calibrator.getMeasurement(slot, device.caps.axisCount,
+		                               calibration))
+		{
+			qDebug() << "JoystickSupport:" << device.caps.name
+			         << "was moved while being calibrated, keeping"
+			         << "the previous calibration.";
+			continue;
+		}
+		calibrator.compile(slot, calibration);
+
+		QStringList deadzones;
+		for (int a = 0; a < device.caps.axisCount; a++)
+			deadzones << QString::number(calibration.axes[a].deadzone, 'f', 3);
+		qDebug() << "JoystickSupport: calibrated" << device.caps.name
+		         << "- deadzones:" << deadzones.join(" ");
+		if (calibrationStore && calibrationWritable)
+		{
+			char guid[33];
+			SDL_JoystickGetGUIDString(device.caps.guid, guid, sizeof(guid));
+			calibration.save(calibrationStore, guid, device.caps.axisCount);
+		}
+	}
+	measuredSlots = 0;
+	return true;
+}
+
+void
+InputProcessor::finishFrame()
+{
+	flushMovementFlags();
+	flushCommands();
+	applyMovement();
+}
+
+void
+InputProcessor::flushCommands()
+{
+	const Uint64 inputTime = commandTime;
+	commandTime = 0;
+	if (commands.flush(sink) > 0 && latencyStats)
+		latencyStats->buttons.addTicks(inputTime, SDL_GetPerformanceCounter());
+}
+
+void
+InputProcessor::compileCalibrations(const DeviceSet& devices,
+                                    const InputMapping* mapping)
+{
+	bool isOpen[InputSnapshot::MaxDevices] = {false};
+	for (int i = 0; i < devices.count(); i++)
+	{
+		int slot = devices.slot(i);
+		const DeviceState& device = devices.device(slot);
+		isOpen[slot] = true;
+		bool isNew = (calibratedIds[slot] != device.instanceId);
+		// The calibrations of the devices that were already open are
+		// replaced only if the files have been edited, as the ones
+		// measured since they were read may not be saved yet.
+		if (!isNew && (mapping == NULL || !mapping->filesChanged))
+			continue;
+
+		// A measurement in progress is applied to the new calibration.
+		if (mapping)
+			calibrations[slot] = mapping->calibrations[slot];
+		else
+			InputMapping::loadCalibration(calibrations[slot], device.caps,
+			                              calibrationStore,
+			                              axisCurve.deadzone);
+		calibrator.compile(slot, calibrations[slot]);
+		if (isNew)
+		{
+			calibratedIds[slot] = device.instanceId;
+			if (autoCalibrate)
+				calibrator.startMeasuring(slot);
+		}
+	}
+	for (int slot = 0; slot < InputSnapshot::MaxDevices; slot++)
+	{
+		if (isOpen[slot])
+			continue;
+		calibratedIds[slot] = -1;
+		calibrator.stopMeasuring(slot);
+		measuredSlots &= ~(1 << slot);
+	}
+}
+
+void
+InputProcessor::handleJoystickAxes(const InputSnapshot& state,
+                                   const DeviceState& device,
+                                   int slot)
+{
+	Q_ASSERT(!device.caps.isGamepad);
+
+	int axesCount = device.caps.axisCount;
+	if (axesCount < 1)
+		return;
+	const Sint16* axisValues = state.axes + slot * InputSnapshot::MaxAxes;
+
+	if (axesCount == 1) // Some kind of paddle?
+	{
+		interpretAsZooming(axisValues[0]);
+		return;
+	}
+
+	if (axesCount >= 2) // Two axes, assuming 0==X, 1==Y, negative is left/up.
+	{
+		interpretAsHorizontalMovement(axisValues[0]);
+		interpretAsVerticalMovement(axisValues[1]);
+	}
+
+	if (axesCount >= 3) // Third axis is assumed to be a throttle.
+		interpretAsZooming(axisValues[2]);
+}
+
+void
+InputProcessor::handleGamepadAxes(const InputSnapshot& state, int slot)
+{
+	interpretAsHorizontalMovement(state.axis(slot, SDL_CONTROLLER_AXIS_LEFTX));
+	interpretAsVerticalMovement(state.axis(slot, SDL_CONTROLLER_AXIS_LEFTY));
+	interpretAsZooming(state.axis(slot, SDL_CONTROLLER_AXIS_RIGHTY));
+}
+
+void
+InputProcessor::handleJoystickBalls(const InputSnapshot& state,
+                                    const DeviceState& device,
+                                    int slot)
+{
+	int x = state.ballX(slot, 0);
+	int y = state.ballY(slot, 0);
+	if (device.caps.ballCount > 1)
+		ballZoom += state.ballY(slot, 1);
+	if (x == 0 && y == 0)
+		return;
+	ballPanX += x;
+	ballPanY += y;
+	if (latencyStats && ratesTime == 0)
+		ratesTime = sampleTime;
+}
+
+void
+InputProcessor::performAction(int actionId, bool active)
+{
+	// Movement is applied once per frame by applyMovement().
+	if (actionId <= ActionMoveSlow)
+	{
+		if (active)
+			requestedMovement |= (1 << actionId);
+		else
+			requestedMovement &= ~(1 << actionId);
+		if (movementTime == 0)
+			movementTime = sampleTime;
+	}
+	else
+	{
+		// Everything else is performed once per frame by flushCommands().
+		if (commands.isFull())
+			flushCommands();
+		if (active && !bindings.isHeldAction(actionId))
+			commands.trigger(actionId);
+		else
+			commands.hold(actionId, active);
+		if (commandTime == 0)
+			commandTime = sampleTime;
+	}
+}
+
+void
+InputProcessor::interpretAsHorizontalMovement(const Sint16& xAxis)
+{
+	horizontalRate = arbitrate(horizontalRate, axisResponse.rate(xAxis));
+}
+
+void
+InputProcessor::interpretAsVerticalMovement(const Sint16& yAxis)
+{
+	verticalRate = arbitrate(verticalRate, axisResponse.rate(yAxis));
+}
+
+void
+InputProcessor::interpretAsZooming(const Sint16& zoomAxis)
+{
+	zoomRate = arbitrate(zoomRate, axisResponse.rate(zoomAxis));
+}
+
+float
+InputProcessor::arbitrate(float current, float candidate) const
+{
+	if (axisArbitration == ArbitrationPriority)
+		return (current != 0.f) ? current : candidate;
+	return (std::fabs(candidate) > std::fabs(current)) ? candidate : current;
+}
+
+void
+InputProcessor::flushMovementFlags()
+{
+	// The other movement actions go through the integrator, but move_slow
+	// also slows down the keyboard, so it's passed on.
+	const quint8 slow = (1 << ActionMoveSlow);
+	if (((requestedMovement ^ assertedMovement) & slow) == 0 || sink == NULL)
+		return;
+	sink->setMovementFlag(ActionMoveSlow, requestedMovement & slow);
+	assertedMovement = requestedMovement & slow;
+}
+
+void
+InputProcessor::integrateSnapshot()
+{
+	// The movement actions act like a fully deflected axis, added to
+	// the axes so they can't cancel each other.
+	const quint8 held = requestedMovement;
+	float x = horizontalRate + ((held >> ActionTurnRight) & 1)
+	          - ((held >> ActionTurnLeft) & 1);
+	float y = verticalRate + ((held >> ActionTurnDown) & 1)
+	          - ((held >> ActionTurnUp) & 1);
+	float z = zoomRate + ((held >> ActionZoomOut) & 1)
+	          - ((held >> ActionZoomIn) & 1);
+	// The same proportion as in StelMovementMgr's keyboard handling.
+	const double speedFactor = (held & (1 << ActionMoveSlow)) ? 0.2 : 1.0;
+	const double pan = panSpeed * speedFactor;
+	integrator.addSample(sampleTime,
+	                     qBound(-1.f, x, 1.f) * pan,
+	                     qBound(-1.f, y, 1.f) * pan,
+	                     qBound(-1.f, z, 1.f) * zoomSpeed * speedFactor);
+	// Trackball counts are already a distance, so each count always moves
+	// the view as much.
+	if (ballPanX != 0 || ballPanY != 0 || ballZoom != 0)
+		integrator.addDistance(ballPanX * ballPanGain * speedFactor,
+		                       ballPanY * ballPanGain * speedFactor,
+		                       ballZoom * ballZoomGain * speedFactor);
+	// A device pointed elsewhere turns the view by the same angle (times
+	// gyro_gain), whatever the field of view. The rotation was measured up
+	// to the time of the snapshot, so it needs no integration.
+	pointingRight += motionRight * gyroGain * speedFactor;
+	pointingUp += motionUp * gyroGain * speedFactor;
+}
+
+void
+InputProcessor::applyMovement()
+{
+	// Stopping doesn't call the sink, so it's not measured.
+	const Uint64 inputTimes[2] = {ratesTime, movementTime};
+	ratesTime = movementTime = 0;
+	double panX, panY, zoom;
+	const bool moved = integrator.takeMovement(panX, panY, zoom);
+	const double pointing[2] = {pointingRight, pointingUp};
+	pointingRight = pointingUp = 0.0;
+	if ((!moved && pointing[0] == 0.0 && pointing[1] == 0.0) || sink == NULL)
+		return;
+	if (latencyStats)
+	{
+		Uint64 now = SDL_GetPerformanceCounter();
+		if (inputTimes[0] != 0)
+			latencyStats->axes.addTicks(inputTimes[0], now);
+		if (inputTimes[1] != 0)
+			latencyStats->buttons.addTicks(inputTimes[1], now);
+	}
+
+	// Panning is relative to the field of view, so the apparent speed
+	// is the same at any zoom level.
+	const double fov = sink->getCurrentFov();
+	const double fovRadians = fov * M_PI / 180.0;
+	// Positive vertical values mean "down".
+	if (panX != 0.0 || panY != 0.0 || pointing[0] != 0.0 || pointing[1] != 0.0)
+		sink->panView(panX * fovRadians + pointing[0],
+		              -panY * fovRadians + pointing[1]);
+	if (zoom != 0.0)
+		sink->changeFov(fov * std::exp(zoom) - fov);
+}
@@ -0,0 +1,271 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef INPUT_PROCESSOR_HPP
+#define INPUT_PROCESSOR_HPP
+
+#include "AxisCalibration.hpp"
+#include "AxisFilter.hpp"
+#include "BindingTable.hpp"
+#include "CommandBuffer.hpp"
+#include "DeviceSet.hpp"
+#include "IdleDetector.hpp"
+#include "InputIntegrator.hpp"
+#include "InputMapping.hpp"
+#include "LatencyHistogram.hpp"
+#include "MovementSink.hpp"
+#include "ResponseCurve.hpp"
+
+class QSettings;
+
+//! Translates the state of the devices into movement and actions.
+//!
+//! Analog axes pan and zoom the view, at a rate set by their deflection,
+//! as do the movement actions, like a fully deflected axis. Trackballs do
+//! the same, in proportion to their motion, like a mouse. All movement is
+//! integrated over the time of the samples by an InputIntegrator, so it
+//! doesn't depend on the frame rate. Game controllers with motion sensors
+//! (if enabled) turn the view by the angle they are turned, measured up to
+//! the time of each sample.
+//! Buttons, hats and axes used as buttons
+//! are bound to actions through a BindingTable read from the configuration.
+//! The axes are first smoothed by an AxisFilter (if enabled) and calibrated
+//! by an AxisCalibrator, so everything that uses them (including axes bound
+//! as buttons) sees the filtered and calibrated values.
+//! The axes of several devices are combined according to #axisArbitration.
+//! The results go to a MovementSink, so this class doesn't depend on
+//! Stellarium. Nothing is passed to it while the snapshots are processed:
+//! the move_slow flag, the other actions (through a CommandBuffer) and the
+//! movement of the view are resolved and passed once per frame by
+//! finishFrame(), in that order, so the result doesn't depend on the order
+//! of the devices or of the bindings.
+class InputProcessor : private ActionTarget
+{
+public:
+	//! How the axes of several devices that control the same thing are
+	//! combined.
+	enum AxisArbitration
+	{
+		//! The axis with the largest deflection wins.
+		ArbitrationMaxMagnitude,
+		//! The first device (in order of connection) whose axis is outside
+		//! of the deadzone wins.
+		ArbitrationPriority
+	};
+
+	InputProcessor();
+
+	//! Reads the settings from the [JoystickSupport] section.
+	void configure(QSettings* conf);
+	void setSink(MovementSink* sink) {this->sink = sink;}
+	//! Sets where to record the time from reading a sample to the calls
+	//! to the sink that result from it. NULL (the default) disables it.
+	//! The snapshots must have timestamps from SDL_GetPerformanceCounter().
+	void setLatencyStats(LatencyStats* stats) {latencyStats = stats;}
+
+	//! Compiles #bindings for all open devices. Also stops any movement,
+	//! as the state of "held" actions starts from scratch.
+	//! Must be called whenever devices are opened or closed.
+	void compileBindings(QSettings* conf, const DeviceSet& devices);
+	const BindingTable& getBindings() const {return bindings;}
+	//! Replaces the bindings and calibrations with ones compiled in
+	//! the background, e.g. after the configuration has been edited or
+	//! devices have been added.
+	//! Call between snapshots; the change takes effect with the next one.
+	//! The old bindings are left in @p mapping.
+	//! @returns false (and changes nothing) if the mapping was compiled
+	//! for devices other than the ones open.
+	bool installMapping(InputMapping& mapping, const DeviceSet& devices);
+	//! Forgets the devices that have been closed, without compiling
+	//! anything. Stops any movement, like compileBindings().
+	void removeDevices(const DeviceSet& devices);
+	//! Deadzone of axes without a calibration, for compiling an InputMapping.
+	float getDefaultDeadzone() const {return axisCurve.deadzone;}
+
+	//! Sets where the calibration of devices is read from and where
+	//! the results of automatic calibration are written, in groups named
+	//! after the devices' GUIDs. If NULL (the default), the defaults are
+	//! used and nothing is written.
+	//! @param writable if false, the store is only read, e.g. when
+	//! replaying a trace.
+	void setCalibrationStore(QSettings* store, bool writable = true)
+	{
+		calibrationStore = store;
+		calibrationWritable = writable;
+	}
+	//! Writes the calibrations measured since the last call to the store
+	//! and to the log. Kept out of processSnapshot(), which doesn't
+	//! allocate memory.
+	//! @returns true if there was anything to write.
+	bool saveCalibrations(const DeviceSet& devices);
+
+	//! Passes a snapshot of the state of all devices to the appropriate
+	//! handlers and stores it (with filtered and calibrated axes) as
+	//! the previous state of @p devices.
+	void processSnapshot(DeviceSet& devices, const InputSnapshot& rawState);
+	//! Moves the view according to the input processed since the last frame,
+	//! up to the time of the last snapshot.
+	void finishFrame();
+	//! True if the devices have been at rest for "idle_timeout" seconds,
+	//! so they need to be checked only IdleDetector::CheckRate times
+	//! per second.
+	bool isIdle() const {return idleDetector.isIdle();}
+
+private:
+	//! Acts according to the state of joystick axes.
+	//! @param slot is the device's slot in the DeviceSet.
+	void handleJoystickAxes(const InputSnapshot& state,
+	                        const DeviceState& device,
+	                        int slot);
+	//! Acts according to the state of gamepad axes.
+	//! @param slot is the device's slot in the DeviceSet (a game controller).
+	void handleGamepadAxes(const InputSnapshot& state, int slot);
+	//! Adds the motion of a device's trackballs to #ballPanX, #ballPanY and
+	//! #ballZoom.
+	//! The first ball pans the view, the second one (if any) zooms.
+	void handleJoystickBalls(const InputSnapshot& state,
+	                         const DeviceState& device,
+	                         int slot);
+
+	//! Receives an action triggered by #bindings. Movement actions are
+	//! stored in #requestedMovement, everything else in #commands.
+	virtual void performAction(int actionId, bool active);
+
+	//! Interprets an axis value as the rate of horizontal movement.
+	//! This means azimuth or right ascension depending on the mount mode.
+	//! Negative is left (counterclockwise), positivive is right (clockwise).
+	void interpretAsHorizontalMovement(const Sint16& xAxis);
+	//! Interprets an axis value as the rate of vertical movement.
+	//! This means altitude or declination depending on the mount mode.
+	//! Negative is "up", positive is "down".
+	void interpretAsVerticalMovement(const Sint16& yAxis);
+	//! Interprets an axis value as the rate of zooming.
+	//! Negative is zooming in, positive is zooming out.
+	void interpretAsZooming(const Sint16& zoomAxis);
+	//! Loads the calibration of newly opened devices and starts measuring
+	//! them if #autoCalibrate is set.
+	//! @param mapping has the calibrations, NULL to read them from
+	//! #calibrationStore.
+	void compileCalibrations(const DeviceSet& devices,
+	                         const InputMapping* mapping);
+	//! Stops the movement and clears the state of the filters, as
+	//! the devices have changed.
+	void resetMovement();
+	//! Combines a rate from an axis with the rate set by the axes of
+	//! the devices processed before it, according to #axisArbitration.
+	float arbitrate(float current, float candidate) const;
+
+	//! Sets the move_slow flag in the sink, only if it differs between
+	//! #requestedMovement and #assertedMovement. This way an idle device
+	//! costs almost nothing and doesn't overwrite the flag set by the
+	//! keyboard.
+	void flushMovementFlags();
+	//! Passes the rates set by the interpretAs*() functions and the movement
+	//! actions, and the trackball motion, of the snapshot being processed
+	//! to #integrator.
+	void integrateSnapshot();
+	//! Performs the actions in #commands.
+	void flushCommands();
+	//! Moves the view as integrated since the last frame.
+	void applyMovement();
+
+	MovementSink* sink;
+	LatencyStats* latencyStats;
+	//! Timestamp of the snapshot being processed.
+	Uint64 sampleTime;
+	//! Timestamp of the oldest snapshot that changed #requestedMovement
+	//! since the last applyMovement(), or 0.
+	Uint64 movementTime;
+	//! Timestamp of the oldest snapshot that changed the axis rates since
+	//! the last applyMovement(), or 0.
+	Uint64 ratesTime;
+	//! Timestamp of the oldest snapshot that added to #commands since
+	//! the last flushCommands(), or 0.
+	Uint64 commandTime;
+
+	AxisArbitration axisArbitration;
+	//! Smooths the axes of all devices, if configured.
+	AxisFilter axisFilter;
+	//! Calibrates the axes of all devices.
+	AxisCalibrator calibrator;
+	//! The calibration of the device in each slot.
+	DeviceCalibration calibrations[InputSnapshot::MaxDevices];
+	//! Instance ID of the device whose calibration is in each slot, or -1.
+	SDL_JoystickID calibratedIds[InputSnapshot::MaxDevices];
+	QSettings* calibrationStore;
+	//! If false, measured calibrations are not written to #calibrationStore.
+	bool calibrationWritable;
+	//! If true, the resting state of each device is measured when opened.
+	bool autoCalibrate;
+	//! Slots whose measurement has finished since saveCalibrations().
+	int measuredSlots;
+	//! The snapshot being processed, with filtered and calibrated axes.
+	InputSnapshot calibratedState;
+	//! Response curve shared by all axes, applied after their calibration.
+	//! Its deadzone is only the default for axes without a calibrated one,
+	//! as the calibration removes the deadzone before the curve is applied.
+	ResponseCurve axisCurve;
+	//! #axisCurve evaluated for all axis values. Built in configure().
+	AxisResponseTable axisResponse;
+	//! Panning speed at full deflection, in fields of view per second.
+	double panSpeed;
+	//! Zooming speed at full deflection. The field of view changes
+	//! e times for each unit.
+	double zoomSpeed;
+	//! Rates set by the interpretAs*() functions, between -1 and 1.
+	float horizontalRate;
+	float verticalRate;
+	float zoomRate;
+	//! Turns the rates and trackball motion of the snapshots into movement.
+	InputIntegrator integrator;
+	//! Notices when the devices are not used.
+	IdleDetector idleDetector;
+	//! Pan per trackball count, in fields of view.
+	double ballPanGain;
+	//! Zoom per trackball count, in the same units as #zoomSpeed.
+	double ballZoomGain;
+	//! Trackball motion in the snapshot being processed, in counts, summed
+	//! over all devices. Positive is right and down.
+	int ballPanX;
+	int ballPanY;
+	int ballZoom;
+	//! Angle by which the view turns for each radian a device is turned
+	//! with its motion sensors.
+	double gyroGain;
+	//! Rotation of the devices in the snapshot being processed, in radians,
+	//! summed over all devices. Positive is right and up.
+	double motionRight;
+	double motionUp;
+	//! The same, times #gyroGain, summed since the last applyMovement().
+	double pointingRight;
+	double pointingUp;
+	//! Movement flags requested by the bindings, one bit per action
+	//! (the bit number is the BuiltinAction value, up to ActionMoveSlow).
+	quint8 requestedMovement;
+	//! Shadow copy of the move_slow flag last set by the plug-in in
+	//! the sink, in the same format as #requestedMovement.
+	quint8 assertedMovement;
+
+	//! Actions bound to the buttons and hats of the open devices.
+	BindingTable bindings;
+	//! Actions triggered since the last frame, except movement.
+	CommandBuffer commands;
+};
+
+#endif//INPUT_PROCESSOR_HPP
@@ -0,0 +1,169 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "InputSampler.hpp"
+
+#include <cstring>
+
+InputSampler::InputSampler() :
+    devices(NULL),
+    rate(500),
+    stopRequested(0),
+    idleRequested(0),
+    droppedCount(0)
+{
+	for (int i = 0; i < InputSnapshot::MaxDevices; i++)
+		fusionIds[i] = -1;
+}
+
+InputSampler::~InputSampler()
+{
+	stop();
+}
+
+void
+InputSampler::setDevices(const DeviceSet* devices)
+{
+	Q_ASSERT(!isRunning());
+	this->devices = devices;
+	samples.clear();
+}
+
+void
+InputSampler::setRate(int hz)
+{
+	Q_ASSERT(!isRunning());
+	rate = qBound(1, hz, 1000);
+}
+
+void
+InputSampler::setIdle(bool idle)
+{
+	idleRequested.fetchAndStoreRelaxed(idle ? 1 : 0);
+}
+
+void
+InputSampler::stop()
+{
+	if (!isRunning())
+		return;
+	stopRequested.fetchAndStoreOrdered(1);
+	wakeUp.release();
+	wait();
+	stopRequested.fetchAndStoreOrdered(0);
+	// In case the thread exited without sleeping again.
+	wakeUp.tryAcquire(wakeUp.available());
+}
+
+int
+InputSampler::getDroppedCount() const
+{
+	return const_cast<QAtomicInt&>(droppedCount).fetchAndAddRelaxed(0);
+}
+
+void
+InputSampler::run()
+{
+	droppedCount.fetchAndStoreRelaxed(0);
+	if (devices == NULL || devices->isEmpty())
+		return;
+
+	const Uint64 frequency = SDL_GetPerformanceFrequency();
+	const Uint64 activePeriod = frequency / rate;
+	const Uint64 idlePeriod = frequency / IdleDetector::CheckRate;
+	Uint64 deadline = SDL_GetPerformanceCounter();
+	InputSnapshot snapshot;
+	// Trackball motion of dropped samples, added to the next sample.
+	const int ballValues = InputSnapshot::MaxDevices * InputSnapshot::MaxBalls * 2;
+	int droppedBalls[ballValues];
+	memset(droppedBalls, 0, sizeof(droppedBalls));
+	// The same for the rotation of the devices.
+	const int motionValues = InputSnapshot::MaxDevices * 2;
+	float droppedMotion[motionValues];
+	memset(droppedMotion, 0, sizeof(droppedMotion));
+	Uint64 previousTime = 0;
+	while (stopRequested.fetchAndAddRelaxed(0) == 0)
+	{
+		SDL_JoystickUpdate();
+		devices->read(snapshot);
+		readMotion(snapshot, previousTime == 0 ? 0.0
+		           : double(snapshot.timestamp - previousTime) / frequency);
+		previousTime = snapshot.timestamp;
+		for (int i = 0; i < ballValues; i++)
+			snapshot.balls[i] += droppedBalls[i];
+		for (int i = 0; i < motionValues; i++)
+			snapshot.motion[i] += droppedMotion[i];
+		if (samples.push(snapshot))
+		{
+			memset(droppedBalls, 0, sizeof(droppedBalls));
+			memset(droppedMotion, 0, sizeof(droppedMotion));
+		}
+		else
+		{
+			droppedCount.fetchAndAddRelaxed(1);
+			memcpy(droppedBalls, snapshot.balls, sizeof(droppedBalls));
+			memcpy(droppedMotion, snapshot.motion, sizeof(droppedMotion));
+		}
+
+		// Sleep until the next sample is due. If the thread fell behind
+		// (e.g. it was not scheduled for a while), don't try to catch up.
+		bool idle = (idleRequested.fetchAndAddRelaxed(0) != 0);
+		deadline += idle ? idlePeriod : activePeriod;
+		Uint64 now = SDL_GetPerformanceCounter();
+		if (now >= deadline)
+			deadline = now;
+		else
+			pause((deadline - now) * 1000000 / frequency);
+	}
+}
+
+void
+InputSampler::pause(Uint64 microseconds)
+{
+	// The whole milliseconds are spent waiting for stop(), which can't
+	// wait with a finer resolution, and the rest in a plain sleep.
+	if (microseconds >= 1000
+	    && wakeUp.tryAcquire(1, int(microseconds / 1000)))
+		return;
+	usleep(microseconds % 1000);
+}
+
+void
+InputSampler::readMotion(InputSnapshot& snapshot, double dt)
+{
+	for (int i = 0; i < devices->count(); i++)
+	{
+		int slot = devices->slot(i);
+		const DeviceState& device = devices->device(slot);
+		float gyro[3], accel[3];
+		if (!device.hasMotionSensors || !device.readMotionSensors(gyro, accel))
+			continue;
+		SensorFusion& fusion = fusions[slot];
+		if (fusionIds[slot] != device.instanceId)
+		{
+			fusion.reset();
+			fusionIds[slot] = device.instanceId;
+		}
+		fusion.addSample(dt, gyro, accel);
+		double right, up;
+		fusion.takeRotation(right, up);
+		snapshot.motion[slot * 2] = float(right);
+		snapshot.motion[slot * 2 + 1] = float(up);
+	}
+}
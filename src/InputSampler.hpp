@@ -0,0 +1,104 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef INPUT_SAMPLER_HPP
+#define INPUT_SAMPLER_HPP
+
+#include <QSemaphore>
+#include <QThread>
+
+#include "DeviceSet.hpp"
+#include "IdleDetector.hpp"
+#include "SampleRing.hpp"
+#include "SensorFusion.hpp"
+
+//! Background thread sampling the open devices at a fixed rate.
+//!
+//! Each sample is pushed as an InputSnapshot into a lock-free ring buffer
+//! that is drained by JoystickSupport::update(), so the input resolution
+//! does not depend on the rendering frame rate. While the sampler is running,
+//! it is the only thing that may call SDL_JoystickUpdate() or read from
+//! the devices. While the devices are idle, it samples them only
+//! IdleDetector::CheckRate times per second.
+//! The motion sensors of the devices that have them turned on are read and
+//! fused in the same thread, at the same rate, so the rotation in each
+//! sample is measured up to the time of the sample.
+class InputSampler : public QThread
+{
+public:
+	//! Number of buffered samples. At 1000 Hz, enough for a quarter second.
+	enum { RingSize = 256 };
+
+	InputSampler();
+	~InputSampler();
+
+	//! Sets the devices to be sampled. The sampler reads only the device
+	//! handles and capabilities, so no device may be opened or closed
+	//! while it's running.
+	//! @warning Can be called only while the thread is not running.
+	void setDevices(const DeviceSet* devices);
+	//! Sets the sampling rate in Hz.
+	//! @warning Can be called only while the thread is not running.
+	void setRate(int hz);
+	int getRate() const {return rate;}
+
+	//! Switches between the full rate and the idle rate. Can be called
+	//! while the thread is running; a change takes effect after the current
+	//! sleep, which is up to 1 / IdleDetector::CheckRate seconds.
+	void setIdle(bool idle);
+
+	//! Asks the thread to exit and waits until it does. The thread is woken
+	//! up if it's sleeping, so this takes at most a millisecond or so even
+	//! while the devices are idle.
+	void stop();
+
+	//! Retrieves the oldest buffered sample. Call only from the thread
+	//! that calls JoystickSupport::update().
+	//! @returns false if there are no new samples.
+	bool popSample(InputSnapshot& sample) {return samples.pop(sample);}
+
+	//! Number of samples lost because the buffer was full, since start.
+	int getDroppedCount() const;
+
+protected:
+	virtual void run();
+
+private:
+	//! Reads the motion sensors of the devices into the motion of a sample.
+	//! @param dt is the time since the previous sample in seconds.
+	void readMotion(InputSnapshot& snapshot, double dt);
+	//! Sleeps for the given time or until stop() is called.
+	void pause(Uint64 microseconds);
+
+	const DeviceSet* devices;
+	int rate;
+	QAtomicInt stopRequested;
+	QAtomicInt idleRequested;
+	QAtomicInt droppedCount;
+	//! Released by stop() to end the current pause().
+	QSemaphore wakeUp;
+	SampleRing<InputSnapshot, RingSize> samples;
+	//! Orientation of the device in each slot, kept while the sampler is
+	//! stopped to open or close other devices.
+	SensorFusion fusions[InputSnapshot::MaxDevices];
+	//! Instance ID of the device in #fusions, or -1.
+	SDL_JoystickID fusionIds[InputSnapshot::MaxDevices];
+};
+
+#endif//INPUT_SAMPLER_HPP
@@ -18,14 +18,27 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include "JoystickSupport.hpp"
+#include "AllocationCounter.hpp"
 #include "StelFileMgr.hpp"
 
+#include <QDateTime>
 #include <QDebug>
+#include <QDir>
 #include <QFile>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QHostAddress>
+#include <QSettings>
+#include <QTextStream>
+
+#include <cstring>
 
 #include "StelApp.hpp"
 #include "StelCore.hpp"
 #include "StelMovementMgr.hpp"
+#if !(STELLARIUM_VERSION_MAJOR == 0 && STELLARIUM_VERSION_MINOR < 13)
+#include "StelActionMgr.hpp"
+#endif
 
 StelModule*
 JoystickPluginInterface::getStelModule() const
@@ -55,19 +68,34 @@ Q_EXPORT_PLUGIN2(JoystickSupport, JoystickPluginInterface);
 
 
 
+//! Files written by the plug-in, such as traces, are kept in its directory,
+//! unless the path is absolute.
+static QString
+getModuleFilePath(const QString& path)
+{
+	if (QFileInfo(path).isAbsolute())
+		return path;
+	QString directory = StelFileMgr::getUserDir() + "/modules/JoystickSupport";
+	QDir().mkpath(directory);
+	return directory + "/" + path;
+}
+
+
 JoystickSupport::JoystickSupport() :
     initialized(false),
-    activeJoystick(NULL),
-    activeGamepad(NULL)
+    devicesChanged(false),
+    samplingRate(0),
+    gyroPointing(false),
+    idle(false),
+    nextIdleCheck(0),
+    calibrationStore(NULL),
+    bindingStore(NULL),
+    mappingWatcher(NULL),
+    latencyStatsEnabled(false)
 {
 	setObjectName("JoystickSupport");
-
-	// TODO: This should be read from the configuration file.
-	// Ultimately, set separately for all axes, individually and/or in pairs.
-	axisThreshold = (2 << 13); // Around 8000
-	// Movement is between -32768 and 32767, so this is about one quarter.
-
-	gamepadStates.fill(false, SDL_CONTROLLER_BUTTON_MAX);
+	for (int i = 0; i < RemoteFormat::MaxSources; i++)
+		remoteSlots[i] = -1;
 }
 
 JoystickSupport::~JoystickSupport()
@@ -89,48 +117,110 @@ JoystickSupport::init()
 		return;
 	}
 	initialized = true;
+#ifdef JOYSTICKSUPPORT_COUNT_ALLOCATIONS
+	if (!AllocationCounter::countsMalloc())
+		qWarning() << "JoystickSupport: only the plug-in's own allocations"
+		           << "are counted, run Stellarium with"
+		           << "LD_PRELOAD=libJoystickSupportAllocationCounter.so"
+		           << "to count all of them.";
+#endif
 
-	// For debugging:
-	devicesDescribed = false;
-
-	// Disable event handling - we can't use SDL's event queue
-	SDL_JoystickEventState(SDL_IGNORE);
-	SDL_GameControllerEventState(SDL_IGNORE);
+	QSettings* conf = StelApp::getInstance().getSettings();
+	Q_ASSERT(conf);
+	conf->beginGroup("JoystickSupport");
+	samplingRate = conf->value("sampling_rate", 0).toInt();
+	gyroPointing = conf->value("gyro_pointing", false).toBool();
+	QString tracePath = conf->value("trace_record").toString();
+	QString replayPath = conf->value("trace_replay").toString();
+	latencyStatsEnabled = conf->value("latency_stats", false).toBool();
+	QString statsPath = conf->value("latency_stats_file").toString();
+	int remotePort = conf->value("remote_input_port", 0).toInt();
+	QString remoteAddress = conf->value("remote_input_address").toString();
+	int remoteMaxAge = conf->value("remote_input_max_age", 100).toInt();
+	int remoteTimeout = conf->value("remote_input_timeout", 1000).toInt();
+	conf->endGroup();
+	processor.configure(conf);
+	processor.setSink(this);
+	if (samplingRate > 0)
+	{
+		sampler.setRate(samplingRate);
+		qDebug() << "JoystickSupport: sampling devices in the background at"
+		         << sampler.getRate() << "Hz";
+	}
+	if (gyroPointing)
+		qDebug() << "JoystickSupport: game controllers with motion sensors"
+		         << "point the view";
 
 	// Load gamepad database
-	if (!loadGamepadDatabase())
+	loadGamepadDatabase();
+
+	// Only device events are handled - everything else is read directly.
+	deviceManager.setGamepadDatabases(&gamepadDatabase, &embeddedDatabase);
+	deviceManager.init();
+	connect(&deviceManager, SIGNAL(deviceAttached(int,QString)),
+	        this, SIGNAL(deviceAttached(int,QString)));
+	connect(&deviceManager, SIGNAL(deviceDetached(int)),
+	        this, SIGNAL(deviceDetached(int)));
+	connect(&deviceManager, SIGNAL(deviceDetached(int)),
+	        this, SLOT(handleDeviceDetached(int)));
+	devicesChanged = true;
+	// New devices are opened in the background.
+	descriptorCache.start(QThread::LowPriority);
+
+	// A replayed trace takes the place of the connected devices.
+	if (!replayPath.isEmpty())
 	{
-		qDebug() << "JoystickSupport: copying default database...";
-		QString path = StelFileMgr::getUserDir() + "/modules/JoystickSupport";
-		#ifdef STELFILEMGR_THROWS
-		try
-		{
-		#endif
-		StelFileMgr::makeSureDirExistsAndIsWritable(path);
-		#ifdef STELFILEMGR_THROWS
-		} catch (std::runtime_error& e)
-		{
-			qWarning() << "JoystickSupport: error creating data directory:"
-			           << e.what();
-		}
-		#endif
-		path.append("/gamecontrollerdb.txt");
-		QFile database(":/JoystickSupport/gamecontrollerdb.txt");
-		if (database.copy(path))
-			loadGamepadDatabase();
-		else
-			qWarning() << "JoystickSupport: error copying database:"
-			           << database.errorString();
+		if (tracePlayer.open(getModuleFilePath(replayPath)))
+			qDebug() << "JoystickSupport: replaying input trace" << replayPath;
 	}
+	else if (!tracePath.isEmpty())
+		traceRecorder.startRecording(getModuleFilePath(tracePath));
+
+	// Remote input is received after the replay.
+	if (remotePort > 0 && remotePort < 65536)
+	{
+		QHostAddress address(QHostAddress::Any);
+		if (!remoteAddress.isEmpty())
+			address = QHostAddress(remoteAddress);
+		remoteInput.setAddress(address, quint16(remotePort));
+		remoteInput.setTimeouts(remoteMaxAge, remoteTimeout);
+		startRemoteInput();
+	}
+
+	// A replayed trace is calibrated as the live devices are, but the
+	// calibrations measured from it are not saved.
+	calibrationStore = new QSettings(getModuleFilePath("calibration.ini"),
+	                                 QSettings::IniFormat, this);
+	processor.setCalibrationStore(calibrationStore, !tracePlayer.isOpen());
+
+	// The bindings and calibrations are reloaded when they are edited,
+	// except while replaying.
+	bindingsPath = getModuleFilePath("bindings.ini");
+	bindingStore = new QSettings(bindingsPath, QSettings::IniFormat, this);
+	if (!tracePlayer.isOpen())
+		startMappingWatcher();
+
+	// The timestamps of replayed samples are from the time of recording.
+	if (latencyStatsEnabled && !tracePlayer.isOpen())
+		processor.setLatencyStats(&latencyStats);
+	if (latencyStatsEnabled && !statsPath.isEmpty())
+		latencyStatsPath = getModuleFilePath(statsPath);
 }
 
 void
 JoystickSupport::deinit()
 {
-	if (activeJoystick)
-	{
-		closeDevice();
-	}
+	stopSampler();
+	stopRemoteInput();
+	mappingCompiler.stop();
+	descriptorCache.stop();
+	for (int i = 0; i < openedDevices.count(); i++)
+		openedDevices[i].close();
+	openedDevices.clear();
+	devices.closeAll();
+	dumpLatencyStats();
+	traceRecorder.stopRecording();
+	tracePlayer.close();
 	if (initialized)
 		SDL_Quit();
 }
@@ -138,62 +228,89 @@ JoystickSupport::deinit()
 void
 JoystickSupport::update(double deltaTime)
 {
-	Q_UNUSED(deltaTime);
-
 	if (!initialized)
 		return;
-
-	int deviceCount = SDL_NumJoysticks();
-	if (deviceCount < 0)
+	LatencyHistogram::Timer frameTimer(latencyStatsEnabled ? &latencyStats.frames
+	                                                       : NULL);
+	if (tracePlayer.isOpen())
 	{
-		qWarning() << "JoystickSupport: error finding number of devices:"
-		           << SDL_GetError();
+		replayFrame();
 		return;
 	}
-	if (deviceCount == 0)
+
+	const quint64 allocationsBefore = AllocationCounter::count();
+	bool steadyState = !devices.isEmpty();
+
+	// While the devices are idle (or there are none), the frames between
+	// the checks don't touch them at all.
+	if (idle)
 	{
-		if (activeJoystick)
-		{
-			closeDevice();
-		}
-		return;
+		Uint64 now = SDL_GetPerformanceCounter();
+		if (now < nextIdleCheck)
+			return;
+		nextIdleCheck = now + SDL_GetPerformanceFrequency()
+		                      / IdleDetector::CheckRate;
 	}
-	// TODO: Emit signal if there is a change in connected number?
 
-	if (!devicesDescribed)
+	// SDL detects connected and disconnected devices while updating.
+	// If the sampler is running, it does that in the background.
+	if (!sampler.isRunning())
+		SDL_JoystickUpdate();
+	// May close devices that have been disconnected.
+	if (deviceManager.processEvents())
 	{
-		devicesDescribed = true;
-		printDeviceDescriptions();
+		devicesChanged = true;
+		steadyState = false;
 	}
 
-	// TODO: For now assuming that we'll only use joystick 0
-	int index = 0;
-	if (activeJoystick == NULL)
+	// Remote devices may connect at any time.
+	if (deviceManager.count() == 0 && !remoteInput.isRunning())
 	{
-		openDevice(index);
+		setIdle(true);
+		return;
 	}
 
-	// Prevent attempts at reading from a detached device.
-	if (SDL_JoystickGetAttached(activeJoystick) == SDL_FALSE)
+	if (devicesChanged)
 	{
-		closeDevice();
-		qWarning() << "Joystick Support: device" << index << "disconnected?";
+		devicesChanged = false;
+		openDevices();
 	}
-
-	StelCore* core = StelApp::getInstance().getCore();
-	if (activeGamepad)
+	if (takeOpenedDevices())
+		steadyState = false;
+	// A mapping, compiled for new devices or reloaded, is installed between
+	// two snapshots, or not at all if the devices have changed since it was
+	// requested.
+	InputMapping* mapping = mappingCompiler.takeResult();
+	if (mapping)
 	{
-		SDL_GameControllerUpdate();
-		handleGamepad(core);
+		if (installMapping(*mapping) && mapping->filesChanged)
+			qDebug() << "JoystickSupport: reloaded the bindings and calibrations.";
+		delete mapping;
+		steadyState = false;
 	}
-	else if (activeJoystick)
+
+	if (processInput())
+		steadyState = false;
+	if (devices.isEmpty())
 	{
-		SDL_JoystickUpdate();
-		// FIXME: Movement may depend on the order these are called. Fixed for hats?
-		handleJoystickAxes(core);
-		handleJoystickButtons(core);
-		handleJoystickHats(core);
+		setIdle(true);
+		return;
 	}
+
+	if (traceRecorder.isRecording())
+		traceRecorder.recordFrame(deltaTime);
+	processor.finishFrame();
+	if (processor.saveCalibrations(devices))
+		steadyState = false;
+	setIdle(processor.isIdle());
+
+	// Once a device is open, the frame-by-frame processing should work
+	// only with the buffers allocated in advance.
+	Q_ASSERT_X(!steadyState || AllocationCounter::count() == allocationsBefore,
+	           "JoystickSupport::update()",
+	           "memory allocated while processing input");
+	Q_UNUSED(steadyState);
+	Q_UNUSED(allocationsBefore);
 }
 
 bool
@@ -206,6 +323,14 @@ JoystickSupport::configureGui(bool show)
 
 bool JoystickSupport::loadGamepadDatabase()
 {
+	// The copy embedded in the plug-in is indexed in memory, so nothing
+	// needs to be written to disk.
+	if (embeddedDatabase.openResource(":/JoystickSupport/gamecontrollerdb.txt"))
+		qDebug() << "JoystickSupport: found" << embeddedDatabase.count()
+		         << "device descriptions in the embedded database.";
+	else
+		qWarning() << "JoystickSupport: unable to read the embedded database.";
+
 	QString dbPath;
 #ifdef STELFILEMGR_THROWS
 	try
@@ -225,368 +350,648 @@ bool JoystickSupport::loadGamepadDatabase()
 	{
 		qDebug() << "JoystickSupport: loading game controller database:"
 		         << dbPath;
-		int num = SDL_GameControllerAddMappingsFromFile(dbPath.toUtf8().data());
-		if (num > 0)
-			qDebug() << "JoystickSupport: loaded" << num
+		// Mappings are passed to SDL only for the devices that are connected,
+		// in place of the embedded ones.
+		if (gamepadDatabase.open(dbPath))
+			qDebug() << "JoystickSupport: found" << gamepadDatabase.count()
 			         << "additional device descriptions.";
-		else if (num < 0)
-			qDebug() << "JoystickSupport: SDL error:" << SDL_GetError();
 		return true;
 	}
 }
 
 void
-JoystickSupport::printDeviceDescriptions()
+JoystickSupport::dumpLatencyStats()
 {
-	int deviceCount = SDL_NumJoysticks();
-	qDebug() << "JoystickSupport: Number of connected devices:" << deviceCount;
+	if (!latencyStatsEnabled)
+		return;
 
-	for (int i = 0; i < deviceCount; i++) // Thread safety?
+	QStringList lines = latencyStats.format();
+	for (int i = 0; i < lines.count(); i++)
+		qDebug() << "JoystickSupport: latency:" << lines[i];
+
+	if (latencyStatsPath.isEmpty())
+		return;
+	QFile file(latencyStatsPath);
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text))
 	{
-		bool isGamepad = SDL_IsGameController(i);
-		qDebug() << "Device" << i << ':'
-		         << QString(SDL_JoystickNameForIndex(i))
-		         << (isGamepad ? "is a game controller." : "is a joystick.");
+		qWarning() << "JoystickSupport: unable to write latency statistics to"
+		           << latencyStatsPath << file.errorString();
+		return;
+	}
+	QTextStream out(&file);
+	out << QDateTime::currentDateTime().toString("yyyy-MM-dd hh:mm:ss") << "\n";
+	for (int i = 0; i < lines.count(); i++)
+		out << lines[i] << "\n";
+}
 
-		SDL_GameController* gamepad = NULL;
-		SDL_Joystick* joystick = NULL;
-		if (isGamepad)
+void
+JoystickSupport::openDevices()
+{
+	for (int i = 0; i < deviceManager.count(); i++)
+	{
+		const DeviceInfo& info = deviceManager.device(i);
+		if (devices.findSlot(info.instanceId) >= 0
+		    || findOpenedDevice(info.instanceId) >= 0)
+			continue;
+		if (devices.count() + openedDevices.count() >= DeviceSet::MaxDevices)
 		{
-			gamepad = SDL_GameControllerOpen(i);
-			if (gamepad == NULL)
-			{
-				qDebug() << "JoystickSupport: unable to open device" << i;
-				continue;
-			}
-			joystick = SDL_GameControllerGetJoystick(gamepad);
+			qWarning() << "JoystickSupport: too many devices, ignoring"
+			           << info.name;
+			continue;
 		}
-		else
-			joystick = SDL_JoystickOpen(i);
+		descriptorCache.request(info.instanceId);
+	}
+}
 
-		if (joystick == NULL)
+bool
+JoystickSupport::takeOpenedDevices()
+{
+	DeviceState device;
+	bool taken = false;
+	while (descriptorCache.takeOpened(device))
+	{
+		openedDevices.append(device);
+		taken = true;
+	}
+	if (taken)
+		requestMapping();
+	return taken;
+}
+
+int
+JoystickSupport::findOpenedDevice(SDL_JoystickID instanceId) const
+{
+	for (int i = 0; i < openedDevices.count(); i++)
+	{
+		if (openedDevices[i].instanceId == instanceId)
+			return i;
+	}
+	return -1;
+}
+
+bool
+JoystickSupport::dropOpenedDevice(SDL_JoystickID instanceId)
+{
+	int i = findOpenedDevice(instanceId);
+	if (i < 0)
+		return false;
+	openedDevices[i].close();
+	openedDevices.remove(i);
+	return true;
+}
+
+void
+JoystickSupport::requestMapping()
+{
+	DeviceSet next(devices);
+	for (int i = 0; i < openedDevices.count(); i++)
+	{
+		const DeviceState& device = openedDevices[i];
+		// Disconnected while being opened (remote devices are dropped
+		// as soon as they disconnect).
+		if (device.instanceId >= 0
+		    && deviceManager.findDeviceIndex(device.instanceId) < 0)
 		{
-			qDebug() << "JoystickSupport: unable to open device" << i;
-			if (gamepad)
-				SDL_GameControllerClose(gamepad);
+			dropOpenedDevice(device.instanceId);
+			i--;
 			continue;
 		}
+		if (next.add(device) >= 0)
+			continue;
 
-		qDebug() << "It has"
-		         << SDL_JoystickNumAxes(joystick) << "axes,"
-		         << SDL_JoystickNumBalls(joystick) << "balls,"
-		         << SDL_JoystickNumButtons(joystick) << "buttons,"
-		         << SDL_JoystickNumHats(joystick) << "hats.";
-
-		if (isGamepad)
-			qDebug() << "Mapping:" << SDL_GameControllerMapping(gamepad);
-
-		if (gamepad)
-			SDL_GameControllerClose(gamepad);
-		else
-			SDL_JoystickClose(joystick);
+		qWarning() << "JoystickSupport: too many devices, ignoring"
+		           << device.caps.name;
+		if (device.instanceId <= -2)
+			remoteSlots[-2 - device.instanceId] = -2;
+		dropOpenedDevice(device.instanceId);
+		i--;
 	}
+	// Compiled even if the files haven't changed.
+	mappingCompiler.request(next, true);
 }
 
 bool
-JoystickSupport::openDevice(int deviceIndex)
+JoystickSupport::installMapping(InputMapping& mapping)
 {
-	if (activeJoystick)
-		closeDevice();
+	// The opened devices are added in the same slots as in the request.
+	DeviceSet next(devices);
+	for (int i = 0; i < openedDevices.count(); i++)
+		next.add(openedDevices[i]);
+	if (!mapping.matches(next))
+	{
+		// Devices were closed or added after the request, or disconnected
+		// while waiting. Whatever it was for is compiled again.
+		requestMapping();
+		return false;
+	}
 
-	if (SDL_IsGameController(deviceIndex))
+	if (!openedDevices.isEmpty())
 	{
-		activeGamepad = SDL_GameControllerOpen(deviceIndex);
-		activeJoystick = SDL_GameControllerGetJoystick(activeGamepad);
-		if (activeJoystick == NULL)
+		// Devices can't be added while the sampler is reading the others.
+		stopSampler();
+		for (int i = 0; i < openedDevices.count(); i++)
 		{
-			SDL_GameControllerClose(activeGamepad);
-			activeGamepad = NULL;
+			const DeviceState& device = openedDevices[i];
+			int slot = devices.add(device);
+			if (device.instanceId <= -2)
+				remoteSlots[-2 - device.instanceId] = slot;
+			if (traceRecorder.isRecording())
+				traceRecorder.recordAttach(slot, devices.device(slot));
 		}
+		openedDevices.clear();
 	}
-	else
-		activeJoystick = SDL_JoystickOpen(deviceIndex);
+	processor.installMapping(mapping, devices);
+	resolveStelActions();
+	if (!sampler.isRunning())
+		startSampler();
+	return true;
+}
+
+void
+JoystickSupport::closeDevice(int slot)
+{
+	stopSampler();
+	if (traceRecorder.isRecording())
+		traceRecorder.recordDetach(slot);
+	devices.close(slot);
+	// The bindings of the other devices stay the same.
+	processor.removeDevices(devices);
+	startSampler();
+}
 
-	if (activeJoystick == NULL)
+void
+JoystickSupport::compileBindings()
+{
+	// The files may have been edited since they were last read.
+	QSettings* conf = StelApp::getInstance().getSettings();
+	if (QFile::exists(bindingsPath))
 	{
-		qWarning() << "JoystickSupport: unable to open device" << deviceIndex
-		           << SDL_GetError();
-		return false;
+		bindingStore->sync();
+		conf = bindingStore;
 	}
+	calibrationStore->sync();
+	processor.compileBindings(conf, devices);
+	resolveStelActions();
+}
 
-	// Initialize various "previous state" holders
-	hatStates.fill(SDL_HAT_CENTERED, SDL_JoystickNumHats(activeJoystick));
-	buttonStates.fill(false, SDL_JoystickNumButtons(activeJoystick));
+void
+JoystickSupport::startMappingWatcher()
+{
+	if (mappingWatcher)
+		return;
 
-	return true;
+	QSettings* conf = StelApp::getInstance().getSettings();
+	mappingCompiler.setFiles(bindingsPath, conf->fileName(),
+	                         calibrationStore->fileName());
+	mappingCompiler.setDefaultDeadzone(processor.getDefaultDeadzone());
+	mappingCompiler.start(QThread::LowPriority);
+
+	// The directory is watched for bindings.ini being created, and for
+	// files being replaced when saved.
+	mappingWatcher = new QFileSystemWatcher(this);
+	mappingWatcher->addPath(QFileInfo(bindingsPath).absolutePath());
+	watchMappingFiles();
+	connect(mappingWatcher, SIGNAL(fileChanged(QString)),
+	        this, SLOT(reloadMapping()));
+	connect(mappingWatcher, SIGNAL(directoryChanged(QString)),
+	        this, SLOT(reloadMapping()));
 }
 
 void
-JoystickSupport::closeDevice()
+JoystickSupport::watchMappingFiles()
 {
-	if (activeGamepad)
+	const QString paths[2] = {bindingsPath, calibrationStore->fileName()};
+	for (int i = 0; i < 2; i++)
 	{
-		SDL_GameControllerClose(activeGamepad);
-		activeGamepad = NULL;
+		if (QFile::exists(paths[i])
+		    && !mappingWatcher->files().contains(paths[i]))
+			mappingWatcher->addPath(paths[i]);
 	}
-	else if (activeJoystick)
-		SDL_JoystickClose(activeJoystick);
+}
 
-	activeJoystick = NULL;
+void
+JoystickSupport::reloadMapping()
+{
+	watchMappingFiles();
+	// Devices opened later read the files anyway.
+	if (!openedDevices.isEmpty())
+		requestMapping();
+	else if (!devices.isEmpty())
+		mappingCompiler.request(devices);
 }
 
-void JoystickSupport::handleJoystickAxes(StelCore* core)
+void
+JoystickSupport::replayFrame()
 {
-	Q_ASSERT(activeJoystick);
-	Q_ASSERT(core);
-	StelMovementMgr* movement = core->getMovementMgr();
+	TracePlayer::Record record;
+	bool frameEnded = false;
+	while (!frameEnded && tracePlayer.next(record, devices.current))
+	{
+		switch (record.type)
+		{
+		case TraceFormat::RecordAttach:
+			// Slots are assigned in the same order as when recording.
+			if (devices.openReplayed(record.caps, record.instanceId) != record.slot)
+				qWarning() << "JoystickSupport: trace replay out of sync";
+			compileBindings();
+			break;
+		case TraceFormat::RecordDetach:
+			closeDevice(record.slot);
+			break;
+		case TraceFormat::RecordSample:
+			processSnapshot(devices.current);
+			break;
+		case TraceFormat::RecordFrame:
+			// The movement follows the timestamps of the samples.
+			frameEnded = true;
+			break;
+		}
+	}
 
-	int axesCount = SDL_JoystickNumAxes(activeJoystick);
-	if (axesCount < 1)
-		return;
-	QVector<Sint16> axisValues(axesCount, 0);
-	for (int i = 0; i < axesCount; i++)
+	if (!devices.isEmpty())
 	{
-		axisValues[i] = SDL_JoystickGetAxis(activeJoystick, i);
+		processor.finishFrame();
+		processor.saveCalibrations(devices);
 	}
 
-	if (axesCount == 1) // Some kind of paddle?
+	if (!frameEnded)
 	{
-		interpretAsZooming(movement, axisValues[0]);
-		return;
+		qDebug() << "JoystickSupport: finished replaying input trace";
+		while (!devices.isEmpty())
+			closeDevice(devices.slot(0));
+		tracePlayer.close();
+		// Live devices are used from now on.
+		devicesChanged = true;
+		startRemoteInput();
+		startMappingWatcher();
+		processor.setCalibrationStore(calibrationStore);
+		if (latencyStatsEnabled)
+			processor.setLatencyStats(&latencyStats);
 	}
+}
+
+void
+JoystickSupport::handleDeviceDetached(int instanceId)
+{
+	int slot = devices.findSlot(instanceId);
+	if (slot >= 0)
+		closeDevice(slot);
+	else if (dropOpenedDevice(instanceId))
+		requestMapping();
+}
+
+void
+JoystickSupport::startSampler()
+{
+	if (devices.isEmpty() || tracePlayer.isOpen())
+		return;
 
-	if (axesCount >= 2) // Two axes, assuming 0==X, 1==Y, negative is left/up.
+	// Motion sensors are read by the sampler, at least as often as they
+	// measure, even if the devices are otherwise read once per frame.
+	int rate = samplingRate;
+	if (gyroPointing)
 	{
-		interpretAsHorizontalMovement(movement, axisValues[0]);
-		interpretAsVerticalMovement(movement, axisValues[1]);
+		float motionRate = devices.enableMotionSensors();
+		if (motionRate == 0.f)
+			motionRate = DefaultMotionRate;
+		rate = qMax(rate, qRound(motionRate));
+	}
+	if (rate <= 0)
+		return;
+	if (rate != sampler.getRate())
+	{
+		sampler.setRate(rate);
+		qDebug() << "JoystickSupport: sampling devices in the background at"
+		         << sampler.getRate() << "Hz";
 	}
 
-	if (axesCount >= 3) // Third axis is assumed to be a throttle.
-		interpretAsZooming(movement, axisValues[2]);
+	sampler.setDevices(&devices);
+	sampler.setIdle(idle);
+	sampler.start(QThread::HighPriority);
 }
 
 void
-JoystickSupport::handleJoystickButtons(StelCore* core)
+JoystickSupport::stopSampler()
 {
-	Q_ASSERT(activeJoystick);
-	Q_ASSERT(core);
-	StelMovementMgr* movement = core->getMovementMgr();
+	if (!sampler.isRunning())
+		return;
+
+	sampler.stop();
+	int dropped = sampler.getDroppedCount();
+	if (dropped > 0)
+		qDebug() << "JoystickSupport: the sampler dropped" << dropped
+		         << "samples because frames took too long.";
+}
+
+void
+JoystickSupport::setIdle(bool idle)
+{
+	if (idle == this->idle)
+		return;
+	this->idle = idle;
+	sampler.setIdle(idle);
+	if (idle)
+		nextIdleCheck = SDL_GetPerformanceCounter()
+		                + SDL_GetPerformanceFrequency() / IdleDetector::CheckRate;
+}
+
+void
+JoystickSupport::startRemoteInput()
+{
+	if (remoteInput.getPort() == 0 || remoteInput.isRunning()
+	    || tracePlayer.isOpen())
+		return;
 
-	for (int i = 0; i < buttonStates.count(); i++)
+	remoteInput.reset();
+	for (int i = 0; i < RemoteFormat::MaxSources; i++)
 	{
-		bool state = (SDL_JoystickGetButton(activeJoystick, i) == 1);
-		bool prevState = buttonStates[i];
+		if (remoteSlots[i] == -3)
+			dropOpenedDevice(-2 - i);
+		remoteSlots[i] = -1;
+	}
+	remoteInput.start(QThread::HighPriority);
+	qDebug() << "JoystickSupport: receiving remote input on UDP port"
+	         << remoteInput.getPort();
+}
+
+void
+JoystickSupport::stopRemoteInput()
+{
+	if (!remoteInput.isRunning())
+		return;
+
+	remoteInput.stop();
+	qDebug() << "JoystickSupport: received" << remoteInput.getAcceptedCount()
+	         << "remote input datagrams, dropped"
+	         << remoteInput.getDroppedCount(RemoteInputServer::DropStale)
+	         << "stale,"
+	         << remoteInput.getDroppedCount(RemoteInputServer::DropOutOfOrder)
+	         << "out of order,"
+	         << remoteInput.getDroppedCount(RemoteInputServer::DropMalformed)
+	         << "malformed and"
+	         << remoteInput.getDroppedCount(RemoteInputServer::DropOverflow)
+	         << "because frames took too long.";
+}
 
-		// Some buttons trigger one-time events, others control a state.
-		switch (i)
+bool
+JoystickSupport::handleRemoteEvent(const RemoteInputServer::Event& event)
+{
+	int& slot = remoteSlots[event.source];
+	// Negative IDs don't clash with SDL's.
+	const SDL_JoystickID instanceId = -2 - event.source;
+	if (event.type == RemoteInputServer::Event::EventDisconnect)
+	{
+		bool changed = false;
+		if (slot >= 0)
 		{
-		case 0: // Triggers mounting change
-			if (state != prevState)
-			{
-				if (!state) // Released after pressing
-					movement->toggleMountMode();
-			}
-			break;
-		case 1: // Slow movement mode
-			movement->moveSlow(state);
-			break;
-		default:
-			break;
+			qDebug() << "JoystickSupport: remote device" << event.source
+			         << "disconnected";
+			closeDevice(slot);
+			changed = true;
 		}
+		else if (slot == -3 && dropOpenedDevice(instanceId))
+		{
+			requestMapping();
+			changed = true;
+		}
+		slot = -1;
+		return changed;
+	}
 
-		buttonStates[i] = state;
+	// The sender may have switched to a different device.
+	bool changed = false;
+	if (slot >= 0 && !event.matches(devices.device(slot).caps))
+	{
+		closeDevice(slot);
+		slot = -1;
+		changed = true;
+	}
+	if (slot == -3)
+	{
+		int i = findOpenedDevice(instanceId);
+		if (i < 0 || !event.matches(openedDevices[i].caps))
+		{
+			dropOpenedDevice(instanceId);
+			slot = -1;
+			changed = true;
+		}
+	}
+	if (slot == -1)
+	{
+		// Added to the devices with its mapping, like a local device
+		// opened by #descriptorCache. Until then, only its last state
+		// is kept.
+		DeviceCapabilities caps;
+		event.getCapabilities(caps);
+		DeviceState device;
+		device.openReplayed(caps, instanceId);
+		openedDevices.append(device);
+		slot = -3;
+		qDebug() << "JoystickSupport: remote device" << event.source
+		         << "connected";
+		requestMapping();
+		changed = true;
 	}
+	remoteStates[event.source] = event;
+	if (slot < 0)
+		return changed;
+
+	event.read(devices.current, slot);
+	// The motion of trackballs and devices was counted in the previous
+	// snapshot, and the movement is integrated up to it.
+	memset(devices.current.balls, 0, sizeof(devices.current.balls));
+	memset(devices.current.motion, 0, sizeof(devices.current.motion));
+	devices.current.timestamp = qMax(event.timestamp,
+	                                 devices.previous.timestamp);
+	processSnapshot(devices.current);
+	return changed;
 }
 
 void
-JoystickSupport::handleJoystickHats(StelCore* core)
+JoystickSupport::restoreRemoteState(InputSnapshot& state) const
 {
-	Q_ASSERT(activeJoystick);
-	Q_ASSERT(core);
-	StelMovementMgr* movement = core->getMovementMgr();
-	for (int i = 0; i < hatStates.count(); i++)
+	for (int i = 0; i < RemoteFormat::MaxSources; i++)
 	{
-		Uint8 state = SDL_JoystickGetHat(activeJoystick, i);
-
-		// This results in discrete movement (one button press, one step) :))
-//		if (hatStates[i] == state)
-//			continue;
+		if (remoteSlots[i] >= 0)
+			remoteStates[i].read(state, remoteSlots[i]);
+	}
+}
 
-		switch (state)
+bool
+JoystickSupport::processInput()
+{
+	bool changed = false;
+	RemoteInputServer::Event event;
+	bool haveEvent = remoteInput.popEvent(event);
+	if (!sampler.isRunning())
+	{
+		// Everything received so far arrived before the devices are read.
+		for (; haveEvent; haveEvent = remoteInput.popEvent(event))
+			changed |= handleRemoteEvent(event);
+		if (!devices.isEmpty())
 		{
-		case SDL_HAT_UP:
-			movement->turnUp(true);
-			break;
-		case SDL_HAT_DOWN:
-			movement->turnDown(true);
-			break;
-		case SDL_HAT_LEFT:
-			movement->turnLeft(true);
-			break;
-		case SDL_HAT_RIGHT:
-			movement->turnRight(true);
-			break;
-		case SDL_HAT_LEFTUP:
-			movement->turnUp(true);
-			movement->turnLeft(true);
-			break;
-		case SDL_HAT_LEFTDOWN:
-			movement->turnDown(true);
-			movement->turnLeft(true);
-			break;
-		case SDL_HAT_RIGHTUP:
-			movement->turnUp(true);
-			movement->turnRight(true);
-			break;
-		case SDL_HAT_RIGHTDOWN:
-			movement->turnDown(true);
-			movement->turnRight(true);
-			break;
-		case SDL_HAT_CENTERED:
-		default:
-			// Only clear the flags if the hat has changed them previously
-			// (otherwise this overwrites changes made by e.g. axis movements)
-			if (hatStates[i] == state)
-				continue;
-			movement->turnUp(false);
-			movement->turnDown(false);
-			movement->turnLeft(false);
-			movement->turnRight(false);
+			devices.read(devices.current);
+			restoreRemoteState(devices.current);
+			processSnapshot(devices.current);
 		}
+		return changed;
+	}
 
-		hatStates[i] = state;
+	// All samples since the last frame are processed in order, so button
+	// presses shorter than a frame are not lost. The remote input is merged
+	// with them by the time of arrival.
+	InputSnapshot sample;
+	bool haveSample = sampler.popSample(sample);
+	while (haveEvent || haveSample)
+	{
+		if (haveEvent && (!haveSample || event.timestamp <= sample.timestamp))
+		{
+			changed |= handleRemoteEvent(event);
+			haveEvent = remoteInput.popEvent(event);
+		}
+		else
+		{
+			devices.current = sample;
+			restoreRemoteState(devices.current);
+			processSnapshot(devices.current);
+			haveSample = sampler.popSample(sample);
+		}
 	}
+	return changed;
 }
 
 void
-JoystickSupport::handleGamepad(StelCore* core)
+JoystickSupport::processSnapshot(const InputSnapshot& state)
 {
-	Q_ASSERT(activeGamepad);
-	Q_ASSERT(core);
-	StelMovementMgr* movement = core->getMovementMgr();
+	if (traceRecorder.isRecording())
+		traceRecorder.recordSample(devices, state);
+	processor.processSnapshot(devices, state);
+}
 
-	// Axes (before buttons, because I haven't fixed the order bug)
-	Sint16 value = SDL_GameControllerGetAxis(activeGamepad,
-	                                         SDL_CONTROLLER_AXIS_LEFTX);
-	interpretAsHorizontalMovement(movement, value);
-	value = SDL_GameControllerGetAxis(activeGamepad, SDL_CONTROLLER_AXIS_LEFTY);
-	interpretAsVerticalMovement(movement, value);
-	value = SDL_GameControllerGetAxis(activeGamepad,
-	                                  SDL_CONTROLLER_AXIS_RIGHTY);
-	interpretAsZooming(movement, value);
-
-
-	// Buttons
-	bool state, changed;
-	getButtonStateChange(SDL_CONTROLLER_BUTTON_DPAD_UP, state, changed);
-	if (state)
-		movement->turnUp(true);
-	else if (changed)
-		movement->turnUp(false);
-
-	getButtonStateChange(SDL_CONTROLLER_BUTTON_DPAD_DOWN, state, changed);
-	if (state)
-		movement->turnDown(true);
-	else if (changed)
-		movement->turnDown(false);
-
-	getButtonStateChange(SDL_CONTROLLER_BUTTON_DPAD_LEFT, state, changed);
-	if (state)
-		movement->turnLeft(true);
-	else if (changed)
-		movement->turnLeft(false);
-
-	getButtonStateChange(SDL_CONTROLLER_BUTTON_DPAD_RIGHT, state, changed);
-	if (state)
-		movement->turnRight(true);
-	else if (changed)
-		movement->turnRight(false);
-
-
-	// == Cross
-	getButtonStateChange(SDL_CONTROLLER_BUTTON_A, state, changed);
-	if (state && changed)
+void
+JoystickSupport::performAction(int actionId, bool active)
+{
+	AllocationCounter::Suspender outsideThePlugin;
+	StelCore* core = StelApp::getInstance().getCore();
+	StelMovementMgr* movement = core->getMovementMgr();
+	switch (actionId)
+	{
+	case ActionToggleMountMode:
 		movement->toggleMountMode();
-
-	// == Circle
-	bool pressed;
-	getButtonStateChange(SDL_CONTROLLER_BUTTON_B, pressed, changed);
-	getButtonStateChange(SDL_CONTROLLER_BUTTON_LEFTSTICK, state, changed);
-	pressed |= state;
-	getButtonStateChange(SDL_CONTROLLER_BUTTON_RIGHTSTICK, state, changed);
-	pressed |= state;
-	movement->moveSlow(pressed);
-
-	// == Square
-	getButtonStateChange(SDL_CONTROLLER_BUTTON_X, state, changed);
-	if (state && changed)
+		break;
+	case ActionAutoZoomIn:
+		movement->autoZoomIn();
+		break;
+	case ActionAutoZoomOut:
 		movement->autoZoomOut();
-	// == Triangle
-	getButtonStateChange(SDL_CONTROLLER_BUTTON_Y, state, changed);
-	if (state && changed)
+		break;
+	case ActionSetTimeNow:
 		core->setTimeNow();
-
-
-	getButtonStateChange(SDL_CONTROLLER_BUTTON_LEFTSHOULDER, state, changed);
-	if (state && changed)
-		core->decreaseTimeSpeed();
-
-	getButtonStateChange(SDL_CONTROLLER_BUTTON_RIGHTSHOULDER, state, changed);
-	if (state && changed)
+		break;
+	case ActionIncreaseTimeSpeed:
 		core->increaseTimeSpeed();
+		break;
+	case ActionDecreaseTimeSpeed:
+		core->decreaseTimeSpeed();
+		break;
+	case ActionSetRealTimeSpeed:
+		core->setRealTimeSpeed();
+		break;
+	case ActionSetZeroTimeSpeed:
+		core->setZeroTimeSpeed();
+		break;
+	case ActionDumpLatencyStats:
+		dumpLatencyStats();
+		break;
+	default:
+#if !(STELLARIUM_VERSION_MAJOR == 0 && STELLARIUM_VERSION_MINOR < 13)
+	{
+		int index = actionId - BuiltinActionCount;
+		if (index < 0 || index >= stelActions.count() || !stelActions[index])
+			break;
+		StelAction* action = stelActions[index];
+		// A held button keeps a checkable action checked, e.g. for showing
+		// a grid only while the button is held.
+		if (action->isCheckable()
+		    && processor.getBindings().isHeldAction(actionId))
+			action->setChecked(active);
+		else if (active)
+			action->trigger();
+	}
+#endif
+		break;
+	}
 }
 
 void
-JoystickSupport::getButtonStateChange(const SDL_GameControllerButton& button,
-                                      bool& state,
-                                      bool& changed)
+JoystickSupport::resolveStelActions()
 {
-	state = SDL_GameControllerGetButton(activeGamepad, button);
-	changed = (gamepadStates[button] != state);
-	gamepadStates[button] = state;
+	const BindingTable& bindings = processor.getBindings();
+	stelActions.fill(NULL, bindings.getActionCount() - BuiltinActionCount);
+#if !(STELLARIUM_VERSION_MAJOR == 0 && STELLARIUM_VERSION_MINOR < 13)
+	StelActionMgr* actionMgr = StelApp::getInstance().getStelActionManager();
+	for (int i = 0; i < stelActions.count(); i++)
+	{
+		QString name = bindings.getActionName(BuiltinActionCount + i);
+		stelActions[i] = actionMgr->findAction(name);
+		if (stelActions[i] == NULL)
+			qWarning() << "JoystickSupport: unknown action in bindings:" << name;
+	}
+#else
+	if (!stelActions.isEmpty())
+		qWarning() << "JoystickSupport: this version of Stellarium"
+		           << "doesn't support binding StelActions.";
+#endif
 }
 
 void
-JoystickSupport::interpretAsHorizontalMovement(StelMovementMgr* movement,
-                                               const Sint16& xAxis)
+JoystickSupport::setMovementFlag(int actionId, bool active)
 {
-	if (xAxis < -axisThreshold)
-		movement->turnLeft(true);
-	else if (xAxis > axisThreshold)
-		movement->turnRight(true);
-	else
+	AllocationCounter::Suspender outsideThePlugin;
+	StelMovementMgr* movement = StelApp::getInstance().getCore()->getMovementMgr();
+	switch (actionId)
 	{
-		movement->turnLeft(false);
-		movement->turnRight(false);
+	case ActionTurnUp:
+		movement->turnUp(active);
+		break;
+	case ActionTurnDown:
+		movement->turnDown(active);
+		break;
+	case ActionTurnLeft:
+		movement->turnLeft(active);
+		break;
+	case ActionTurnRight:
+		movement->turnRight(active);
+		break;
+	case ActionZoomIn:
+		movement->zoomIn(active);
+		break;
+	case ActionZoomOut:
+		movement->zoomOut(active);
+		break;
+	case ActionMoveSlow:
+		movement->moveSlow(active);
+		break;
 	}
 }
 
+double
+JoystickSupport::getCurrentFov()
+{
+	AllocationCounter::Suspender outsideThePlugin;
+	return StelApp::getInstance().getCore()->getMovementMgr()->getCurrentFov();
+}
+
 void
-JoystickSupport::interpretAsVerticalMovement(StelMovementMgr* movement,
-                                             const Sint16& yAxis)
+JoystickSupport::panView(double deltaAz, double deltaAlt)
 {
-	if (yAxis < -axisThreshold)
-		movement->turnUp(true);
-	else if (yAxis > axisThreshold)
-		movement->turnDown(true);
-	else
-	{
-		movement->turnUp(false);
-		movement->turnDown(false);
-	}
+	AllocationCounter::Suspender outsideThePlugin;
+	StelApp::getInstance().getCore()->getMovementMgr()->panView(deltaAz, deltaAlt);
 }
 
 void
-JoystickSupport::interpretAsZooming(StelMovementMgr* movement,
-                                    const Sint16& zoomAxis)
+JoystickSupport::changeFov(double deltaFov)
 {
-	if (zoomAxis < -axisThreshold)
-		movement->zoomIn(true);
-	else if (zoomAxis > axisThreshold)
-		movement->zoomOut(true);
-	else
-	{
-		movement->zoomIn(false);
-		movement->zoomOut(false);
-	}
+	AllocationCounter::Suspender outsideThePlugin;
+	StelApp::getInstance().getCore()->getMovementMgr()->changeFov(deltaFov);
 }
@@ -29,8 +29,22 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <QVector>
 
 #include "StelModule.hpp"
+#include "DeviceDescriptorCache.hpp"
+#include "DeviceManager.hpp"
+#include "DeviceSet.hpp"
+#include "GamepadDatabase.hpp"
+#include "InputProcessor.hpp"
+#include "InputSampler.hpp"
+#include "LatencyHistogram.hpp"
+#include "MappingCompiler.hpp"
+#include "MovementSink.hpp"
+#include "RemoteInputServer.hpp"
+#include "TracePlayer.hpp"
+#include "TraceRecorder.hpp"
 
-class StelCore;
+class QFileSystemWatcher;
+class QSettings;
+class StelAction;
 class StelMovementMgr;
 
 //! Main class of the Joystick Support plug-in.
@@ -40,9 +54,12 @@ class StelMovementMgr;
 //! button presses, axis moves and other events into the appropriate Stellarium
 //! actions.
 //!
-//! For now this includes only panning and zooming the view,
-//! making movements more precise/slow and switching between mount modes.
-class JoystickSupport : public StelModule
+//! All connected devices (up to DeviceSet::MaxDevices) are used at the same
+//! time, e.g. a stick, a throttle and rudder pedals. Devices of another
+//! computer, received by a RemoteInputServer, are used in the same way.
+//! Their input is translated by an InputProcessor, for which this class acts
+//! as a MovementSink forwarding everything to Stellarium.
+class JoystickSupport : public StelModule, private MovementSink
 {
 	Q_OBJECT
 
@@ -55,91 +72,190 @@ public:
 	virtual void update(double deltaTime);
 	virtual bool configureGui(bool show);
 
-	//! Loads the SDL game controller database if such file exists.
+	//! Loads the SDL game controller database embedded in the plug-in and,
+	//! if such file exists, a user copy that takes precedence over it.
 	//! The file is expexted to be called "gamecontrollerdb.txt" and to be found
 	//! in the modules/JoystickSupport/ sub-directory - either of Stellarium's
 	//! installation directory, or the user data directory.
+	//! Both are indexed by GamepadDatabase, and mappings are passed to SDL
+	//! only for the devices that are connected.
 	//! @returns true if the file was found successfully, even if parsing it
 	//! failed.
 	bool loadGamepadDatabase();
 
+	//! Writes the latency statistics to the log and, if "latency_stats_file"
+	//! is set, appends them to that file. Does nothing if the statistics
+	//! are not enabled with "latency_stats".
+	void dumpLatencyStats();
+
+signals:
+	//! Emitted when a device is connected. Not emitted for the devices
+	//! that are already connected when the plug-in is initialized.
+	void deviceAttached(int instanceId, const QString& name);
+	//! Emitted when a device is disconnected.
+	void deviceDetached(int instanceId);
+
+private slots:
+	//! Closes the disconnected device if it's open.
+	void handleDeviceDetached(int instanceId);
+	//! Recompiles the bindings and calibrations in the background after
+	//! their files have changed.
+	void reloadMapping();
+
 private:
-	//! Lists all connected devices and their properties in the log.
-	//! Mostly a debugging function.
-	void printDeviceDescriptions();
-
-	//! Makes the selected device the currently active device.
-	//! Populates the necessary fields. If a device is active, it's closed,
-	//! even if it's the same one. If the device cannot be opened,
-	//! #activeJoystick is set to null.
-	//! @param deviceIndex is the logical device index as used in SDL.
-	bool openDevice(int deviceIndex);
-	//! Closes the currently active device, e.g. because it's disconnected.
-	void closeDevice();
-
-	//! Reads the current state of joystick axes and acts accordingly.
-	//! Requires an open device in #activeJoystick.
-	void handleJoystickAxes(StelCore* core);
-	//! Reads the current state of joystick balls and acts accordingly.
-	//! @warning Not implemented, as I have no way to test it.
-	void handleJoystickBalls(StelCore* core);
-	//! Reads the current state of joystick buttons and acts accordingly.
-	//! Requires an open device in #activeJoystick.
-	void handleJoystickButtons(StelCore* core);
-	//! Reads the current state of joystick hat switches and acts accordingly.
-	//! Gamepad direction buttons (the up/down/left/right quartet) are
-	//! often interpreted as hat switches.
-	//! Requires an open device in #activeJoystick.
-	void handleJoystickHats(StelCore* core);
-
-	//! Reads the current state of gamepad controlls and acts accordingly.
-	//! @warning Calling this is mutually exclusive with the above functions.
-	//! As a result, joystick trackballs won't be handled natively.
-	// NOTE: Temporary, until I figure out how to add my own layer of bindings.
-	void handleGamepad(StelCore* core);
-
-	//! Helper function reading the state of gamepad buttons.
-	void getButtonStateChange(const SDL_GameControllerButton& button,
-	                          bool& state,
-	                          bool& changed);
-
-	//! Interprets an axis value as indicating horizontal movement direction.
-	//! This means azimuth or right ascension depending on the mount mode.
-	//! Negative is left (counterclockwise), positivive is right (clockwise).
-	void interpretAsHorizontalMovement(StelMovementMgr* movement,
-	                                   const Sint16& xAxis);
-	//! Interprets an axis value as indicating vertical movement direction.
-	//! This means altitude or declination depending on the mount mode.
-	//! Negative is "up", positive is "down".
-	void interpretAsVerticalMovement(StelMovementMgr* movement,
-	                                 const Sint16& yAxis);
-	//! Interprets an axis value as indicating zooming direction (in or out).
-	void interpretAsZooming(StelMovementMgr* movement, const Sint16& zoomAxis);
+	//! Asks #descriptorCache to open all connected devices that are
+	//! not open yet.
+	void openDevices();
+	//! Moves the devices opened by #descriptorCache to #openedDevices and
+	//! asks for their mapping.
+	//! @returns true if there were any.
+	bool takeOpenedDevices();
+	//! @returns the position of a device in #openedDevices, or -1.
+	int findOpenedDevice(SDL_JoystickID instanceId) const;
+	//! Closes a device in #openedDevices and removes it from the list.
+	//! @returns false if it's not there.
+	bool dropOpenedDevice(SDL_JoystickID instanceId);
+	//! Asks #mappingCompiler for the mapping of the open devices together
+	//! with #openedDevices, dropping the ones that have been disconnected
+	//! or don't fit.
+	void requestMapping();
+	//! Installs a mapping compiled in the background, adding #openedDevices
+	//! to #devices if it was compiled for them.
+	//! @returns false if it was compiled for other devices (and a new one
+	//! has been requested).
+	bool installMapping(InputMapping& mapping);
+	//! Closes an open device, e.g. because it's disconnected. The bindings
+	//! are not compiled again.
+	//! @param slot is the device's slot in #devices.
+	void closeDevice(int slot);
+	//! Processes the records of the replayed trace up to the end of the next
+	//! frame, in place of reading the devices.
+	//! Closes the trace and switches to live input at its end.
+	void replayFrame();
+	//! Compiles the bindings of #processor for all open devices and finds
+	//! the StelActions they reference. Reads the files in the calling
+	//! thread, so it's used only for replayed devices.
+	void compileBindings();
+	//! Starts watching the files of the bindings and calibrations and
+	//! the thread that recompiles them.
+	void startMappingWatcher();
+	//! Watches the files that exist and are not watched yet, e.g. because
+	//! they were replaced when saved.
+	void watchMappingFiles();
+
+	//! Starts the background sampler for the open devices, if enabled.
+	void startSampler();
+	//! Stops the background sampler. Must be called before any device
+	//! is opened or closed or any other thread touches them.
+	void stopSampler();
+	//! Switches between checking the devices in every frame (or sample)
+	//! and only IdleDetector::CheckRate times per second.
+	void setIdle(bool idle);
+
+	//! Starts receiving remote input, if enabled.
+	void startRemoteInput();
+	//! Stops receiving remote input. The remote devices are left open.
+	void stopRemoteInput();
+	//! Opens, updates or closes a remote device. A new state is processed
+	//! as a snapshot of its own, with the local devices as they were.
+	//! @returns true if a device was opened or closed.
+	bool handleRemoteEvent(const RemoteInputServer::Event& event);
+	//! Puts the last received state of the remote devices into a snapshot
+	//! of the local ones.
+	void restoreRemoteState(InputSnapshot& state) const;
+
+	//! Reads the devices (or the samples since the last frame) and
+	//! the remote input and processes them in the order of their timestamps.
+	//! @returns true if a device was opened or closed.
+	bool processInput();
+	//! Records a snapshot of the state of all devices, if recording,
+	//! and passes it to #processor.
+	void processSnapshot(const InputSnapshot& state);
+
+	// MovementSink, implemented with StelMovementMgr and StelCore.
+	virtual void performAction(int actionId, bool active);
+	virtual void setMovementFlag(int actionId, bool active);
+	virtual double getCurrentFov();
+	virtual void panView(double deltaAz, double deltaAlt);
+	virtual void changeFov(double deltaFov);
+	//! Finds the StelActions referenced by the bindings.
+	void resolveStelActions();
 
 	//! True if SDL was initialized correctly, if not - disables the plugin.
 	bool initialized;
 
-	// Temporary flag - prevents repeated output of device descriptions.
-	bool devicesDescribed;
-
-	//! The current active device, null if none is opened.
-	SDL_Joystick* activeJoystick;
-	//! The currently active gamepad, null if the active device is not one.
-	//! A value implies that #activeJoystick is not null and contains
-	//! the underlying joystick device.
-	SDL_GameController* activeGamepad;
-
-	//! For now, threshold/deadzone for all joystick axes.
-	//! Axis values in the interval [-threshold;threshold] are ignored.
-	Sint16 axisThreshold;
-
-	//! State of the hat(s) on the previous update.
-	QVector<Uint8> hatStates;
-	//! State of the button(s) on the previous update.
-	QVector<bool> buttonStates;
-	//! State of the gamepad buttons on the previous update.
-	// NOTE: Temporary. It would be easier to remove later.
-	QVector<bool> gamepadStates;
+	//! The user's copy of the game controller database, if there is one.
+	GamepadDatabase gamepadDatabase;
+	//! The copy of the database embedded in the plug-in, indexed in memory.
+	GamepadDatabase embeddedDatabase;
+	//! Table of connected devices, updated by SDL device events.
+	DeviceManager deviceManager;
+
+	//! Set when devices are connected or disconnected, so any new ones
+	//! are opened in the next update().
+	bool devicesChanged;
+	//! Opens the new devices in the background and logs their descriptions.
+	DeviceDescriptorCache descriptorCache;
+	//! Devices opened by #descriptorCache, and remote devices, waiting for
+	//! the mapping compiled for them. They are added to #devices together
+	//! with it, so compiling never holds up a frame.
+	QVector<DeviceState> openedDevices;
+	//! The open devices, their capabilities and their last states.
+	DeviceSet devices;
+
+	//! Translates the input into movement and actions.
+	InputProcessor processor;
+	//! StelActions referenced by the bindings, in the order of their IDs
+	//! (starting from BuiltinActionCount). Null if not found.
+	QVector<StelAction*> stelActions;
+
+	//! Background polling thread, used if #samplingRate is not zero.
+	InputSampler sampler;
+	//! Rate of background sampling in Hz, read from the configuration.
+	//! If zero, the devices are read once per frame in update().
+	int samplingRate;
+	//! If true, game controllers with motion sensors point the view, and
+	//! the sampler runs at least at the rate of their readings.
+	bool gyroPointing;
+	//! Sampling rate used for motion sensors whose rate SDL doesn't report.
+	enum { DefaultMotionRate = 250 };
+	//! True while no device is used (or there are none), see setIdle().
+	bool idle;
+	//! Value of SDL_GetPerformanceCounter() at which the idle devices are
+	//! checked next.
+	Uint64 nextIdleCheck;
+
+	//! Receives the input of remote devices if "remote_input_port" is set.
+	RemoteInputServer remoteInput;
+	//! Slot of each remote device in #devices, -1 if it's not open, -2
+	//! if it can't be opened (until it disconnects) and -3 while it's
+	//! waiting in #openedDevices.
+	int remoteSlots[RemoteFormat::MaxSources];
+	//! Last received state of each remote device.
+	RemoteInputServer::Event remoteStates[RemoteFormat::MaxSources];
+
+	//! Records the input if "trace_record" is set in the configuration.
+	TraceRecorder traceRecorder;
+	//! Replays a recorded trace if "trace_replay" is set in the configuration.
+	TracePlayer tracePlayer;
+
+	//! Calibration of the devices, read from and written to
+	//! "calibration.ini" in the plug-in's directory.
+	QSettings* calibrationStore;
+	//! Bindings read from "bindings.ini" in the plug-in's directory, used
+	//! instead of the ones in Stellarium's configuration if it exists.
+	QSettings* bindingStore;
+	QString bindingsPath;
+	//! Notices when the bindings or calibrations are edited.
+	QFileSystemWatcher* mappingWatcher;
+	//! Recompiles them without holding up the frames.
+	MappingCompiler mappingCompiler;
+
+	//! Input latency and frame time, collected if "latency_stats" is set.
+	LatencyStats latencyStats;
+	bool latencyStatsEnabled;
+	//! File to which dumpLatencyStats() appends, may be empty.
+	QString latencyStatsPath;
 };
 
 
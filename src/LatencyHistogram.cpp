@@ -0,0 +1,149 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "LatencyHistogram.hpp"
+
+#include <climits>
+
+// Qt 4 has no explicit load operation on QAtomicInt.
+static inline int
+loadRelaxed(const QAtomicInt& value)
+{
+#if QT_VERSION >= 0x050000
+	return value.load();
+#else
+	return value;
+#endif
+}
+
+LatencyHistogram::LatencyHistogram() :
+    maximum(0)
+{
+	ticksPerMicrosecond = SDL_GetPerformanceFrequency() / 1000000.0;
+}
+
+void
+LatencyHistogram::add(int microseconds)
+{
+	if (microseconds < 0)
+		microseconds = 0;
+	counts[bucketOf(microseconds)].fetchAndAddRelaxed(1);
+	int previous = loadRelaxed(maximum);
+	while (microseconds > previous
+	       && !maximum.testAndSetRelaxed(previous, microseconds))
+		previous = loadRelaxed(maximum);
+}
+
+void
+LatencyHistogram::addTicks(Uint64 start, Uint64 end)
+{
+	double microseconds = (end > start) ? (end - start) / ticksPerMicrosecond
+	                                    : 0.0;
+	add(microseconds < INT_MAX ? int(microseconds) : INT_MAX);
+}
+
+void
+LatencyHistogram::reset()
+{
+	for (int i = 0; i < BucketCount; i++)
+		counts[i].fetchAndStoreRelaxed(0);
+	maximum.fetchAndStoreRelaxed(0);
+}
+
+LatencyHistogram::Summary
+LatencyHistogram::summarize() const
+{
+	// A copy, so the percentiles are consistent with the total.
+	int copy[BucketCount];
+	Summary summary;
+	summary.count = 0;
+	for (int i = 0; i < BucketCount; i++)
+	{
+		copy[i] = loadRelaxed(counts[i]);
+		summary.count += copy[i];
+	}
+	summary.max = loadRelaxed(maximum);
+
+	const int percentiles[3] = {50, 95, 99};
+	int* results[3] = {&summary.p50, &summary.p95, &summary.p99};
+	int bucket = 0;
+	int seen = 0;
+	for (int p = 0; p < 3; p++)
+	{
+		// Rank of the percentile, counting from 1.
+		qint64 rank = (qint64(summary.count) * percentiles[p] + 99) / 100;
+		while (bucket < BucketCount - 1 && seen + copy[bucket] < rank)
+			seen += copy[bucket++];
+		*results[p] = (summary.count == 0) ? 0
+		              : qMin(upperBound(bucket), summary.max);
+	}
+	return summary;
+}
+
+QString
+LatencyHistogram::format(const QString& name) const
+{
+	Summary s = summarize();
+	return QString("%1: %2 samples, p50 %3 us, p95 %4 us, p99 %5 us, max %6 us")
+	        .arg(name).arg(s.count).arg(s.p50).arg(s.p95).arg(s.p99)
+	        .arg(s.max);
+}
+
+int
+LatencyHistogram::bucketOf(int microseconds)
+{
+	if (microseconds < LinearBuckets)
+		return microseconds;
+	// The position of the highest bit selects the power of two (from 5),
+	// the three bits below it select the sub-bucket.
+	int exponent = 5;
+	while (exponent < 30 && (microseconds >> (exponent + 1)) != 0)
+		exponent++;
+	int subBucket = (microseconds >> (exponent - 3)) & (SubBuckets - 1);
+	return LinearBuckets + (exponent - 5) * SubBuckets + subBucket;
+}
+
+int
+LatencyHistogram::upperBound(int bucket)
+{
+	if (bucket < LinearBuckets)
+		return bucket;
+	int exponent = 5 + (bucket - LinearBuckets) / SubBuckets;
+	int subBucket = (bucket - LinearBuckets) % SubBuckets;
+	qint64 bound = (qint64(SubBuckets + subBucket + 1) << (exponent - 3)) - 1;
+	return bound < INT_MAX ? int(bound) : INT_MAX;
+}
+
+void
+LatencyStats::reset()
+{
+	buttons.reset();
+	axes.reset();
+	frames.reset();
+}
+
+QStringList
+LatencyStats::format() const
+{
+	QStringList lines;
+	lines << buttons.format("buttons to actions")
+	      << axes.format("axes to movement")
+	      << frames.format("frame CPU time");
+	return lines;
+}
@@ -0,0 +1,110 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef LATENCY_HISTOGRAM_HPP
+#define LATENCY_HISTOGRAM_HPP
+
+#ifndef SDL_MAIN_HANDLED
+#define SDL_MAIN_HANDLED
+#endif
+#include "SDL.h"
+
+#include <QAtomicInt>
+#include <QStringList>
+
+//! Distribution of durations in microseconds, in fixed buckets.
+//!
+//! Durations up to 32 us have a bucket each; above that, each power of two
+//! is split into 8 buckets, so percentiles are accurate to 12.5%.
+//! add() is wait-free and never allocates, and summarize() can be called
+//! from any thread while durations are being added.
+class LatencyHistogram
+{
+public:
+	enum
+	{
+		LinearBuckets = 32,
+		SubBuckets = 8,
+		BucketCount = LinearBuckets + 26 * SubBuckets
+	};
+
+	struct Summary
+	{
+		int count;
+		//! Upper bounds of the buckets containing the percentiles.
+		int p50;
+		int p95;
+		int p99;
+		int max;
+	};
+
+	LatencyHistogram();
+
+	void add(int microseconds);
+	//! Adds the time between two values of SDL_GetPerformanceCounter().
+	void addTicks(Uint64 start, Uint64 end);
+	void reset();
+	Summary summarize() const;
+	//! One line with the summary, prefixed with @p name.
+	QString format(const QString& name) const;
+
+	//! Adds the time until the end of the scope, if the histogram is not NULL.
+	class Timer
+	{
+	public:
+		Timer(LatencyHistogram* histogram) :
+		    histogram(histogram),
+		    start(histogram ? SDL_GetPerformanceCounter() : 0) {}
+		~Timer()
+		{
+			if (histogram)
+				histogram->addTicks(start, SDL_GetPerformanceCounter());
+		}
+	private:
+		LatencyHistogram* histogram;
+		Uint64 start;
+	};
+
+private:
+	static int bucketOf(int microseconds);
+	static int upperBound(int bucket);
+
+	QAtomicInt counts[BucketCount];
+	QAtomicInt maximum;
+	//! SDL_GetPerformanceFrequency() in ticks per microsecond.
+	double ticksPerMicrosecond;
+};
+
+//! The histograms kept when the latency_stats option is enabled.
+struct LatencyStats
+{
+	//! From reading a sample to the action or movement flag it triggers.
+	LatencyHistogram buttons;
+	//! From reading a sample in which the axes moved to the resulting
+	//! pan or zoom.
+	LatencyHistogram axes;
+	//! CPU time spent by the plug-in in each frame.
+	LatencyHistogram frames;
+
+	void reset();
+	//! One line per histogram.
+	QStringList format() const;
+};
+
+#endif//LATENCY_HISTOGRAM_HPP
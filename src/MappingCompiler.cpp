@@ -0,0 +1,128 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "MappingCompiler.hpp"
+
+#include <QFile>
+#include <QSettings>
+
+MappingCompiler::MappingCompiler() :
+    defaultDeadzone(0.15f),
+    stopRequested(0),
+    devicesChanged(0),
+    pendingRequest(NULL),
+    result(NULL)
+{
+	//
+}
+
+MappingCompiler::~MappingCompiler()
+{
+	stop();
+}
+
+void
+MappingCompiler::setFiles(const QString& bindingsPath,
+                          const QString& configPath,
+                          const QString& calibrationPath)
+{
+	Q_ASSERT(!isRunning());
+	this->bindingsPath = bindingsPath;
+	this->configPath = configPath;
+	this->calibrationPath = calibrationPath;
+}
+
+void
+MappingCompiler::request(const DeviceSet& devices, bool devicesChanged)
+{
+	InputMapping* mapping = new InputMapping();
+	mapping->describe(devices);
+	// Set first, so it's seen with the request (or an earlier one, which
+	// only compiles it sooner).
+	if (devicesChanged)
+		this->devicesChanged.fetchAndStoreRelease(1);
+	delete pendingRequest.fetchAndStoreRelease(mapping);
+	wakeUp.release();
+}
+
+void
+MappingCompiler::stop()
+{
+	if (isRunning())
+	{
+		stopRequested.fetchAndStoreOrdered(1);
+		wakeUp.release();
+		wait();
+		stopRequested.fetchAndStoreOrdered(0);
+	}
+	devicesChanged.fetchAndStoreOrdered(0);
+	delete pendingRequest.fetchAndStoreAcquire(NULL);
+	delete result.fetchAndStoreAcquire(NULL);
+}
+
+void
+MappingCompiler::run()
+{
+	// What was compiled before the thread started was read from these.
+	lastContents = readFiles();
+	while (stopRequested.fetchAndAddRelaxed(0) == 0)
+	{
+		wakeUp.acquire();
+		InputMapping* mapping = pendingRequest.fetchAndStoreAcquire(NULL);
+		if (mapping == NULL)
+			continue;
+
+		// Editors often write a file more than once, and the calibration
+		// is also written by the plug-in itself.
+		QByteArray contents = readFiles();
+		bool forced = (devicesChanged.fetchAndStoreAcquire(0) != 0);
+		if (contents == lastContents && !forced)
+		{
+			delete mapping;
+			continue;
+		}
+		mapping->filesChanged = (contents != lastContents);
+		lastContents = contents;
+
+		// The thread's own copies, as QSettings can't be shared between
+		// threads.
+		bool hasBindings = QFile::exists(bindingsPath);
+		QSettings conf(hasBindings ? bindingsPath : configPath,
+		               QSettings::IniFormat);
+		QSettings calibrationStore(calibrationPath, QSettings::IniFormat);
+		mapping->compile(&conf, &calibrationStore, defaultDeadzone);
+		delete result.fetchAndStoreRelease(mapping);
+	}
+}
+
+QByteArray
+MappingCompiler::readFiles() const
+{
+	QByteArray contents;
+	const QString paths[3] = {bindingsPath, configPath, calibrationPath};
+	for (int i = 0; i < 3; i++)
+	{
+		QFile file(paths[i]);
+		// The separator keeps the contents of different files apart.
+		contents += '\0';
+		if (file.open(QIODevice::ReadOnly))
+			contents += file.readAll();
+	}
+	return contents;
+}
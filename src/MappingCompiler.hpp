@@ -0,0 +1,91 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef MAPPING_COMPILER_HPP
+#define MAPPING_COMPILER_HPP
+
+#include <QAtomicPointer>
+#include <QByteArray>
+#include <QSemaphore>
+#include <QString>
+#include <QThread>
+
+#include "InputMapping.hpp"
+
+//! Background thread recompiling the bindings and calibrations when their
+//! files are edited or devices are added, so that a change applies without
+//! restarting Stellarium and without holding up a frame.
+//!
+//! Requests and results are passed as whole InputMappings through atomic
+//! pointers: request() publishes the description of the open devices,
+//! the thread reads the files into a new mapping, and takeResult() picks it
+//! up, typically at the start of JoystickSupport::update(). Neither side ever
+//! waits for the other, and a result is either installed completely or not
+//! at all. A newer request or result replaces one that hasn't been picked up.
+class MappingCompiler : public QThread
+{
+public:
+	MappingCompiler();
+	~MappingCompiler();
+
+	//! Sets the files to read. The bindings are read from @p bindingsPath
+	//! if it exists, from @p configPath otherwise.
+	//! @warning Can be called only while the thread is not running.
+	void setFiles(const QString& bindingsPath, const QString& configPath,
+	              const QString& calibrationPath);
+	//! @warning Can be called only while the thread is not running.
+	void setDefaultDeadzone(float deadzone) {defaultDeadzone = deadzone;}
+
+	//! Asks for the mapping of the open devices to be compiled again.
+	//! Call only from the thread that calls JoystickSupport::update().
+	//! @param devicesChanged if false, nothing is compiled unless the files
+	//! have changed since the last time.
+	void request(const DeviceSet& devices, bool devicesChanged = false);
+	//! Retrieves the newest compiled mapping, if any. The caller owns it.
+	//! @returns NULL if nothing has been compiled since the last call.
+	InputMapping* takeResult() {return result.fetchAndStoreAcquire(NULL);}
+
+	//! Asks the thread to exit and waits until it does. Discards any request
+	//! or result that hasn't been picked up.
+	void stop();
+
+protected:
+	virtual void run();
+
+private:
+	//! Reads the files the mapping is compiled from.
+	QByteArray readFiles() const;
+
+	QString bindingsPath;
+	QString configPath;
+	QString calibrationPath;
+	float defaultDeadzone;
+	QAtomicInt stopRequested;
+	//! Set by request() if the devices have changed.
+	QAtomicInt devicesChanged;
+	//! Released by request() and stop() to wake up the thread.
+	QSemaphore wakeUp;
+	QAtomicPointer<InputMapping> pendingRequest;
+	QAtomicPointer<InputMapping> result;
+	//! Contents of the files when they were last read. Saves that don't
+	//! change anything are ignored. Used only by the thread.
+	QByteArray lastContents;
+};
+
+#endif//MAPPING_COMPILER_HPP
@@ -0,0 +1,48 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef MOVEMENT_SINK_HPP
+#define MOVEMENT_SINK_HPP
+
+#include "BindingTable.hpp"
+
+//! Receives the results of processing the input: movement of the view and
+//! actions. In the plug-in, it's implemented by JoystickSupport on top of
+//! StelMovementMgr and StelCore; other implementations allow the input
+//! processing to run without Stellarium, e.g. in a benchmark.
+//!
+//! performAction() (inherited from ActionTarget) receives all actions
+//! except the movement flags.
+class MovementSink : public ActionTarget
+{
+public:
+	//! Sets a movement flag. Called only when the flag changes.
+	//! InputProcessor sets only ActionMoveSlow; the other movement actions
+	//! move the view through panView() and changeFov().
+	//! @param actionId is a BuiltinAction up to ActionMoveSlow.
+	virtual void setMovementFlag(int actionId, bool active) = 0;
+	//! Returns the current field of view in degrees.
+	virtual double getCurrentFov() = 0;
+	//! Pans the view by the given angles in radians.
+	virtual void panView(double deltaAz, double deltaAlt) = 0;
+	//! Changes the field of view by the given amount in degrees.
+	virtual void changeFov(double deltaFov) = 0;
+};
+
+#endif//MOVEMENT_SINK_HPP
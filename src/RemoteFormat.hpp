@@ -0,0 +1,137 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef REMOTE_FORMAT_HPP
+#define REMOTE_FORMAT_HPP
+
+#include "DeviceState.hpp"
+
+#include <QtEndian>
+
+#include <cstring>
+
+//! Layout of the UDP datagrams received by RemoteInputServer.
+//!
+//! Each datagram carries the complete state of one device of a sender, so
+//! any datagram can be lost or dropped without affecting the following ones.
+//! Unlike the trace files, datagrams may cross between machines, so all values
+//! are little-endian. A datagram consists of a header of HeaderSize bytes:
+//!  - magic ("JSRI", 4 bytes), version (1)
+//!  - source (1): device number chosen by the sender, below MaxSources
+//!  - flags (1), axis count (1), button count (1), hat count (1), unused (2)
+//!  - session (4): chosen by the sender when it starts, so that the sequence
+//!    numbers of a restarted sender are not mistaken for old ones
+//!  - sequence (4): incremented by one for each datagram of a source
+//!  - send time (8): when the sender read the device, in microseconds of
+//!    its own monotonic clock
+//!  - the device's GUID (16), used to find its bindings and calibration
+//!
+//! followed by:
+//!  - the axes, axis count x 2 bytes (signed)
+//!  - the buttons, one bit each, the first button in the lowest bit of
+//!    the first byte, (button count + 7) / 8 bytes
+//!  - the hats, hat count x 1 byte, as SDL_JoystickGetHat() returns them
+//! Datagrams of any other size are ignored.
+namespace RemoteFormat
+{
+	enum
+	{
+		Version = 1,
+		//! Number of devices a sender (or all senders together) can have.
+		MaxSources = 4
+	};
+
+	enum Flags
+	{
+		//! The axes and buttons are SDL_GameControllerAxis and
+		//! SDL_GameControllerButton.
+		FlagGamepad = 1,
+		//! The sender has closed the device (or is exiting); the rest of
+		//! the datagram is ignored.
+		FlagDisconnect = 2
+	};
+
+	//! Datagrams are parsed in place, at these offsets.
+	enum Offsets
+	{
+		OffsetVersion = 4,
+		OffsetSource = 5,
+		OffsetFlags = 6,
+		OffsetAxisCount = 7,
+		OffsetButtonCount = 8,
+		OffsetHatCount = 9,
+		OffsetSession = 12,
+		OffsetSequence = 16,
+		OffsetSendTime = 20,
+		OffsetGuid = 28,
+		HeaderSize = 44
+	};
+
+	enum
+	{
+		MaxPacketSize = HeaderSize + InputSnapshot::MaxAxes * 2
+		                + InputSnapshot::MaxButtons / 8 + InputSnapshot::MaxHats
+	};
+
+	static const char magic[4] = {'J', 'S', 'R', 'I'};
+
+	//! Size of a datagram with the given numbers of controls.
+	inline int packetSize(int axisCount, int buttonCount, int hatCount)
+	{
+		return HeaderSize + axisCount * 2 + (buttonCount + 7) / 8 + hatCount;
+	}
+
+	//! Writes the state of a device's block of a snapshot as a datagram.
+	//! @param buffer must have room for MaxPacketSize bytes.
+	//! @returns the size of the datagram.
+	inline int writePacket(char* buffer, int source, int flags,
+	                       quint32 session, quint32 sequence, quint64 sendTime,
+	                       const DeviceCapabilities& caps,
+	                       const InputSnapshot& state, int slot)
+	{
+		uchar* data = reinterpret_cast<uchar*>(buffer);
+		memcpy(data, magic, sizeof(magic));
+		data[OffsetVersion] = Version;
+		data[OffsetSource] = source;
+		data[OffsetFlags] = flags | (caps.isGamepad ? FlagGamepad : 0);
+		data[OffsetAxisCount] = caps.axisCount;
+		data[OffsetButtonCount] = caps.buttonCount;
+		data[OffsetHatCount] = caps.hatCount;
+		qToLittleEndian<quint16>(0, data + OffsetHatCount + 1);
+		qToLittleEndian<quint32>(session, data + OffsetSession);
+		qToLittleEndian<quint32>(sequence, data + OffsetSequence);
+		qToLittleEndian<quint64>(sendTime, data + OffsetSendTime);
+		memcpy(data + OffsetGuid, caps.guid.data, sizeof(caps.guid.data));
+
+		uchar* p = data + HeaderSize;
+		for (int i = 0; i < caps.axisCount; i++, p += 2)
+			qToLittleEndian<qint16>(state.axis(slot, i), p);
+		for (int i = 0; i < caps.buttonCount; i += 8)
+		{
+			const quint64 word = state.buttons[slot * InputSnapshot::ButtonWords
+			                                   + (i >> 6)];
+			*p++ = uchar(word >> (i & 63));
+		}
+		for (int i = 0; i < caps.hatCount; i++)
+			*p++ = state.hat(slot, i);
+		return p - data;
+	}
+}
+
+#endif//REMOTE_FORMAT_HPP
@@ -0,0 +1,296 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "RemoteInputServer.hpp"
+
+#include <QDebug>
+#include <QUdpSocket>
+
+#include <cstring>
+
+//! Length of the windows over which the fastest datagram is found.
+static const int offsetWindow = 1; // seconds
+//! How often the thread wakes up to check for a stop or timeouts when
+//! nothing arrives.
+static const int pollInterval = 50; // milliseconds
+
+void
+RemoteInputServer::Event::read(InputSnapshot& snapshot, int slot) const
+{
+	snapshot.clearDevice(slot);
+	memcpy(snapshot.axes + slot * InputSnapshot::MaxAxes, axes,
+	       axisCount * sizeof(axes[0]));
+	memcpy(snapshot.buttons + slot * InputSnapshot::ButtonWords, buttons,
+	       sizeof(buttons));
+	memcpy(snapshot.hats + slot * InputSnapshot::MaxHats, hats,
+	       hatCount * sizeof(hats[0]));
+}
+
+bool
+RemoteInputServer::Event::matches(const DeviceCapabilities& caps) const
+{
+	return caps.isGamepad == isGamepad
+	       && caps.axisCount == axisCount
+	       && caps.buttonCount == buttonCount
+	       && caps.hatCount == hatCount
+	       && memcmp(caps.guid.data, guid.data, sizeof(guid.data)) == 0;
+}
+
+void
+RemoteInputServer::Event::getCapabilities(DeviceCapabilities& caps) const
+{
+	caps.isGamepad = isGamepad;
+	caps.axisCount = axisCount;
+	caps.buttonCount = buttonCount;
+	caps.hatCount = hatCount;
+	caps.ballCount = 0;
+	caps.guid = guid;
+	caps.name = QString("Remote device %1").arg(source);
+	caps.mapping.clear();
+}
+
+
+RemoteInputServer::RemoteInputServer() :
+    address(QHostAddress::Any),
+    port(0),
+    maxAge(100000),
+    stopRequested(0),
+    acceptedCount(0)
+{
+	frequency = SDL_GetPerformanceFrequency();
+	timeoutTicks = frequency;
+	reset();
+}
+
+RemoteInputServer::~RemoteInputServer()
+{
+	stop();
+}
+
+void
+RemoteInputServer::setAddress(const QHostAddress& address, quint16 port)
+{
+	Q_ASSERT(!isRunning());
+	this->address = address;
+	this->port = port;
+}
+
+void
+RemoteInputServer::setTimeouts(int maxAge, int timeout)
+{
+	Q_ASSERT(!isRunning());
+	this->maxAge = qint64(qMax(1, maxAge)) * 1000;
+	timeoutTicks = Uint64(qMax(1, timeout)) * frequency / 1000;
+}
+
+void
+RemoteInputServer::stop()
+{
+	if (!isRunning())
+		return;
+
+	stopRequested.fetchAndStoreOrdered(1);
+	wait();
+	stopRequested.fetchAndStoreOrdered(0);
+}
+
+int
+RemoteInputServer::getDroppedCount(DropReason reason) const
+{
+	return const_cast<QAtomicInt&>(droppedCounts[reason]).fetchAndAddRelaxed(0);
+}
+
+int
+RemoteInputServer::getAcceptedCount() const
+{
+	return const_cast<QAtomicInt&>(acceptedCount).fetchAndAddRelaxed(0);
+}
+
+void
+RemoteInputServer::reset()
+{
+	Q_ASSERT(!isRunning());
+	memset(sources, 0, sizeof(sources));
+	acceptedCount.fetchAndStoreRelaxed(0);
+	for (int i = 0; i < DropReasonCount; i++)
+		droppedCounts[i].fetchAndStoreRelaxed(0);
+	events.clear();
+}
+
+void
+RemoteInputServer::receive(const char* data, int size, Uint64 timestamp)
+{
+	using namespace RemoteFormat;
+	const uchar* p = reinterpret_cast<const uchar*>(data);
+	if (size < HeaderSize
+	    || memcmp(p, magic, sizeof(magic)) != 0
+	    || p[OffsetVersion] != Version
+	    || p[OffsetSource] >= MaxSources)
+	{
+		drop(DropMalformed);
+		return;
+	}
+
+	Event event;
+	event.source = p[OffsetSource];
+	event.timestamp = timestamp;
+	const int flags = p[OffsetFlags];
+	event.isGamepad = (flags & FlagGamepad) != 0;
+	event.axisCount = p[OffsetAxisCount];
+	event.buttonCount = p[OffsetButtonCount];
+	event.hatCount = p[OffsetHatCount];
+	if (event.axisCount > InputSnapshot::MaxAxes
+	    || event.buttonCount > InputSnapshot::MaxButtons
+	    || event.hatCount > InputSnapshot::MaxHats
+	    || size != packetSize(event.axisCount, event.buttonCount, event.hatCount))
+	{
+		drop(DropMalformed);
+		return;
+	}
+
+	// A new session restarts the sequence. Otherwise, the difference is
+	// taken modulo 2^32, so the sequence may wrap around.
+	Source& source = sources[event.source];
+	const quint32 session = qFromLittleEndian<quint32>(p + OffsetSession);
+	const quint32 sequence = qFromLittleEndian<quint32>(p + OffsetSequence);
+	const bool newSession = !source.known || session != source.session;
+	if (!newSession && qint32(sequence - source.sequence) <= 0)
+	{
+		drop(DropOutOfOrder);
+		return;
+	}
+	source.known = true;
+	source.session = session;
+	source.sequence = sequence;
+	source.lastArrival = timestamp;
+
+	if (flags & FlagDisconnect)
+	{
+		// If the buffer is full, the timeout will try again.
+		event.type = Event::EventDisconnect;
+		if (source.connected && push(event))
+			source.connected = false;
+		return;
+	}
+
+	event.type = Event::EventState;
+	event.sendTime = qFromLittleEndian<quint64>(p + OffsetSendTime);
+
+	// The delay is compared to the fastest datagram in the current and
+	// the previous window, so a change in the network or in the clocks is
+	// followed within two windows. It starts over when the device connects.
+	const qint64 offset = qint64(timestamp * 1000000.0 / frequency)
+	                      - qint64(event.sendTime);
+	if (newSession || !source.connected)
+	{
+		source.minOffset[0] = source.minOffset[1] = offset;
+		source.windowStart = timestamp;
+	}
+	else if (timestamp - source.windowStart >= offsetWindow * frequency)
+	{
+		source.minOffset[1] = source.minOffset[0];
+		source.minOffset[0] = offset;
+		source.windowStart = timestamp;
+	}
+	source.minOffset[0] = qMin(source.minOffset[0], offset);
+	if (offset - qMin(source.minOffset[0], source.minOffset[1]) > maxAge)
+	{
+		drop(DropStale);
+		return;
+	}
+
+	memcpy(event.guid.data, p + OffsetGuid, sizeof(event.guid.data));
+	p += HeaderSize;
+	for (int i = 0; i < event.axisCount; i++, p += 2)
+		event.axes[i] = qFromLittleEndian<qint16>(p);
+	memset(event.buttons, 0, sizeof(event.buttons));
+	for (int i = 0; i < event.buttonCount; i += 8)
+		event.buttons[i >> 6] |= quint64(*p++) << (i & 63);
+	// Bits beyond the last button are ignored.
+	if (event.buttonCount & 7)
+		event.buttons[event.buttonCount >> 6] &=
+		        (Q_UINT64_C(1) << (event.buttonCount & 63)) - 1;
+	memcpy(event.hats, p, event.hatCount);
+	if (push(event))
+	{
+		source.connected = true;
+		acceptedCount.fetchAndAddRelaxed(1);
+	}
+}
+
+void
+RemoteInputServer::checkTimeouts(Uint64 now)
+{
+	for (int i = 0; i < RemoteFormat::MaxSources; i++)
+	{
+		Source& source = sources[i];
+		if (!source.connected || now - source.lastArrival < timeoutTicks)
+			continue;
+		Event event;
+		event.type = Event::EventDisconnect;
+		event.source = i;
+		event.timestamp = now;
+		if (push(event))
+			source.connected = false;
+	}
+}
+
+void
+RemoteInputServer::run()
+{
+	QUdpSocket socket;
+	if (!socket.bind(address, port))
+	{
+		qWarning() << "JoystickSupport: unable to receive remote input on"
+		           << address.toString() << port << socket.errorString();
+		return;
+	}
+
+	char buffer[RemoteFormat::MaxPacketSize + 1];
+	while (stopRequested.fetchAndAddRelaxed(0) == 0)
+	{
+		if (socket.waitForReadyRead(pollInterval))
+		{
+			while (socket.hasPendingDatagrams())
+			{
+				// A datagram longer than the buffer is truncated, and then
+				// rejected because of its size.
+				qint64 size = socket.readDatagram(buffer, sizeof(buffer));
+				if (size >= 0)
+					receive(buffer, int(size), SDL_GetPerformanceCounter());
+			}
+		}
+		checkTimeouts(SDL_GetPerformanceCounter());
+	}
+}
+
+bool
+RemoteInputServer::push(const Event& event)
+{
+	if (events.push(event))
+		return true;
+	drop(DropOverflow);
+	return false;
+}
+
+void
+RemoteInputServer::drop(DropReason reason)
+{
+	droppedCounts[reason].fetchAndAddRelaxed(1);
+}
@@ -0,0 +1,177 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef REMOTE_INPUT_SERVER_HPP
+#define REMOTE_INPUT_SERVER_HPP
+
+#include <QHostAddress>
+#include <QThread>
+
+#include "DeviceState.hpp"
+#include "RemoteFormat.hpp"
+#include "SampleRing.hpp"
+
+//! Background thread receiving the state of remote devices over UDP.
+//!
+//! Datagrams (see RemoteFormat) are read into a fixed buffer and parsed in
+//! place into Events, which are pushed into a lock-free ring buffer drained
+//! by JoystickSupport::update(). There, each remote device gets a slot in
+//! DeviceSet like a local one, so its input goes through the same bindings,
+//! calibration and filters.
+//!
+//! Only the newest state of a device matters, so datagrams that arrive out of
+//! order (or twice) are dropped, as are stale ones that took more than
+//! the maximum age longer than the fastest recent datagram to arrive. As the
+//! clocks of the two machines are not synchronized, the delay is measured
+//! relative to the smallest difference between the send and arrival times in
+//! the last second or two, which also follows any drift between the clocks.
+class RemoteInputServer : public QThread
+{
+public:
+	//! Number of buffered events. At 250 datagrams per second for each of
+	//! MaxSources devices, enough for a quarter second.
+	enum { RingSize = 256 };
+
+	//! A datagram that was accepted, or a device that went away.
+	struct Event
+	{
+		enum Type
+		{
+			EventState,
+			//! The sender closed the device, or nothing was received from it
+			//! for longer than the timeout.
+			EventDisconnect
+		};
+
+		//! Copies the device state into its block of a snapshot, clearing
+		//! the controls that the remote device doesn't have.
+		void read(InputSnapshot& snapshot, int slot) const;
+		//! True if the device has the same controls as @p caps.
+		bool matches(const DeviceCapabilities& caps) const;
+		//! Fills in the capabilities of the remote device.
+		void getCapabilities(DeviceCapabilities& caps) const;
+
+		quint8 type;
+		quint8 source;
+		bool isGamepad;
+		quint8 axisCount;
+		quint8 buttonCount;
+		quint8 hatCount;
+		//! Value of SDL_GetPerformanceCounter() when the datagram arrived.
+		Uint64 timestamp;
+		//! Send time of the datagram, in the sender's microseconds.
+		quint64 sendTime;
+		SDL_JoystickGUID guid;
+		Sint16 axes[InputSnapshot::MaxAxes];
+		quint64 buttons[InputSnapshot::ButtonWords];
+		Uint8 hats[InputSnapshot::MaxHats];
+	};
+
+	//! Why datagrams were not accepted, see getDroppedCount().
+	enum DropReason
+	{
+		DropMalformed,
+		DropOutOfOrder,
+		DropStale,
+		//! The ring buffer was full because frames took too long.
+		DropOverflow,
+		DropReasonCount
+	};
+
+	RemoteInputServer();
+	~RemoteInputServer();
+
+	//! Sets the address and UDP port to listen on.
+	//! @warning Can be called only while the thread is not running.
+	void setAddress(const QHostAddress& address, quint16 port);
+	quint16 getPort() const {return port;}
+	//! Sets how much longer than the fastest recent datagram a datagram may
+	//! take to arrive before it's dropped, and after how long without any
+	//! datagrams a device is disconnected, both in milliseconds.
+	//! @warning Can be called only while the thread is not running.
+	void setTimeouts(int maxAge, int timeout);
+
+	//! Asks the thread to exit and waits until it does.
+	void stop();
+
+	//! Retrieves the oldest event. Call only from the thread that calls
+	//! JoystickSupport::update().
+	//! @returns false if there are no new events.
+	bool popEvent(Event& event) {return events.pop(event);}
+
+	//! Number of datagrams dropped for the given reason, since start.
+	int getDroppedCount(DropReason reason) const;
+	//! Number of datagrams accepted, since start.
+	int getAcceptedCount() const;
+
+	//! Parses and checks a datagram and pushes the resulting event.
+	//! Called by the thread for each datagram; can be called directly only
+	//! while the thread is not running, e.g. to test it.
+	//! @param timestamp is the value of SDL_GetPerformanceCounter() when
+	//! the datagram arrived.
+	void receive(const char* data, int size, Uint64 timestamp);
+	//! Disconnects the devices from which nothing was received for longer
+	//! than the timeout. Called by the thread, like receive().
+	void checkTimeouts(Uint64 now);
+	//! Forgets all remote devices and counters and discards all events.
+	//! The remote devices are not disconnected, so any that are open need to
+	//! be closed by the caller.
+	//! @warning Can be called only while the thread is not running.
+	void reset();
+
+protected:
+	virtual void run();
+
+private:
+	//! What is known about the datagrams of a source.
+	struct Source
+	{
+		//! True once a datagram has been received, even if it was dropped.
+		bool known;
+		//! True if the last event pushed for the source was EventState.
+		bool connected;
+		quint32 session;
+		quint32 sequence;
+		//! SDL_GetPerformanceCounter() when the last datagram arrived.
+		Uint64 lastArrival;
+		//! The smallest difference between the arrival and send times in
+		//! microseconds, in the current and the previous window.
+		qint64 minOffset[2];
+		//! SDL_GetPerformanceCounter() when the current window started.
+		Uint64 windowStart;
+	};
+
+	//! Pushes an event, counting it as dropped if the buffer is full.
+	//! @returns false if the event was dropped.
+	bool push(const Event& event);
+	void drop(DropReason reason);
+
+	QHostAddress address;
+	quint16 port;
+	qint64 maxAge;
+	Uint64 timeoutTicks;
+	Uint64 frequency;
+	QAtomicInt stopRequested;
+	QAtomicInt acceptedCount;
+	QAtomicInt droppedCounts[DropReasonCount];
+	Source sources[RemoteFormat::MaxSources];
+	SampleRing<Event, RingSize> events;
+};
+
+#endif//REMOTE_INPUT_SERVER_HPP
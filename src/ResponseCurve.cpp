@@ -0,0 +1,46 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "ResponseCurve.hpp"
+
+void
+AxisResponseTable::build(const ResponseCurve& curve)
+{
+	const float deadzone = qBound(0.0f, curve.deadzone, 0.99f);
+	const float saturation = qBound(deadzone + 0.01f, curve.saturation, 1.0f);
+	const float expo = qBound(0.0f, curve.expo, 1.0f);
+	const float range = saturation - deadzone;
+
+	table.resize(Size);
+	float* values = table.data();
+	for (int i = 0; i < Size; i++)
+	{
+		// The negative half has one more value, so -32768 gets clamped.
+		float x = qMax(-1.0f, (i - 32768) / 32767.0f);
+		float magnitude = qAbs(x);
+		if (magnitude <= deadzone)
+		{
+			values[i] = 0.0f;
+			continue;
+		}
+		float t = qMin(1.0f, (magnitude - deadzone) / range);
+		float y = (1.0f - expo) * t + expo * t * t * t;
+		values[i] = (x < 0) ? -y : y;
+	}
+}
@@ -0,0 +1,71 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef RESPONSE_CURVE_HPP
+#define RESPONSE_CURVE_HPP
+
+#ifndef SDL_MAIN_HANDLED
+#define SDL_MAIN_HANDLED
+#endif
+#include "SDL.h"
+
+#include <QVector>
+
+//! Describes how the deflection of an axis is translated to a movement rate.
+//! All values are fractions of the full travel of the axis in one direction.
+struct ResponseCurve
+{
+	ResponseCurve() : deadzone(0.15f), expo(0.5f), saturation(1.0f) {}
+
+	//! Deflections up to this value are ignored.
+	float deadzone;
+	//! How much of the curve is cubic instead of linear, between 0 and 1.
+	//! Higher values allow finer control near the center.
+	float expo;
+	//! Deflections beyond this value produce the maximum rate.
+	float saturation;
+};
+
+//! A ResponseCurve evaluated in advance for every possible axis value.
+//!
+//! Looking up a value costs a single memory read, so there is no reason
+//! to discard any of the axis' resolution. The table takes 256 KiB,
+//! so devices should share tables where possible.
+class AxisResponseTable
+{
+public:
+	//! Number of possible values of a Sint16 axis.
+	enum { Size = 65536 };
+
+	//! Evaluates the curve for all axis values.
+	void build(const ResponseCurve& curve);
+	bool isEmpty() const {return table.isEmpty();}
+
+	//! Returns the rate, between -1 and 1, corresponding to an axis value.
+	//! @warning The table must have been built.
+	float rate(Sint16 axisValue) const
+	{
+		return table.constData()[axisValue + 32768];
+	}
+
+private:
+	QVector<float> table;
+};
+
+#endif//RESPONSE_CURVE_HPP
@@ -0,0 +1,101 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef SAMPLE_RING_HPP
+#define SAMPLE_RING_HPP
+
+#include <QAtomicInt>
+
+//! Fixed-size, lock-free ring buffer for exactly one producer thread
+//! and one consumer thread.
+//!
+//! The producer only writes #head and the consumer only writes #tail,
+//! so neither side ever waits for the other. If the buffer is full,
+//! push() fails and the item is dropped - the producer is never blocked.
+//! @tparam Capacity must be a power of two.
+template<typename T, int Capacity>
+class SampleRing
+{
+public:
+	SampleRing() : head(0), tail(0) {}
+
+	//! Appends an item. Call only from the producer thread.
+	//! @returns false if the buffer is full and the item was dropped.
+	bool push(const T& item)
+	{
+		int h = loadRelaxed(head);
+		int next = (h + 1) & (Capacity - 1);
+		if (next == loadAcquire(tail))
+			return false;
+		items[h] = item;
+		storeRelease(head, next);
+		return true;
+	}
+
+	//! Removes the oldest item. Call only from the consumer thread.
+	//! @returns false if the buffer is empty.
+	bool pop(T& item)
+	{
+		int t = loadRelaxed(tail);
+		if (t == loadAcquire(head))
+			return false;
+		item = items[t];
+		storeRelease(tail, (t + 1) & (Capacity - 1));
+		return true;
+	}
+
+	//! Discards all items.
+	//! @warning Safe only while the producer is not running.
+	void clear() { storeRelease(tail, loadAcquire(head)); }
+
+private:
+	// Qt 4 has no explicit load/store operations on QAtomicInt.
+	static int loadRelaxed(QAtomicInt& value)
+	{
+	#if QT_VERSION >= 0x050000
+		return value.load();
+	#else
+		return value;
+	#endif
+	}
+	static int loadAcquire(QAtomicInt& value)
+	{
+	#if QT_VERSION >= 0x050000
+		return value.loadAcquire();
+	#else
+		return value.fetchAndAddAcquire(0);
+	#endif
+	}
+	static void storeRelease(QAtomicInt& value, int newValue)
+	{
+	#if QT_VERSION >= 0x050000
+		value.storeRelease(newValue);
+	#else
+		value.fetchAndStoreRelease(newValue);
+	#endif
+	}
+
+	T items[Capacity];
+	//! Index of the next slot to be written. Owned by the producer.
+	QAtomicInt head;
+	//! Index of the next slot to be read. Owned by the consumer.
+	QAtomicInt tail;
+};
+
+#endif//SAMPLE_RING_HPP
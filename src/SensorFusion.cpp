@@ -0,0 +1,162 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "SensorFusion.hpp"
+
+#include <QtGlobal>
+
+#include <cmath>
+
+const double SensorFusion::StandardGravity = 9.80665;
+
+//! How far the acceleration may differ from StandardGravity (as a fraction
+//! of it) for the controller to be considered still.
+static const double AccelTolerance = 0.1;
+//! Time constant of the correction of the direction of gravity, in seconds.
+static const double GravityTime = 1.0;
+//! Angular speed below which the reading may be drift (about 1 degree per
+//! second), and the time constant of measuring it, in seconds.
+static const double BiasThreshold = 0.02;
+static const double BiasTime = 4.0;
+//! Angular speed (after removing the drift) ignored as noise.
+static const double NoiseThreshold = 0.005;
+//! Longest time a reading is assumed to have held, e.g. after a pause.
+static const double MaxSampleTime = 0.1;
+
+static double
+dot(const double a[3], const double b[3])
+{
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static void
+cross(const double a[3], const double b[3], double result[3])
+{
+	result[0] = a[1] * b[2] - a[2] * b[1];
+	result[1] = a[2] * b[0] - a[0] * b[2];
+	result[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+//! Scales a vector to unit length.
+//! @returns false (leaving it unchanged) if it's too short for that.
+static bool
+normalize(double v[3])
+{
+	double length = std::sqrt(dot(v, v));
+	if (length < 1e-6)
+		return false;
+	for (int i = 0; i < 3; i++)
+		v[i] /= length;
+	return true;
+}
+
+SensorFusion::SensorFusion()
+{
+	reset();
+}
+
+void
+SensorFusion::reset()
+{
+	started = false;
+	vertical[0] = 0.0;
+	vertical[1] = 1.0;
+	vertical[2] = 0.0;
+	bias[0] = bias[1] = bias[2] = 0.0;
+	biasTime = 0.0;
+	rotationRight = rotationUp = 0.0;
+}
+
+void
+SensorFusion::addSample(double dt, const float gyro[3], const float accel[3])
+{
+	double gravity[3] = {accel[0], accel[1], accel[2]};
+	const double accelLength = std::sqrt(dot(gravity, gravity));
+	const bool hasGravity = normalize(gravity);
+	if (!started)
+	{
+		started = true;
+		if (hasGravity)
+			for (int i = 0; i < 3; i++)
+				vertical[i] = gravity[i];
+		return;
+	}
+	if (dt <= 0.0)
+		return;
+	dt = qMin(dt, MaxSampleTime);
+
+	const bool still = hasGravity
+	                   && std::fabs(accelLength - StandardGravity)
+	                      < AccelTolerance * StandardGravity;
+	double w[3];
+	for (int i = 0; i < 3; i++)
+		w[i] = gyro[i] - bias[i];
+	if (still && std::sqrt(dot(w, w)) < BiasThreshold)
+	{
+		// An average of all readings until BiasTime has been measured, so
+		// the drift is known soon after start, then a moving average.
+		biasTime = qMin(biasTime + dt, BiasTime);
+		const double k = dt / biasTime;
+		for (int i = 0; i < 3; i++)
+		{
+			bias[i] += w[i] * k;
+			w[i] = gyro[i] - bias[i];
+		}
+	}
+
+	// Seen from the controller, gravity turns the opposite way.
+	double turn[3];
+	cross(w, vertical, turn);
+	for (int i = 0; i < 3; i++)
+		vertical[i] -= turn[i] * dt;
+	if (still)
+	{
+		const double k = dt / (GravityTime + dt);
+		for (int i = 0; i < 3; i++)
+			vertical[i] += (gravity[i] - vertical[i]) * k;
+	}
+	normalize(vertical);
+
+	if (std::sqrt(dot(w, w)) < NoiseThreshold)
+		return;
+	// The horizontal axis across the direction the controller points at
+	// (-z), i.e. vertical x z. When it points straight up or down,
+	// the controller's own x axis made horizontal.
+	double across[3] = {vertical[1], -vertical[0], 0.0};
+	if (dot(across, across) < 0.01)
+	{
+		across[0] = 1.0 - vertical[0] * vertical[0];
+		across[1] = -vertical[0] * vertical[1];
+		across[2] = -vertical[0] * vertical[2];
+	}
+	if (!normalize(across))
+		return;
+	// Counterclockwise around the vertical is to the left.
+	rotationRight -= dot(w, vertical) * dt;
+	rotationUp += dot(w, across) * dt;
+}
+
+bool
+SensorFusion::takeRotation(double& right, double& up)
+{
+	right = rotationRight;
+	up = rotationUp;
+	rotationRight = rotationUp = 0.0;
+	return right != 0.0 || up != 0.0;
+}
@@ -0,0 +1,75 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef SENSOR_FUSION_HPP
+#define SENSOR_FUSION_HPP
+
+//! Turns the readings of a game controller's gyroscope and accelerometer
+//! into the rotation of the direction it points at, for pointing the view.
+//!
+//! A complementary filter: the direction of gravity in the controller's axes
+//! is followed by rotating it with the gyroscope, and slowly pulled towards
+//! the accelerometer's reading while that is close to gravity alone.
+//! The rotation is then split into turning around the vertical (left and
+//! right) and around the horizontal axis across the controller (up and
+//! down), so rolling the controller doesn't move the view. The gyroscope's
+//! drift is measured while it turns very slowly and the controller is
+//! otherwise still, and rotation slower than its noise is ignored.
+//!
+//! Doesn't depend on SDL, so recorded readings can be processed offline.
+//! The axes are SDL's: with the controller held in front of you, x is right,
+//! y is up and z is towards you. Angular speeds are in radians per second,
+//! counterclockwise around each axis, and accelerations (including gravity)
+//! in meters per second squared.
+class SensorFusion
+{
+public:
+	//! Acceleration that is taken to be gravity alone.
+	static const double StandardGravity;
+
+	SensorFusion();
+
+	//! Forgets the orientation, the drift and any rotation not taken yet.
+	void reset();
+	//! Adds a reading, held for @p dt seconds since the previous one.
+	//! The first reading after reset() only sets the initial orientation.
+	void addSample(double dt, const float gyro[3], const float accel[3]);
+	//! Returns the rotation since the previous call, in radians.
+	//! @param right is positive to the right, @p up upwards.
+	//! @returns false if there was none.
+	bool takeRotation(double& right, double& up);
+
+	//! The direction upwards, in the controller's axes (a unit vector).
+	const double* getUp() const {return vertical;}
+	//! The measured drift of the gyroscope, in radians per second.
+	const double* getBias() const {return bias;}
+
+private:
+	//! False until the first reading after reset().
+	bool started;
+	double vertical[3];
+	double bias[3];
+	//! Time over which #bias has been measured, up to BiasTime.
+	double biasTime;
+	//! Rotation since the last takeRotation().
+	double rotationRight;
+	double rotationUp;
+};
+
+#endif//SENSOR_FUSION_HPP
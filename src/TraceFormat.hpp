@@ -0,0 +1,93 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef TRACE_FORMAT_HPP
+#define TRACE_FORMAT_HPP
+
+#include "DeviceState.hpp"
+
+//! Layout of the input trace files written by TraceRecorder and read by
+//! TracePlayer.
+//!
+//! A trace starts with a FileHeader, followed by records, each starting with
+//! a RecordType byte. All values are in the native byte order of the machine
+//! that recorded the trace, which is checked by TracePlayer.
+//!  - RecordAttach: slot (1 byte), is gamepad (1), axis count (1),
+//!    button count (1), hat count (1), ball count (1), instance ID (4),
+//!    GUID (16), name length (2), name (UTF-8, at most MaxNameLength
+//!    bytes)
+//!  - RecordDetach: slot (1 byte)
+//!  - RecordSample: timestamp (8 bytes), mask of the included slots (1),
+//!    then for each included slot its axes, button words, hats, ball
+//!    motion and rotation as in InputSnapshot. Samples identical to
+//!    the previous one are not recorded, unless a trackball or the device
+//!    has moved.
+//!  - RecordFrame: time since the previous frame in seconds (double),
+//!    marking the end of a call to JoystickSupport::update().
+//!
+//! TracePlayer also reads older traces: version 2 has no rotation in its
+//! samples, and version 1 has neither ball motion nor FileHeader::maxBalls.
+namespace TraceFormat
+{
+	enum
+	{
+		Version = 3,
+		//! Oldest version that can still be replayed.
+		FirstVersion = 1,
+		ByteOrderMark = 0x01020304,
+		//! Device names are cut to this many bytes, so that an attach
+		//! record always fits in a chunk of TraceRecorder.
+		MaxNameLength = 255
+	};
+
+	enum RecordType
+	{
+		RecordSample = 1,
+		RecordAttach,
+		RecordDetach,
+		RecordFrame
+	};
+
+	struct FileHeader
+	{
+		char magic[8];
+		quint32 version;
+		quint32 byteOrder;
+		//! SDL_GetPerformanceFrequency() of the recording machine.
+		Uint64 frequency;
+		//! The limits of InputSnapshot. Traces can be replayed only by
+		//! builds with the same limits.
+		quint16 maxDevices;
+		quint16 maxAxes;
+		quint16 maxButtons;
+		quint16 maxHats;
+		quint16 maxBalls;
+	};
+
+	static const char magic[8] = {'J', 'S', 'T', 'R', 'A', 'C', 'E', '\0'};
+
+	//! Size of a device's state in a RecordSample.
+	static const int slotDataSize = InputSnapshot::MaxAxes * sizeof(Sint16)
+	                                + InputSnapshot::ButtonWords * sizeof(quint64)
+	                                + InputSnapshot::MaxHats * sizeof(Uint8)
+	                                + InputSnapshot::MaxBalls * 2 * sizeof(int)
+	                                + 2 * sizeof(float);
+}
+
+#endif//TRACE_FORMAT_HPP
@@ -0,0 +1,213 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "TracePlayer.hpp"
+
+#include <QDebug>
+#include <QFile>
+
+#include <cstddef>
+#include <cstring>
+
+TracePlayer::TracePlayer() :
+    position(0),
+    headerSize(0),
+    version(0),
+    recordedFrequency(1),
+    localFrequency(1)
+{
+	//
+}
+
+bool
+TracePlayer::open(const QString& path)
+{
+	close();
+
+	QFile file(path);
+	if (!file.open(QIODevice::ReadOnly))
+	{
+		qWarning() << "JoystickSupport: unable to open trace file" << path
+		           << file.errorString();
+		return false;
+	}
+	QByteArray contents = file.readAll();
+
+	// The header of version 1 ended before maxBalls. Such traces have no
+	// ball motion, so they fit any limit.
+	TraceFormat::FileHeader header;
+	const int oldHeaderSize = offsetof(TraceFormat::FileHeader, maxBalls);
+	if (contents.size() < oldHeaderSize)
+	{
+		qWarning() << "JoystickSupport: invalid trace file" << path;
+		return false;
+	}
+	memcpy(&header, contents.constData(), oldHeaderSize);
+	int size = sizeof(header);
+	if (header.version < 2)
+	{
+		size = oldHeaderSize;
+		header.maxBalls = InputSnapshot::MaxBalls;
+	}
+	else if (contents.size() >= size)
+		memcpy(&header, contents.constData(), size);
+	if (contents.size() < size
+	    || memcmp(header.magic, TraceFormat::magic, sizeof(header.magic)) != 0
+	    || header.frequency == 0)
+	{
+		qWarning() << "JoystickSupport: invalid trace file" << path;
+		return false;
+	}
+	if (header.version < quint32(TraceFormat::FirstVersion)
+	    || header.version > quint32(TraceFormat::Version)
+	    || header.byteOrder != TraceFormat::ByteOrderMark
+	    || header.maxDevices != InputSnapshot::MaxDevices
+	    || header.maxAxes != InputSnapshot::MaxAxes
+	    || header.maxButtons != InputSnapshot::MaxButtons
+	    || header.maxHats != InputSnapshot::MaxHats
+	    || header.maxBalls != InputSnapshot::MaxBalls)
+	{
+		qWarning() << "JoystickSupport: the trace file" << path
+		           << "was recorded by an incompatible version or machine.";
+		return false;
+	}
+
+	data = contents;
+	headerSize = size;
+	version = header.version;
+	recordedFrequency = header.frequency;
+	localFrequency = SDL_GetPerformanceFrequency();
+	position = headerSize;
+	return true;
+}
+
+void
+TracePlayer::close()
+{
+	data.clear();
+	position = 0;
+}
+
+void
+TracePlayer::rewind()
+{
+	if (isOpen())
+		position = headerSize;
+}
+
+bool
+TracePlayer::next(Record& record, InputSnapshot& snapshot)
+{
+	Uint8 type;
+	if (!read(&type, 1))
+		return false;
+	record.type = static_cast<TraceFormat::RecordType>(type);
+
+	switch (type)
+	{
+	case TraceFormat::RecordSample:
+	{
+		Uint8 slotMask;
+		Uint64 timestamp;
+		if (!read(&timestamp, sizeof(timestamp)) || !read(&slotMask, 1))
+			return false;
+		// In ticks of the local counter, if the trace was recorded on
+		// a machine where it runs at another rate. Split so that it
+		// doesn't overflow.
+		if (recordedFrequency != localFrequency)
+			timestamp = timestamp / recordedFrequency * localFrequency
+			            + timestamp % recordedFrequency * localFrequency
+			              / recordedFrequency;
+		snapshot.timestamp = timestamp;
+		memset(snapshot.axes, 0, sizeof(snapshot.axes));
+		memset(snapshot.buttons, 0, sizeof(snapshot.buttons));
+		memset(snapshot.hats, 0, sizeof(snapshot.hats));
+		memset(snapshot.balls, 0, sizeof(snapshot.balls));
+		memset(snapshot.motion, 0, sizeof(snapshot.motion));
+		for (int slot = 0; slot < InputSnapshot::MaxDevices; slot++)
+		{
+			if ((slotMask & (1 << slot)) == 0)
+				continue;
+			if (!read(snapshot.axes + slot * InputSnapshot::MaxAxes,
+			          InputSnapshot::MaxAxes * sizeof(Sint16))
+			    || !read(snapshot.buttons + slot * InputSnapshot::ButtonWords,
+			             InputSnapshot::ButtonWords * sizeof(quint64))
+			    || !read(snapshot.hats + slot * InputSnapshot::MaxHats,
+			             InputSnapshot::MaxHats * sizeof(Uint8)))
+				return false;
+			// Left at zero in older traces.
+			if (version >= 2
+			    && !read(snapshot.balls + slot * InputSnapshot::MaxBalls * 2,
+			             InputSnapshot::MaxBalls * 2 * sizeof(int)))
+				return false;
+			if (version >= 3
+			    && !read(snapshot.motion + slot * 2, 2 * sizeof(float)))
+				return false;
+		}
+		return true;
+	}
+	case TraceFormat::RecordAttach:
+	{
+		Uint8 fields[6];
+		Sint32 instanceId;
+		quint16 nameLength;
+		if (!read(fields, sizeof(fields))
+		    || !read(&instanceId, sizeof(instanceId))
+		    || !read(record.caps.guid.data, sizeof(record.caps.guid.data))
+		    || !read(&nameLength, sizeof(nameLength))
+		    || position + nameLength > data.size())
+			return false;
+		record.slot = fields[0];
+		record.caps.isGamepad = (fields[1] != 0);
+		record.caps.axisCount = fields[2];
+		record.caps.buttonCount = fields[3];
+		record.caps.hatCount = fields[4];
+		record.caps.ballCount = fields[5];
+		record.caps.name = QString::fromUtf8(data.constData() + position,
+		                                     nameLength);
+		record.caps.mapping.clear();
+		position += nameLength;
+		record.instanceId = instanceId;
+		return record.slot < InputSnapshot::MaxDevices;
+	}
+	case TraceFormat::RecordDetach:
+	{
+		Uint8 slot;
+		if (!read(&slot, 1))
+			return false;
+		record.slot = slot;
+		return true;
+	}
+	case TraceFormat::RecordFrame:
+		return read(&record.deltaTime, sizeof(record.deltaTime));
+	default:
+		qWarning() << "JoystickSupport: unknown record in trace file:" << type;
+		return false;
+	}
+}
+
+bool
+TracePlayer::read(void* destination, int size)
+{
+	if (position + size > data.size())
+		return false;
+	memcpy(destination, data.constData() + position, size);
+	position += size;
+	return true;
+}
@@ -0,0 +1,82 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef TRACE_PLAYER_HPP
+#define TRACE_PLAYER_HPP
+
+#include <QByteArray>
+#include <QString>
+
+#include "DeviceState.hpp"
+#include "TraceFormat.hpp"
+
+//! Reads a trace file written by TraceRecorder, one record at a time.
+//!
+//! The whole file is loaded when it's opened, so reading the records
+//! doesn't touch the disk.
+//! The timestamps of samples are converted to the rate of the local
+//! performance counter, so a trace plays at the speed it was recorded.
+class TracePlayer
+{
+public:
+	//! Contents of a record other than a sample.
+	struct Record
+	{
+		TraceFormat::RecordType type;
+		//! For RecordAttach and RecordDetach.
+		int slot;
+		//! For RecordAttach.
+		SDL_JoystickID instanceId;
+		DeviceCapabilities caps;
+		//! For RecordFrame.
+		double deltaTime;
+	};
+
+	TracePlayer();
+
+	//! Loads a trace file.
+	//! @returns false if the file can't be read or was recorded by
+	//! an incompatible version or machine.
+	bool open(const QString& path);
+	void close();
+	bool isOpen() const {return !data.isEmpty();}
+	//! Goes back to the first record.
+	void rewind();
+
+	//! Reads the next record. For RecordSample, the state of the devices
+	//! included in the sample is copied into @p snapshot.
+	//! @returns false at the end of the trace or if the record is invalid.
+	bool next(Record& record, InputSnapshot& snapshot);
+
+private:
+	//! Copies the next @p size bytes of the trace, if there are that many.
+	bool read(void* destination, int size);
+
+	QByteArray data;
+	int position;
+	//! Size of the file header, which depends on #version.
+	int headerSize;
+	quint32 version;
+	//! SDL_GetPerformanceFrequency() of the recording machine and of this
+	//! one. The timestamps of samples are converted from one to the other.
+	Uint64 recordedFrequency;
+	Uint64 localFrequency;
+};
+
+#endif//TRACE_PLAYER_HPP
@@ -0,0 +1,257 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "TraceRecorder.hpp"
+
+#include <QDebug>
+
+#include <cstring>
+
+TraceRecorder::TraceRecorder() :
+    recording(false),
+    pendingSince(0),
+    lastSampleSize(0),
+    stopRequested(0),
+    droppedCount(0)
+{
+	pending.size = 0;
+}
+
+TraceRecorder::~TraceRecorder()
+{
+	stopRecording();
+}
+
+bool
+TraceRecorder::startRecording(const QString& path)
+{
+	stopRecording();
+
+	file.setFileName(path);
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+	{
+		qWarning() << "JoystickSupport: unable to create trace file" << path
+		           << file.errorString();
+		return false;
+	}
+
+	TraceFormat::FileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, TraceFormat::magic, sizeof(header.magic));
+	header.version = TraceFormat::Version;
+	header.byteOrder = TraceFormat::ByteOrderMark;
+	header.frequency = SDL_GetPerformanceFrequency();
+	header.maxDevices = InputSnapshot::MaxDevices;
+	header.maxAxes = InputSnapshot::MaxAxes;
+	header.maxButtons = InputSnapshot::MaxButtons;
+	header.maxHats = InputSnapshot::MaxHats;
+	header.maxBalls = InputSnapshot::MaxBalls;
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	pending.size = 0;
+	lastSampleSize = 0;
+	chunks.clear();
+	droppedCount.fetchAndStoreRelaxed(0);
+	stopRequested.fetchAndStoreRelaxed(0);
+	recording = true;
+	start(QThread::LowPriority);
+	qDebug() << "JoystickSupport: recording input trace to" << path;
+	return true;
+}
+
+void
+TraceRecorder::stopRecording()
+{
+	if (!recording)
+		return;
+
+	recording = false;
+	submit();
+	stopRequested.fetchAndStoreOrdered(1);
+	wait();
+	file.close();
+
+	int dropped = getDroppedCount();
+	if (dropped > 0)
+		qWarning() << "JoystickSupport: the input trace is incomplete,"
+		           << dropped << "blocks were lost.";
+}
+
+void
+TraceRecorder::recordAttach(int slot, const DeviceState& device)
+{
+	const DeviceCapabilities& caps = device.caps;
+	QByteArray name = caps.name.toUtf8();
+	if (name.size() > TraceFormat::MaxNameLength)
+	{
+		// Not in the middle of a UTF-8 sequence.
+		int length = TraceFormat::MaxNameLength;
+		while (length > 0 && (name.at(length) & 0xC0) == 0x80)
+			length--;
+		name.truncate(length);
+	}
+	quint16 nameLength = name.size();
+	reserve(1 + 6 + sizeof(Sint32) + sizeof(caps.guid.data)
+	        + sizeof(nameLength) + nameLength);
+
+	Uint8 fields[7];
+	fields[0] = TraceFormat::RecordAttach;
+	fields[1] = slot;
+	fields[2] = caps.isGamepad;
+	fields[3] = caps.axisCount;
+	fields[4] = caps.buttonCount;
+	fields[5] = caps.hatCount;
+	fields[6] = caps.ballCount;
+	append(fields, sizeof(fields));
+	Sint32 instanceId = device.instanceId;
+	append(&instanceId, sizeof(instanceId));
+	append(caps.guid.data, sizeof(caps.guid.data));
+	append(&nameLength, sizeof(nameLength));
+	append(name.constData(), nameLength);
+
+	// The next sample is recorded in any case.
+	lastSampleSize = 0;
+}
+
+void
+TraceRecorder::recordDetach(int slot)
+{
+	reserve(2);
+	Uint8 fields[2] = {TraceFormat::RecordDetach, Uint8(slot)};
+	append(fields, sizeof(fields));
+	lastSampleSize = 0;
+}
+
+void
+TraceRecorder::recordSample(const DeviceSet& devices,
+                            const InputSnapshot& snapshot)
+{
+	// Serialized first, so it can be compared with the last sample.
+	char sample[sizeof(lastSample)];
+	Uint8 slotMask = 0;
+	int size = 1;
+	bool ballsMoved = false;
+	for (int i = 0; i < devices.count(); i++)
+	{
+		int slot = devices.slot(i);
+		slotMask |= 1 << slot;
+		char* data = sample + size;
+		memcpy(data, snapshot.axes + slot * InputSnapshot::MaxAxes,
+		       InputSnapshot::MaxAxes * sizeof(Sint16));
+		data += InputSnapshot::MaxAxes * sizeof(Sint16);
+		memcpy(data, snapshot.buttons + slot * InputSnapshot::ButtonWords,
+		       InputSnapshot::ButtonWords * sizeof(quint64));
+		data += InputSnapshot::ButtonWords * sizeof(quint64);
+		memcpy(data, snapshot.hats + slot * InputSnapshot::MaxHats,
+		       InputSnapshot::MaxHats * sizeof(Uint8));
+		data += InputSnapshot::MaxHats * sizeof(Uint8);
+		const int* balls = snapshot.balls + slot * InputSnapshot::MaxBalls * 2;
+		memcpy(data, balls, InputSnapshot::MaxBalls * 2 * sizeof(int));
+		data += InputSnapshot::MaxBalls * 2 * sizeof(int);
+		for (int b = 0; b < InputSnapshot::MaxBalls * 2; b++)
+			ballsMoved |= (balls[b] != 0);
+		memcpy(data, snapshot.motion + slot * 2, 2 * sizeof(float));
+		ballsMoved |= snapshot.motionRight(slot) != 0.f
+		              || snapshot.motionUp(slot) != 0.f;
+		size += TraceFormat::slotDataSize;
+	}
+	sample[0] = slotMask;
+	// Ball motion and rotation are relative, so a repeated sample is more
+	// motion.
+	if (!ballsMoved && size == lastSampleSize
+	    && memcmp(sample, lastSample, size) == 0)
+		return;
+	memcpy(lastSample, sample, size);
+	lastSampleSize = size;
+
+	reserve(1 + sizeof(snapshot.timestamp) + size);
+	Uint8 type = TraceFormat::RecordSample;
+	append(&type, 1);
+	append(&snapshot.timestamp, sizeof(snapshot.timestamp));
+	append(sample, size);
+}
+
+void
+TraceRecorder::recordFrame(double deltaTime)
+{
+	reserve(1 + sizeof(deltaTime));
+	Uint8 type = TraceFormat::RecordFrame;
+	append(&type, 1);
+	append(&deltaTime, sizeof(deltaTime));
+
+	if (SDL_GetPerformanceCounter() - pendingSince > SDL_GetPerformanceFrequency())
+		submit();
+}
+
+int
+TraceRecorder::getDroppedCount() const
+{
+	return const_cast<QAtomicInt&>(droppedCount).fetchAndAddRelaxed(0);
+}
+
+void
+TraceRecorder::run()
+{
+	Chunk chunk;
+	for (;;)
+	{
+		// Checked before draining, so nothing submitted before the request
+		// is left behind.
+		bool stopping = (stopRequested.fetchAndAddAcquire(0) != 0);
+		bool written = false;
+		while (chunks.pop(chunk))
+		{
+			if (file.write(chunk.data, chunk.size) != chunk.size)
+				droppedCount.fetchAndAddRelaxed(1);
+			written = true;
+		}
+		if (written)
+			file.flush();
+		if (stopping)
+			return;
+		msleep(100);
+	}
+}
+
+void
+TraceRecorder::reserve(int size)
+{
+	Q_ASSERT(size <= ChunkSize);
+	if (pending.size + size > ChunkSize)
+		submit();
+	if (pending.size == 0)
+		pendingSince = SDL_GetPerformanceCounter();
+}
+
+void
+TraceRecorder::append(const void* data, int size)
+{
+	memcpy(pending.data + pending.size, data, size);
+	pending.size += size;
+}
+
+void
+TraceRecorder::submit()
+{
+	if (pending.size == 0)
+		return;
+	if (!chunks.push(pending))
+		droppedCount.fetchAndAddRelaxed(1);
+	pending.size = 0;
+}
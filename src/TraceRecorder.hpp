@@ -0,0 +1,102 @@
+/*
+Stellarium Joystick Plug-in
+Copyright (C) 2014  Bogdan Marinov <daggerstab@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef TRACE_RECORDER_HPP
+#define TRACE_RECORDER_HPP
+
+#include <QFile>
+#include <QThread>
+
+#include "DeviceSet.hpp"
+#include "SampleRing.hpp"
+#include "TraceFormat.hpp"
+
+//! Records the raw input of the devices into a trace file (see TraceFormat),
+//! so problems reported by users can be replayed by TracePlayer.
+//!
+//! Records are serialized into a preallocated chunk. Full chunks are passed
+//! through a lock-free ring buffer to a background thread that appends them
+//! to the file, so recording never waits for the disk and doesn't allocate
+//! memory. If the disk can't keep up and the ring is full, whole chunks are
+//! dropped and counted.
+//! All record*() functions must be called from the same thread.
+class TraceRecorder : public QThread
+{
+public:
+	enum
+	{
+		ChunkSize = 16384,
+		//! Number of chunks in the ring buffer, 1 MiB in total.
+		ChunkCount = 64
+	};
+
+	TraceRecorder();
+	~TraceRecorder();
+
+	//! Creates the trace file and starts the writing thread.
+	//! @returns false if the file can't be created.
+	bool startRecording(const QString& path);
+	//! Writes out everything recorded so far and closes the file.
+	void stopRecording();
+	bool isRecording() const {return recording;}
+
+	void recordAttach(int slot, const DeviceState& device);
+	void recordDetach(int slot);
+	//! Records the state of the open devices, unless it's the same as
+	//! in the last recorded sample.
+	void recordSample(const DeviceSet& devices, const InputSnapshot& snapshot);
+	//! Marks the end of a frame. Also passes the current chunk to the
+	//! writing thread if it has been waiting for more than a second.
+	void recordFrame(double deltaTime);
+
+	//! Number of chunks lost because the ring buffer was full.
+	int getDroppedCount() const;
+
+protected:
+	virtual void run();
+
+private:
+	struct Chunk
+	{
+		int size;
+		char data[ChunkSize];
+	};
+
+	//! Makes sure the current chunk has space for a record.
+	void reserve(int size);
+	void append(const void* data, int size);
+	//! Passes the current chunk to the writing thread.
+	void submit();
+
+	QFile file;
+	bool recording;
+	//! The chunk being filled.
+	Chunk pending;
+	//! Performance counter value when #pending got its first record.
+	Uint64 pendingSince;
+	//! Contents of the last recorded sample, without the timestamp.
+	char lastSample[1 + InputSnapshot::MaxDevices * TraceFormat::slotDataSize];
+	int lastSampleSize;
+
+	SampleRing<Chunk, ChunkCount> chunks;
+	QAtomicInt stopRequested;
+	QAtomicInt droppedCount;
+};
+
+#endif//TRACE_RECORDER_HPP